@@ -0,0 +1,73 @@
+#include "bdd-for-c.h"
+#include <stdint.h>
+
+static void *first_allocation;
+static char *fixture;
+
+spec("scratch memory") {
+    describe("bdd_alloc") {
+        it("should return aligned writable memory") {
+            for (size_t size = 0; size < 100; ++size) {
+                unsigned char *memory = bdd_alloc(size);
+                check(memory != NULL);
+                check((uintptr_t)memory % 16 == 0, "got: %p", (void *)memory);
+                memset(memory, 0xab, size);
+            }
+        }
+
+        it("should allocate more than a block at once") {
+            size_t size = 4 * BDD_ARENA_BLOCK_SIZE;
+            unsigned char *memory = bdd_alloc(size);
+            memset(memory, 1, size);
+            unsigned char *other = bdd_alloc(size);
+            memset(other, 2, size);
+            check(memory[size - 1] == 1);
+            check(other[0] == 2);
+        }
+
+        it("should keep the allocations of a test apart") {
+            char *strings[1000];
+            for (int i = 0; i < 1000; ++i) {
+                char buffer[16];
+                snprintf(buffer, sizeof(buffer), "%d", i);
+                strings[i] = bdd_strdup(buffer);
+            }
+            for (int i = 0; i < 1000; ++i) {
+                check(atoi(strings[i]) == i, "got: %s", strings[i]);
+            }
+        }
+    }
+
+    describe("release") {
+        it("should release the memory when the test is done") {
+            first_allocation = bdd_alloc(32);
+        }
+
+        it("should reuse the memory of the previous test") {
+            check(bdd_alloc(32) == first_allocation);
+        }
+    }
+
+    describe("threads") {
+        it_concurrently(4, 10000, "should give every thread its own memory") {
+            size_t *value = bdd_alloc(sizeof(size_t));
+            *value = bdd_thread_index();
+            check(*value == bdd_thread_index());
+        }
+    }
+
+    describe("hooks") {
+        before_each() {
+            fixture = bdd_strdup("fixture");
+        }
+
+        after_each() {
+            check(strcmp(fixture, "fixture") == 0);
+        }
+
+        it("should keep the memory of before_each for the test") {
+            check(strcmp(fixture, "fixture") == 0);
+            check(bdd_alloc(1) != (void *)fixture);
+        }
+    }
+}
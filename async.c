@@ -0,0 +1,135 @@
+#include "bdd-for-c.h"
+#include <time.h>
+#include <unistd.h>
+
+static unsigned long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000 + (unsigned long long)ts.tv_nsec / 1000000;
+}
+
+static void on_timer(bdd_async *async, void *user_data) {
+    (void)user_data;
+    bdd_done(async);
+}
+
+static void on_readable(bdd_async *async, int fd, int events, void *user_data) {
+    char buffer[16] = {0};
+    (void)user_data;
+    if (!(events & BDD_READABLE) || read(fd, buffer, sizeof(buffer) - 1) != 5) {
+        bdd_fail(async, "expected to read 5 bytes");
+        return;
+    }
+    if (strcmp(buffer, "hello") != 0) {
+        bdd_fail(async, "got: %s", buffer);
+        return;
+    }
+    bdd_done(async);
+}
+
+static void on_ready(bdd_async *async, int fd, int events, void *user_data) {
+    (void)fd;
+    (void)user_data;
+    if (!(events & BDD_READABLE)) {
+        bdd_fail(async, "expected the descriptor to be readable");
+        return;
+    }
+    bdd_done(async);
+}
+
+static void write_hello(bdd_async *async, void *user_data) {
+    int *fds = user_data;
+    (void)async;
+    if (write(fds[1], "hello", 5) != 5) {
+        bdd_fail(async, "could not write to the pipe");
+    }
+}
+
+spec("async tests") {
+    static unsigned long long started_at;
+    static int fds[2];
+    static int shared_fds[2];
+    static int watched_fds[2];
+
+    describe("timers") {
+        before() started_at = now_ms();
+
+        it_async(done, "should complete when the first timer fires") {
+            bdd_async_timer(done, 100, on_timer, NULL);
+        }
+
+        it_async(done, "should complete when the second timer fires") {
+            bdd_async_timer(done, 100, on_timer, NULL);
+        }
+
+        it_async(done, "should complete when the third timer fires") {
+            bdd_async_timer(done, 100, on_timer, NULL);
+        }
+
+        it("should have run adjacent async tests concurrently") {
+            unsigned long long elapsed = now_ms() - started_at;
+            check(elapsed < 250, "took %llu ms", elapsed);
+        }
+    }
+
+    describe("file descriptors") {
+        before_each() {
+            check(pipe(fds) == 0);
+        }
+
+        after_each() {
+            close(fds[0]);
+            close(fds[1]);
+        }
+
+        it_async(done, "should notify when a descriptor becomes readable") {
+            bdd_async_watch(done, fds[0], BDD_READABLE, on_readable, NULL);
+            bdd_async_timer(done, 10, write_hello, fds);
+        }
+
+        it_async(done, "should allow to complete synchronously") {
+            bdd_done(done);
+        }
+    }
+
+    describe("shared file descriptors") {
+        before() {
+            check(pipe(shared_fds) == 0);
+        }
+
+        it_async(done, "should keep its watch when another test unwatches the descriptor") {
+            bdd_async_watch(done, shared_fds[0], BDD_READABLE, on_readable, NULL);
+            bdd_async_timer(done, 20, write_hello, shared_fds);
+        }
+
+        it_async(done, "should only unwatch its own descriptors") {
+            bdd_async_unwatch(done, shared_fds[0]);
+            bdd_done(done);
+        }
+    }
+
+    describe("descriptors watched by several tests") {
+        before() {
+            check(pipe(watched_fds) == 0);
+        }
+
+        after() {
+            close(watched_fds[0]);
+            close(watched_fds[1]);
+        }
+
+        it_async(done, "should keep the other watches when it completes first") {
+            bdd_async_watch(done, watched_fds[0], BDD_READABLE, on_ready, NULL);
+            bdd_async_timer(done, 10, on_timer, NULL);
+        }
+
+        it_async(done, "should notify every test watching the descriptor") {
+            bdd_async_watch(done, watched_fds[0], BDD_READABLE, on_ready, NULL);
+            bdd_async_timer(done, 30, write_hello, watched_fds);
+        }
+
+        it_async(done, "should notify the other test watching it too") {
+            bdd_async_watch(done, watched_fds[0], BDD_READABLE, on_ready, NULL);
+        }
+    }
+}
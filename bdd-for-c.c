@@ -0,0 +1,4 @@
+// For `sched_setaffinity` of `BDD_PIN_CPU`
+#define _GNU_SOURCE
+#define BDD_IMPLEMENTATION
+#include "bdd-for-c.h"
@@ -29,7 +29,7 @@ SOFTWARE.
   #include <stdio.h>
   #include <Windows.h>
   #include <io.h>
-  #define __BDD_IS_ATTY__() _isatty(_fileno(stdout))
+  #define __BDD_IS_ATTY__(stream) _isatty(_fileno(stream))
 #else
   #ifndef _POSIX_C_SOURCE
     // This definition is required for `fileno` to be defined
@@ -38,14 +38,33 @@ SOFTWARE.
   #include <stdio.h>
   #include <unistd.h>
   #include <term.h>
-  #define __BDD_IS_ATTY__() isatty(fileno(stdout))
+  #include <time.h>
+  #include <poll.h>
+  #include <pthread.h>
+  #include <sched.h>
+  #include <dirent.h>
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <sys/resource.h>
+  #include <sys/socket.h>
+  #include <sys/un.h>
+  #include <sys/wait.h>
+  #ifdef __linux__
+    #include <sys/epoll.h>
+    #include <sys/inotify.h>
+  #endif
+  #define __BDD_IS_ATTY__(stream) isatty(fileno(stream))
 #endif
 
 #include <stddef.h>
+#include <stdint.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
+#include <errno.h>
+#include <signal.h>
 
 #ifdef _MSC_VER
 #pragma warning(push)
@@ -60,6 +79,60 @@ SOFTWARE.
 #define BDD_USE_TAP 0
 #endif
 
+#ifndef BDD_REPORTED_MISMATCHES
+// How many mismatching elements the bulk checks, like `check_all_eq`, list
+#define BDD_REPORTED_MISMATCHES 5
+#endif
+
+#ifndef BDD_OUTPUT_BUFFER_SIZE
+#define BDD_OUTPUT_BUFFER_SIZE (256 * 1024)
+#endif
+
+#ifndef BDD_ASYNC_TIMEOUT_MS
+#define BDD_ASYNC_TIMEOUT_MS 5000
+#endif
+
+#ifndef BDD_BENCH_SAMPLES
+#define BDD_BENCH_SAMPLES 30
+#endif
+
+#ifndef BDD_BENCH_BATCH_US
+// Every sample of a `bench_variant` runs its body for at least this long
+#define BDD_BENCH_BATCH_US 1000
+#endif
+
+#ifndef BDD_NOISY_CV
+// Benchmarks whose samples vary more than this relative to their
+// mean (coefficient of variation) are reported as noisy
+#define BDD_NOISY_CV 0.05
+#endif
+
+#ifndef BDD_INTERLEAVINGS
+// The most schedules explored for an `it_interleaved` test
+#define BDD_INTERLEAVINGS 10000
+#endif
+
+#ifndef BDD_INTERLEAVING_STEPS
+// The most scheduling decisions in a single schedule of `it_interleaved`
+#define BDD_INTERLEAVING_STEPS 100000
+#endif
+
+#ifndef BDD_INTERLEAVING_SPINS
+// A thread of `it_interleaved` that reaches the same `bdd_yield` this many
+// times in a row is waiting for the others in a loop and gives way to them
+#define BDD_INTERLEAVING_SPINS 3
+#endif
+
+#ifndef BDD_FUZZ_MAX_SIZE
+// The largest input that `fuzz_it` generates, unless a seed is larger
+#define BDD_FUZZ_MAX_SIZE 4096
+#endif
+
+#ifndef BDD_ARENA_BLOCK_SIZE
+// The size of the first block of the scratch memory of `bdd_alloc`
+#define BDD_ARENA_BLOCK_SIZE (64 * 1024)
+#endif
+
 #define __BDD_COLOR_RESET__       "\x1B[0m"
 #define __BDD_COLOR_RED__         "\x1B[31m"
 #define __BDD_COLOR_GREEN__       "\x1B[32m"
@@ -73,53 +146,6 @@ typedef struct __bdd_array__ {
     size_t size;
 } __bdd_array__;
 
-__bdd_array__ *__bdd_array_create__() {
-    __bdd_array__ *arr = malloc(sizeof(__bdd_array__));
-    if (!arr) {
-        perror("malloc(array)");
-        abort();
-    }
-    arr->capacity = 4;
-    arr->size = 0;
-    arr->values = calloc(arr->capacity, sizeof(void *));
-    return arr;
-}
-
-void *__bdd_array_push__(__bdd_array__ *arr, void *item) {
-    if (arr->size == arr->capacity) {
-        arr->capacity *= 2;
-        void *v = realloc(arr->values, sizeof(void*) * arr->capacity);
-        if (!v) {
-            perror("realloc(array)");
-            abort();
-        }
-        arr->values = v;
-    }
-    arr->values[arr->size++] = item;
-    return item;
-}
-
-void *__bdd_array_last__(__bdd_array__ *arr) {
-    if (arr->size == 0) {
-        return NULL;
-    }
-    return arr->values[arr->size - 1];
-}
-
-void *__bdd_array_pop__(__bdd_array__ *arr) {
-    if (arr->size == 0) {
-        return NULL;
-    }
-    void *result = arr->values[arr->size - 1];
-    --arr->size;
-    return result;
-}
-
-void __bdd_array_free__(__bdd_array__ *arr) {
-    free(arr->values);
-    free(arr);
-}
-
 typedef enum __bdd_node_type__ {
     __BDD_NODE_GROUP__ = 1,
     __BDD_NODE_TEST__ = 2,
@@ -130,6 +156,13 @@ typedef enum __bdd_node_flags__ {
   __bdd_node_flags_none__  = 0,
   __bdd_node_flags_focus__ = 1 << 0,
   __bdd_node_flags_skip__  = 1 << 1,
+  __bdd_node_flags_async__ = 1 << 2,
+  __bdd_node_flags_concurrent__ = 1 << 3,
+  __bdd_node_flags_timed__ = 1 << 4,
+  __bdd_node_flags_corpus__ = 1 << 5,
+  __bdd_node_flags_bench__ = 1 << 6,
+  __bdd_node_flags_interleaved__ = 1 << 7,
+  __bdd_node_flags_fuzz__ = 1 << 8,
 } __bdd_node_flags__;
 
 typedef struct __bdd_test_step__ {
@@ -138,14 +171,45 @@ typedef struct __bdd_test_step__ {
     char *name;
     __bdd_node_type__ type;
     __bdd_node_flags__ flags;
+    bool ends_test; // the last hook or the test itself, when the scratch memory is released
 } __bdd_test_step__;
 
+// A static record of a node statement, emitted by the macros into the
+// `bdd_meta` section so the spec can be listed without running it
+typedef struct __bdd_meta__ {
+    unsigned magic;
+    int type;
+    int flags;
+    int line;
+    const char *file;
+    const char *name; // the format of the name if it has arguments, null if it is not a literal
+} __bdd_meta__;
+
+#define __BDD_META_MAGIC__ 0xbdd3e7aau
+
+typedef struct __bdd_repeat_stats__ {
+    size_t passed;
+    size_t failed;
+    unsigned long long *durations;
+    size_t capacity;
+} __bdd_repeat_stats__;
+
 typedef struct __bdd_node__ {
     int id;
     int next_node_id;
     char *name;
     __bdd_node_flags__ flags;
     __bdd_node_type__ type;
+    unsigned long long params[2];
+    struct __bdd_node__ *parent;
+    bool excluded; // left out of the plan, e.g. when it belongs to another shard
+    unsigned long long duration_ns;
+    bool timed; // a test of the group ran, so its duration is worth keeping
+    unsigned long long trace_started_ns; // span of the steps of a group in the trace
+    unsigned long long trace_finished_ns;
+    __bdd_repeat_stats__ *repeat; // results of the test over all of the `BDD_REPEAT` rounds
+    void *payload; // extra state of special nodes, like the files of `it_corpus`
+    void (*free_payload)(void *payload);
     __bdd_array__ *list_before;
     __bdd_array__ *list_after;
     __bdd_array__ *list_before_each;
@@ -153,6 +217,25 @@ typedef struct __bdd_node__ {
     __bdd_array__ *list_children;
 } __bdd_node__;
 
+// Resource usage of the process, sampled around each test with `BDD_RUSAGE`
+typedef struct __bdd_rusage__ {
+    unsigned long long rss;
+    unsigned long long peak_rss;
+    unsigned long long minor_faults;
+    unsigned long long major_faults;
+    unsigned long long voluntary_switches;
+    unsigned long long involuntary_switches;
+    unsigned long long blocks_in;
+    unsigned long long blocks_out;
+} __bdd_rusage__;
+
+typedef struct bdd_async bdd_async;
+typedef struct __bdd_concurrent_thread__ __bdd_concurrent_thread__;
+typedef struct __bdd_interleaving_thread__ __bdd_interleaving_thread__;
+typedef struct __bdd_histogram__ __bdd_histogram__;
+typedef struct __bdd_arena__ __bdd_arena__;
+typedef struct __bdd_fuzz__ __bdd_fuzz__;
+
 enum __bdd_run_type__ {
     __BDD_INIT_RUN__ = 1,
     __BDD_TEST_RUN__ = 2
@@ -172,388 +255,6600 @@ typedef struct __bdd_config_type__ {
     bool use_color;
     bool use_tap;
     bool has_focus_nodes;
+    bool interactive;
+    FILE *output;
+    unsigned long long async_timeout_ms;
+    bdd_async *async_current;
+    __bdd_array__ *async_pending;
+    __bdd_array__ *async_watches;
+    __bdd_array__ *async_timers;
+    int async_poll_fd;
+    unsigned long long node_params[2];
+    __bdd_concurrent_thread__ *concurrent_thread;
+    __bdd_interleaving_thread__ *interleaving_thread;
+    const unsigned char *corpus_data;
+    size_t corpus_size;
+    const char *fuzz_target; // path of the test to fuzz with `BDD_FUZZ`
+    const char *fuzz_runs; // the other `BDD_FUZZ_*` settings, as they are written
+    const char *fuzz_seconds;
+    const char *fuzz_seed;
+    const char *fuzz_dictionary;
+    __bdd_fuzz__ *fuzz;
+    const unsigned char *fuzz_data;
+    size_t fuzz_size;
+    bool update_snapshots;
+    bool use_rusage;
+    unsigned long long bench_iterations;
+    unsigned long long bench_count;
+    unsigned long long bench_started_at;
+    unsigned long long bench_elapsed_ns;
+    __bdd_histogram__ *latency;
+    unsigned long long latency_remaining;
+    unsigned long long latency_started_at;
+    __bdd_arena__ *arena;
+    bool repeating;
+    __bdd_array__ *watch_previous; // statuses of the run before the rebuild in `BDD_WATCH`
+    __bdd_array__ *watch_results;
+    bool quiet; // only failures are printed in the rounds after the first one
+    size_t round;
+    __bdd_rusage__ rusage_before;
+    FILE *trace;
+    unsigned long long trace_origin_ns;
+    size_t trace_events;
+    size_t trace_threads;
 } __bdd_config_type__;
 
-__bdd_test_step__ *__bdd_test_step_create__(size_t level, __bdd_node__ *node) {
-    __bdd_test_step__ *step = malloc(sizeof(__bdd_test_step__));
-    if (!step) {
-        perror("malloc(step)");
-        abort();
-    }
-    step->id = node->id;
-    step->level = level;
-    step->type = node->type;
-    step->name = node->name;
-    step->flags = node->flags;
-    return step;
-}
+#define BDD_READABLE 1
+#define BDD_WRITABLE 2
 
-__bdd_node__ *__bdd_node_create__(int id, char *name, __bdd_node_type__ type, __bdd_node_flags__ flags) {
-    __bdd_node__ *n = malloc(sizeof(__bdd_node__));
-    if (!n) {
-        perror("malloc(node)");
-        abort();
-    }
-    n->id = id;
-    n->next_node_id = id + 1;
-    n->name = name; // node takes ownership of name
-    n->type = type;
-    n->flags = flags;
-    n->list_before = __bdd_array_create__();
-    n->list_after = __bdd_array_create__();
-    n->list_before_each = __bdd_array_create__();
-    n->list_after_each = __bdd_array_create__();
-    n->list_children = __bdd_array_create__();
-    return n;
-}
+typedef void (*bdd_io_callback)(bdd_async *async, int fd, int events, void *user_data);
+typedef void (*bdd_timer_callback)(bdd_async *async, void *user_data);
 
-bool __bdd_node_is_leaf__(__bdd_node__ *node) {
-    return node->list_children->size == 0;
-}
+extern char *__bdd_spec_name__;
+void __bdd_test_main__(__bdd_config_type__ *__bdd_config__);
 
-void __bdd_node_flatten_internal__(
+char *__bdd_format__(const char *format, ...);
+bool __bdd_enter_node__(
+    __bdd_node_flags__ node_flags,
     __bdd_config_type__ *config,
-    size_t level,
-    __bdd_node__ *node,
-    __bdd_array__  *steps,
-    __bdd_array__  *before_each_lists,
-    __bdd_array__  *after_each_lists
-) {
-    if (__bdd_node_is_leaf__(node)) {
-        if (config->has_focus_nodes && !(node->flags & __bdd_node_flags_focus__)) {
-            return;
-        }
+    __bdd_node_type__ type,
+    ptrdiff_t list_offset,
+    const char *fmt,
+    ...
+);
+bool __bdd_node_params__(__bdd_config_type__ *config, unsigned long long param0, unsigned long long param1);
+void __bdd_exit_node__(__bdd_config_type__ *config);
+size_t __bdd_thread_index__(__bdd_config_type__ *config);
+bool __bdd_concurrent_next__(__bdd_config_type__ *config);
+bool __bdd_interleaving_next__(__bdd_config_type__ *config);
+bool __bdd_interleaving_setup__(__bdd_config_type__ *config, bool begin);
+bool __bdd_interleaving_verify__(__bdd_config_type__ *config);
+void __bdd_interleaving_yield__(const char *location);
+void __bdd_async_fail__(bdd_async *async, const char *location, char *message);
+size_t __bdd_corpus_count__(__bdd_config_type__ *config, const char *spec_file);
+const char *__bdd_corpus_file__(__bdd_config_type__ *config, size_t index);
+const unsigned char *__bdd_corpus_map__(__bdd_config_type__ *config);
+bool __bdd_fuzz_next__(__bdd_config_type__ *config, const char *spec_file);
+bool __bdd_check_mem_eq__(
+    __bdd_config_type__ *config,
+    const char *location,
+    const void *actual,
+    const void *expected,
+    size_t size,
+    const char *actual_text,
+    const char *expected_text
+);
+bool __bdd_check_all_eq__(
+    __bdd_config_type__ *config, const char *location, const int *values, size_t count, int value, const char *text
+);
+bool __bdd_check_floats_close__(
+    __bdd_config_type__ *config,
+    const char *location,
+    const float *actual,
+    const float *expected,
+    size_t count,
+    float tolerance,
+    const char *actual_text,
+    const char *expected_text
+);
+bool __bdd_check_doubles_close__(
+    __bdd_config_type__ *config,
+    const char *location,
+    const double *actual,
+    const double *expected,
+    size_t count,
+    double tolerance,
+    const char *actual_text,
+    const char *expected_text
+);
+bool __bdd_check_sorted__(
+    __bdd_config_type__ *config, const char *location, const int *values, size_t count, const char *text
+);
+bool __bdd_bench_next__(__bdd_config_type__ *config);
+bool __bdd_check_faster__(
+    __bdd_config_type__ *config, const char *location, const char *faster, const char *slower, double ratio
+);
+bool __bdd_check_rss_below__(__bdd_config_type__ *config, const char *location, unsigned long long bytes);
+void __bdd_latency_start__(__bdd_config_type__ *config, unsigned long long iterations);
+void *__bdd_arena_alloc__(__bdd_config_type__ *config, size_t size);
+char *__bdd_arena_strdup__(__bdd_config_type__ *config, const char *string);
+bool __bdd_latency_next__(__bdd_config_type__ *config);
+bool __bdd_check_percentile__(
+    __bdd_config_type__ *config, const char *location, double percentile, unsigned long long limit_ns
+);
+bool __bdd_check_snapshot__(
+    __bdd_config_type__ *config,
+    const char *spec_file,
+    const char *location,
+    const void *data,
+    size_t size,
+    const char *name
+);
 
-        for (size_t listIndex = 0; listIndex < before_each_lists->size; ++listIndex) {
-            __bdd_array__ *list = before_each_lists->values[listIndex];
-            for (size_t i = 0; i < list->size; ++i) {
-                __bdd_array_push__(steps, __bdd_test_step_create__(level, list->values[i]));
-            }
-        }
+void bdd_done(bdd_async *async);
+void bdd_async_timeout(bdd_async *async, unsigned long long ms);
+void bdd_async_timer(bdd_async *async, unsigned long long ms, bdd_timer_callback callback, void *user_data);
+void bdd_async_watch(bdd_async *async, int fd, int events, bdd_io_callback callback, void *user_data);
+void bdd_async_unwatch(bdd_async *async, int fd);
 
-        __bdd_array_push__(steps, __bdd_test_step_create__(level, node));
+// Settings of a run started with `bdd_run`. The zero value runs
+// all the tests and prints the tree to `stdout` without colors.
+typedef struct bdd_options {
+    FILE *output; // `stdout` when NULL
+    bool use_tap;
+    bool use_color;
+    const char *filter; // only runs the tests with this text in their path
+    bool use_environment; // reads the other `BDD_*` variables, as `main` does
+} bdd_options;
 
-        for (size_t listIndex = 0; listIndex < after_each_lists->size; ++listIndex) {
-            size_t reverseListIndex = after_each_lists->size - listIndex - 1;
-            __bdd_array__ *list = after_each_lists->values[reverseListIndex];
-            for (size_t i = 0; i < list->size; ++i) {
-                __bdd_array_push__(steps, __bdd_test_step_create__(level, list->values[i]));
-            }
-        }
-        return;
-    }
+typedef struct bdd_result {
+    size_t test_count;
+    size_t failed_test_count;
+    size_t rounds;
+    unsigned long long duration_ns;
+} bdd_result;
 
-    __bdd_array_push__(steps, __bdd_test_step_create__(level, node));
+void bdd_options_from_environment(bdd_options *options);
 
-    for (size_t i = 0; i < node->list_before->size; ++i) {
-        __bdd_array_push__(steps, __bdd_test_step_create__(level + 1, node->list_before->values[i]));
-    }
+// Runs the spec in the calling process and returns the exit code of `main`.
+// Every call discovers the spec again and starts from a clean state, so the
+// spec can be run repeatedly, e.g. by a benchmark or a fuzzing driver.
+int bdd_run(const bdd_options *options, bdd_result *result);
 
-    __bdd_array_push__(before_each_lists, node->list_before_each);
-    __bdd_array_push__(after_each_lists, node->list_after_each);
+#define spec(name) \
+char *__bdd_spec_name__ = (name);\
+void __bdd_test_main__ (__bdd_config_type__ *__bdd_config__)\
 
-    for (size_t i = 0; i < node->list_children->size; ++i) {
-        __bdd_node_flatten_internal__(
-          config, level + 1, node->list_children->values[i], steps, before_each_lists, after_each_lists
-        );
-    }
+// A part of the spec defined in another file
+#define spec_part(name) void name(__bdd_config_type__ *__bdd_config__)
+#define include_spec_part(name) do {\
+    name(__bdd_config__);\
+    if (__bdd_config__->error) {\
+        return;\
+    }\
+} while (0)
 
-    __bdd_array_pop__(before_each_lists);
-    __bdd_array_pop__(after_each_lists);
+#define __BDD_FIRST__(first, ...) first
 
-    for (size_t i = 0; i < node->list_after->size; ++i) {
-        __bdd_array_push__(steps, __bdd_test_step_create__(level + 1, node->list_after->values[i]));
-    }
-}
+#if defined(__GNUC__) && defined(__ELF__) && !defined(BDD_NO_META)
+// Only string literals can be stored in a static record, any
+// other name, like a variable, is recorded as unknown (null)
+#define __BDD_META_NAME__(name) (__builtin_constant_p(name) ? (name) : 0)
+#define __BDD_META__(flags, type, ...) __extension__ ({\
+    static const __bdd_meta__ __bdd_meta_record__\
+        __attribute__((section("bdd_meta"), used, aligned(sizeof(void *)))) = {\
+        __BDD_META_MAGIC__, (type), (flags), __LINE__, __FILE__, __BDD_META_NAME__(__BDD_FIRST__(__VA_ARGS__, 0))\
+    };\
+    0;\
+})
+#else
+#define __BDD_META__(flags, type, ...) 0
+#endif
 
-__bdd_array__ *__bdd_node_flatten__(__bdd_config_type__ *config, __bdd_node__ *node, __bdd_array__ *steps) {
-    if (node == NULL) {
-        return steps;
-    }
+#define __BDD_NODE__(flags, node_list, type, ...)\
+for(\
+    bool __bdd_has_run__ = __BDD_META__(flags, type, __VA_ARGS__);\
+    (\
+      !__bdd_has_run__ && \
+      __bdd_enter_node__(flags, __bdd_config__, (type), offsetof(struct __bdd_node__, node_list), __VA_ARGS__) \
+    );\
+    __bdd_exit_node__(__bdd_config__), \
+    __bdd_has_run__ = 1 \
+)
 
-    __bdd_array__ *before_each_lists = __bdd_array_create__();
-    __bdd_array__ *after_each_lists = __bdd_array_create__();
-    __bdd_node_flatten_internal__(config, 0, node, steps, before_each_lists, after_each_lists);
-    __bdd_array_free__(before_each_lists);
-    __bdd_array_free__(after_each_lists);
+#define __BDD_NODE_WITH_PARAMS__(param0, param1, flags, node_list, type, ...)\
+for(\
+    bool __bdd_has_run__ = __BDD_META__(flags, type, __VA_ARGS__);\
+    (\
+      !__bdd_has_run__ && \
+      __bdd_node_params__(__bdd_config__, (param0), (param1)) && \
+      __bdd_enter_node__(flags, __bdd_config__, (type), offsetof(struct __bdd_node__, node_list), __VA_ARGS__) \
+    );\
+    __bdd_exit_node__(__bdd_config__), \
+    __bdd_has_run__ = 1 \
+)
 
-    return steps;
-}
+#define describe(...) __BDD_NODE__(__bdd_node_flags_none__, list_children, __BDD_NODE_GROUP__, __VA_ARGS__)
+#define it(...)       __BDD_NODE__(__bdd_node_flags_none__, list_children, __BDD_NODE_TEST__, __VA_ARGS__)
+#define it_only(...)  __BDD_NODE__(__bdd_node_flags_focus__, list_children, __BDD_NODE_TEST__, __VA_ARGS__)
+#define fit(...)      it_only(__VA_ARGS__)
+#define it_skip(...)  __BDD_NODE__(__bdd_node_flags_skip__, list_children, __BDD_NODE_TEST__, __VA_ARGS__)
+#define xit(...)      it_skip(__VA_ARGS__)
+#define it_async(handle, ...)\
+for (\
+    bdd_async *handle = __bdd_config__->async_current, *__bdd_async_once__ = (bdd_async *)1;\
+    __bdd_async_once__ && ((void)handle, 1);\
+    __bdd_async_once__ = NULL\
+)\
+__BDD_NODE__(__bdd_node_flags_async__, list_children, __BDD_NODE_TEST__, __VA_ARGS__)
 
-void __bdd_node_free__(__bdd_node__ *n) {
-    free(n->name);
-    __bdd_array_free__(n->list_before);
-    __bdd_array_free__(n->list_after);
-    __bdd_array_free__(n->list_before_each);
-    __bdd_array_free__(n->list_after_each);
-    __bdd_array_free__(n->list_children);
-    free(n);
-}
+#define it_concurrently(threads, iterations, ...)\
+__BDD_NODE_WITH_PARAMS__(\
+    (threads), (iterations), __bdd_node_flags_concurrent__, list_children, __BDD_NODE_TEST__, __VA_ARGS__\
+)\
+while (__bdd_concurrent_next__(__bdd_config__))
+#define it_concurrently_for(threads, milliseconds, ...)\
+__BDD_NODE_WITH_PARAMS__(\
+    (threads), (milliseconds), __bdd_node_flags_concurrent__ | __bdd_node_flags_timed__,\
+    list_children, __BDD_NODE_TEST__, __VA_ARGS__\
+)\
+while (__bdd_concurrent_next__(__bdd_config__))
+#define bdd_thread_index() __bdd_thread_index__(__bdd_config__)
 
-char *__bdd_spec_name__;
-void __bdd_test_main__(__bdd_config_type__ *__bdd_config__);
-char *__bdd_vformat__(const char *format, va_list va);
+#define it_interleaved(threads, preemptions, ...)\
+__BDD_NODE_WITH_PARAMS__(\
+    (threads), (preemptions), __bdd_node_flags_interleaved__, list_children, __BDD_NODE_TEST__, __VA_ARGS__\
+)\
+while (__bdd_interleaving_next__(__bdd_config__))
+#define interleaving_setup \
+for (\
+    bool __bdd_setup_once__ = __bdd_interleaving_setup__(__bdd_config__, true);\
+    __bdd_setup_once__;\
+    __bdd_setup_once__ = __bdd_interleaving_setup__(__bdd_config__, false)\
+)
+#define interleaving_verify if (__bdd_interleaving_verify__(__bdd_config__))
+#define bdd_yield() __bdd_interleaving_yield__(__BDD_LOCATION__)
 
-void __bdd_indent__(FILE *fp, size_t level) {
-    for (size_t i = 0; i < level; ++i) {
-        fprintf(fp, "  ");
-    }
-}
+#define it_corpus(directory, data, size)\
+__BDD_NODE__(__bdd_node_flags_corpus__, list_children, __BDD_NODE_GROUP__, "%s", (directory))\
+for (\
+    size_t __bdd_corpus_index__ = 0;\
+    __bdd_corpus_index__ < __bdd_corpus_count__(__bdd_config__, __FILE__);\
+    ++__bdd_corpus_index__\
+)\
+__BDD_NODE__(\
+    __bdd_node_flags_none__, list_children, __BDD_NODE_TEST__,\
+    "%s", __bdd_corpus_file__(__bdd_config__, __bdd_corpus_index__)\
+)\
+for (const unsigned char *data = __bdd_corpus_map__(__bdd_config__); data; data = NULL)\
+for (size_t size = __bdd_config__->corpus_size, __bdd_corpus_once__ = 1; __bdd_corpus_once__ && ((void)data, (void)size, 1); __bdd_corpus_once__ = 0)
 
-bool __bdd_enter_node__(__bdd_node_flags__ node_flags, __bdd_config_type__ *config, __bdd_node_type__ type, ptrdiff_t list_offset, char *fmt, ...) {
-    va_list va;
-    va_start(va, fmt);
-    char *name = __bdd_vformat__(fmt, va);
-    va_end(va);
+#define fuzz_it(name, data, size)\
+__BDD_NODE__(__bdd_node_flags_fuzz__, list_children, __BDD_NODE_TEST__, name)\
+while (__bdd_fuzz_next__(__bdd_config__, __FILE__))\
+for (const unsigned char *data = __bdd_config__->fuzz_data; data; data = NULL)\
+for (size_t size = __bdd_config__->fuzz_size, __bdd_fuzz_once__ = 1; __bdd_fuzz_once__ && ((void)data, (void)size, 1); __bdd_fuzz_once__ = 0)
 
-    if (config->run == __BDD_INIT_RUN__) {
-        __bdd_node__ *top = __bdd_array_last__(config->node_stack);
-        __bdd_array__ *list = *(__bdd_array__ **)((unsigned char *)top + list_offset);
+// Variants of a benchmark in the same group are run in turns and compared
+#define bench_variant(...)\
+__BDD_NODE__(__bdd_node_flags_bench__, list_children, __BDD_NODE_TEST__, __VA_ARGS__)\
+while (__bdd_bench_next__(__bdd_config__))
 
-        int id = config->id++;
-        __bdd_node__ *node = __bdd_node_create__(id, name, type, node_flags);
-        if (node_flags & __bdd_node_flags_focus__) {
-            // Propagate focus to group nodes up the tree to print inly them
-            top->flags |= node_flags & __bdd_node_flags_focus__;
-            config->has_focus_nodes = true;
-        }
-        __bdd_array_push__(list, node);
-        __bdd_array_push__(config->nodes, node);
-        if (type == __BDD_NODE_GROUP__) {
-            __bdd_array_push__(config->node_stack, node);
-            return true;
-        }
-        return false;
-    }
+#define before_each() __BDD_NODE__(__bdd_node_flags_none__, list_before_each, __BDD_NODE_INTERIM__, "before_each")
+#define after_each()  __BDD_NODE__(__bdd_node_flags_none__, list_after_each, __BDD_NODE_INTERIM__, "after_each")
+#define before()      __BDD_NODE__(__bdd_node_flags_none__, list_before, __BDD_NODE_INTERIM__, "before")
+#define after()       __BDD_NODE__(__bdd_node_flags_none__, list_after, __BDD_NODE_INTERIM__, "after")
 
-    if (config->id >= (int)config->nodes->size) {
-        fprintf(stderr, "non-deterministic spec\n");
-        abort();
-    }
-    __bdd_node__ *node = config->nodes->values[config->id];
-    if (node->type != type || strcmp(node->name, name) != 0) {
-        fprintf(stderr, "non-deterministic spec\n");
-        abort();
-    }
-    free(name);
+#ifndef BDD_NO_CONTEXT_KEYWORD
+#define context(name) describe(name)
+#endif
 
-    __bdd_test_step__ *step = config->current_test;
-    bool should_enter = step->id >= node->id && step->id < node->next_node_id;
-    if (should_enter) {
-        __bdd_array_push__(config->node_stack, node);
-        config->id++;
+#define __BDD_MACRO__(M, ...) __BDD_OVERLOAD__(M, __BDD_COUNT_ARGS__(__VA_ARGS__)) (__VA_ARGS__)
+#define __BDD_OVERLOAD__(macro_name, suffix) __BDD_EXPAND_OVERLOAD__(macro_name, suffix)
+#define __BDD_EXPAND_OVERLOAD__(macro_name, suffix) macro_name##suffix
+
+#define __BDD_COUNT_ARGS__(...) __BDD_PATTERN_MATCH__(__VA_ARGS__,_,_,_,_,_,_,_,_,_,ONE__)
+#define __BDD_PATTERN_MATCH__(_1,_2,_3,_4,_5,_6,_7,_8,_9,_10,N, ...) N
+
+#define __BDD_STRING_HELPER__(x) #x
+#define __BDD_STRING__(x) __BDD_STRING_HELPER__(x)
+#define __STRING__LINE__ __BDD_STRING__(__LINE__)
+
+#define __BDD_FMT_COLOR__ __BDD_COLOR_RED__ "Check failed:" __BDD_COLOR_RESET__ " %s"
+#define __BDD_FMT_PLAIN__ "Check failed: %s"
+
+#define __BDD_CHECK__(condition, ...) if (!(condition))\
+{\
+    char *message = __bdd_format__(__VA_ARGS__);\
+    const char *fmt = __bdd_config__->use_color ? __BDD_FMT_COLOR__ : __BDD_FMT_PLAIN__;\
+    __bdd_config__->location = "at " __FILE__ ":" __STRING__LINE__;\
+    size_t bufflen = strlen(fmt) + strlen(message) + 1;\
+    __bdd_config__->error = calloc(bufflen, sizeof(char));\
+    if (__bdd_config__->use_color) {\
+      snprintf(__bdd_config__->error, bufflen, __BDD_FMT_COLOR__, message);\
+    } else {\
+      snprintf(__bdd_config__->error, bufflen, __BDD_FMT_PLAIN__, message);\
+    }\
+    free(message);\
+    return;\
+}
+
+#define __BDD_CHECK_ONE__(condition) __BDD_CHECK__(condition, #condition)
+
+#define check(...) __BDD_MACRO__(__BDD_CHECK_, __VA_ARGS__)
+
+#define __BDD_LOCATION__ "at " __FILE__ ":" __STRING__LINE__
+
+#define check_faster(faster, slower, ratio)\
+if (!__bdd_check_faster__(__bdd_config__, __BDD_LOCATION__, (faster), (slower), (ratio)))\
+{\
+    return;\
+}
+
+#define BDD_NS 1ull
+#define BDD_US 1000ull
+#define BDD_MS 1000000ull
+
+#define measure_latency(iterations)\
+for (\
+    __bdd_latency_start__(__bdd_config__, (iterations));\
+    __bdd_latency_next__(__bdd_config__);\
+)
+
+#define check_percentile(percentile, limit_ns)\
+if (!__bdd_check_percentile__(__bdd_config__, __BDD_LOCATION__, (percentile), (limit_ns)))\
+{\
+    return;\
+}
+
+// Scratch memory that is released when the test and its `after_each` hooks are done
+#define bdd_alloc(size) __bdd_arena_alloc__(__bdd_config__, (size))
+#define bdd_strdup(string) __bdd_arena_strdup__(__bdd_config__, (string))
+
+#define check_rss_below(bytes)\
+if (!__bdd_check_rss_below__(__bdd_config__, __BDD_LOCATION__, (bytes)))\
+{\
+    return;\
+}
+
+#define check_snapshot(data, size, name)\
+if (!__bdd_check_snapshot__(__bdd_config__, __FILE__, __BDD_LOCATION__, (data), (size), (name)))\
+{\
+    return;\
+}
+
+// Bulk checks scan whole arrays and report how many elements do not match
+#define check_mem_eq(actual, expected, size)\
+if (!__bdd_check_mem_eq__(__bdd_config__, __BDD_LOCATION__, (actual), (expected), (size), #actual, #expected))\
+{\
+    return;\
+}
+
+#define check_all_eq(values, count, value)\
+if (!__bdd_check_all_eq__(__bdd_config__, __BDD_LOCATION__, (values), (count), (value), #values))\
+{\
+    return;\
+}
+
+#define check_floats_close(actual, expected, count, tolerance)\
+if (!__bdd_check_floats_close__(\
+    __bdd_config__, __BDD_LOCATION__, (actual), (expected), (count), (tolerance), #actual, #expected\
+))\
+{\
+    return;\
+}
+
+#define check_doubles_close(actual, expected, count, tolerance)\
+if (!__bdd_check_doubles_close__(\
+    __bdd_config__, __BDD_LOCATION__, (actual), (expected), (count), (tolerance), #actual, #expected\
+))\
+{\
+    return;\
+}
+
+#define check_sorted(values, count)\
+if (!__bdd_check_sorted__(__bdd_config__, __BDD_LOCATION__, (values), (count), #values))\
+{\
+    return;\
+}
+
+#define bdd_fail(async, ...) __bdd_async_fail__((async), "at " __FILE__ ":" __STRING__LINE__, __bdd_format__(__VA_ARGS__))
+
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#endif //BDD_FOR_C_H
+
+// The runtime is compiled once, either by defining `BDD_IMPLEMENTATION` before
+// including this file in exactly one translation unit or by linking `bdd-for-c.c`.
+#if defined(BDD_IMPLEMENTATION) && !defined(BDD_FOR_C_IMPLEMENTATION)
+#define BDD_FOR_C_IMPLEMENTATION
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable: 4996) // _CRT_SECURE_NO_WARNINGS
+#endif
+
+// Counters of the work done by the framework itself, printed at
+// the end of the run when the `BDD_STATS` environment variable is set.
+typedef struct __bdd_stats_type__ {
+    bool enabled;
+    unsigned long long discovery_enters;
+    unsigned long long test_enters;
+    unsigned long long entered;
+    unsigned long long skipped;
+    unsigned long long test_main_calls;
+    unsigned long long format_calls;
+    unsigned long long formatted_bytes;
+    unsigned long long allocations;
+    unsigned long long discovery_ns;
+    unsigned long long flatten_ns;
+    unsigned long long execution_ns;
+    unsigned long long body_ns;
+    unsigned long long body_started_at;
+} __bdd_stats_type__;
+
+__bdd_stats_type__ __bdd_stats__ = { 0 };
+
+// Concurrent tests update the counters from several threads
+#if defined(__GNUC__)
+#define __BDD_STATS_ADD__(counter, value) do {\
+    if (__bdd_stats__.enabled) {\
+        __atomic_fetch_add(&__bdd_stats__.counter, (value), __ATOMIC_RELAXED);\
+    }\
+} while (0)
+#else
+#define __BDD_STATS_ADD__(counter, value) do {\
+    if (__bdd_stats__.enabled) {\
+        __bdd_stats__.counter += (value);\
+    }\
+} while (0)
+#endif
+
+unsigned long long __bdd_now_ns__();
+
+void *__bdd_malloc__(size_t size) {
+    __BDD_STATS_ADD__(allocations, 1);
+    return malloc(size);
+}
+
+void *__bdd_calloc__(size_t count, size_t size) {
+    __BDD_STATS_ADD__(allocations, 1);
+    return calloc(count, size);
+}
+
+void *__bdd_realloc__(void *pointer, size_t size) {
+    __BDD_STATS_ADD__(allocations, 1);
+    return realloc(pointer, size);
+}
+
+// The time spent in the body of the running test or hook, which is
+// measured from entering its node either until leaving it or until
+// `__bdd_test_main__` returns early after a failed `check`.
+void __bdd_stats_body_start__(__bdd_config_type__ *config) {
+    if (__bdd_stats__.enabled && !config->concurrent_thread && !config->interleaving_thread) {
+        __bdd_stats__.body_started_at = __bdd_now_ns__();
+    }
+}
+
+void __bdd_stats_body_end__() {
+    if (__bdd_stats__.body_started_at) {
+        __bdd_stats__.body_ns += __bdd_now_ns__() - __bdd_stats__.body_started_at;
+        __bdd_stats__.body_started_at = 0;
+    }
+}
+
+void __bdd_call_test_main__(__bdd_config_type__ *config) {
+    __BDD_STATS_ADD__(test_main_calls, 1);
+    __bdd_test_main__(config);
+    if (!config->concurrent_thread && !config->interleaving_thread) {
+        __bdd_stats_body_end__();
+    }
+}
+
+__bdd_array__ *__bdd_array_create__() {
+    __bdd_array__ *arr = __bdd_malloc__(sizeof(__bdd_array__));
+    if (!arr) {
+        perror("malloc(array)");
+        abort();
+    }
+    arr->capacity = 4;
+    arr->size = 0;
+    arr->values = __bdd_calloc__(arr->capacity, sizeof(void *));
+    return arr;
+}
+
+void *__bdd_array_push__(__bdd_array__ *arr, void *item) {
+    if (arr->size == arr->capacity) {
+        arr->capacity *= 2;
+        void *v = __bdd_realloc__(arr->values, sizeof(void*) * arr->capacity);
+        if (!v) {
+            perror("realloc(array)");
+            abort();
+        }
+        arr->values = v;
+    }
+    arr->values[arr->size++] = item;
+    return item;
+}
+
+void *__bdd_array_last__(__bdd_array__ *arr) {
+    if (arr->size == 0) {
+        return NULL;
+    }
+    return arr->values[arr->size - 1];
+}
+
+void *__bdd_array_pop__(__bdd_array__ *arr) {
+    if (arr->size == 0) {
+        return NULL;
+    }
+    void *result = arr->values[arr->size - 1];
+    --arr->size;
+    return result;
+}
+
+void *__bdd_array_remove__(__bdd_array__ *arr, size_t index) {
+    if (index >= arr->size) {
+        return NULL;
+    }
+    void *result = arr->values[index];
+    memmove(&arr->values[index], &arr->values[index + 1], sizeof(void *) * (arr->size - index - 1));
+    --arr->size;
+    return result;
+}
+
+char *__bdd_strdup__(const char *str) {
+    size_t size = strlen(str) + 1;
+    char *result = __bdd_malloc__(size);
+    if (!result) {
+        perror("malloc(strdup)");
+        abort();
+    }
+    memcpy(result, str, size);
+    return result;
+}
+
+void __bdd_array_free__(__bdd_array__ *arr) {
+    free(arr->values);
+    free(arr);
+}
+
+// Scratch memory of `bdd_alloc`, released all at once when a test is done
+typedef struct __bdd_arena_block__ {
+    struct __bdd_arena_block__ *next; // the block that was filled before
+    size_t size;
+} __bdd_arena_block__;
+
+struct __bdd_arena__ {
+    __bdd_arena_block__ *block; // the block being filled
+    size_t used; // of the block being filled
+    size_t allocated; // since the last reset
+    size_t high_water; // the most allocated between two resets
+    unsigned long long allocations;
+};
+
+// A position in the arena to roll the allocations back to
+typedef struct __bdd_arena_mark__ {
+    __bdd_arena_block__ *block;
+    size_t used;
+    size_t allocated;
+} __bdd_arena_mark__;
+
+#define __BDD_ARENA_ALIGNMENT__ 16
+#define __BDD_ARENA_HEADER_SIZE__ \
+    ((sizeof(__bdd_arena_block__) + __BDD_ARENA_ALIGNMENT__ - 1) & ~(size_t)(__BDD_ARENA_ALIGNMENT__ - 1))
+
+__bdd_arena__ *__bdd_arena_create__() {
+    __bdd_arena__ *arena = __bdd_calloc__(1, sizeof(__bdd_arena__));
+    if (!arena) {
+        perror("calloc(arena)");
+        abort();
+    }
+    return arena;
+}
+
+void *__bdd_arena_alloc__(__bdd_config_type__ *config, size_t size) {
+    __bdd_arena__ *arena = config->arena;
+    size_t aligned = (size + __BDD_ARENA_ALIGNMENT__ - 1) & ~(size_t)(__BDD_ARENA_ALIGNMENT__ - 1);
+    if (aligned < size) {
+        return NULL;
+    }
+    if (aligned == 0) {
+        aligned = __BDD_ARENA_ALIGNMENT__;
+    }
+    if (!arena->block || arena->block->size - arena->used < aligned) {
+        // Every new block is twice as big as the last one,
+        // so a test allocates a logarithmic number of blocks
+        size_t block_size = arena->block ? arena->block->size * 2 : BDD_ARENA_BLOCK_SIZE;
+        if (block_size < aligned) {
+            block_size = aligned;
+        }
+        __bdd_arena_block__ *block = __bdd_malloc__(__BDD_ARENA_HEADER_SIZE__ + block_size);
+        if (!block) {
+            perror("malloc(arena)");
+            abort();
+        }
+        block->next = arena->block;
+        block->size = block_size;
+        arena->block = block;
+        arena->used = 0;
+    }
+    void *result = (unsigned char *)arena->block + __BDD_ARENA_HEADER_SIZE__ + arena->used;
+    arena->used += aligned;
+    arena->allocated += aligned;
+    ++arena->allocations;
+    return result;
+}
+
+char *__bdd_arena_strdup__(__bdd_config_type__ *config, const char *string) {
+    size_t size = strlen(string) + 1;
+    char *result = __bdd_arena_alloc__(config, size);
+    memcpy(result, string, size);
+    return result;
+}
+
+__bdd_arena_mark__ __bdd_arena_save__(__bdd_arena__ *arena) {
+    __bdd_arena_mark__ mark = { arena->block, arena->used, arena->allocated };
+    return mark;
+}
+
+void __bdd_arena_rewind__(__bdd_arena__ *arena, __bdd_arena_mark__ mark) {
+    if (arena->allocated > arena->high_water) {
+        arena->high_water = arena->allocated;
+    }
+    while (arena->block != mark.block) {
+        __bdd_arena_block__ *next = arena->block->next;
+        free(arena->block);
+        arena->block = next;
+    }
+    arena->used = mark.used;
+    arena->allocated = mark.allocated;
+}
+
+void __bdd_arena_reset__(__bdd_arena__ *arena) {
+    size_t capacity = 0;
+    for (__bdd_arena_block__ *block = arena->block; block; block = block->next) {
+        capacity += block->size;
+    }
+    __bdd_arena_mark__ empty = { NULL, 0, 0 };
+    if (arena->block && arena->block->next) {
+        // Replaced with a single block, so the next test with
+        // the same allocations fits in it without growing
+        __bdd_arena_rewind__(arena, empty);
+        arena->block = __bdd_malloc__(__BDD_ARENA_HEADER_SIZE__ + capacity);
+        if (!arena->block) {
+            perror("malloc(arena)");
+            abort();
+        }
+        arena->block->next = NULL;
+        arena->block->size = capacity;
+    } else {
+        empty.block = arena->block;
+        __bdd_arena_rewind__(arena, empty);
+    }
+}
+
+void __bdd_arena_free__(__bdd_arena__ *arena) {
+    __bdd_arena_mark__ empty = { NULL, 0, 0 };
+    __bdd_arena_rewind__(arena, empty);
+    free(arena);
+}
+
+__bdd_test_step__ *__bdd_test_step_create__(size_t level, __bdd_node__ *node) {
+    __bdd_test_step__ *step = __bdd_malloc__(sizeof(__bdd_test_step__));
+    if (!step) {
+        perror("malloc(step)");
+        abort();
+    }
+    step->id = node->id;
+    step->level = level;
+    step->type = node->type;
+    step->name = node->name;
+    step->flags = node->flags;
+    step->ends_test = false;
+    return step;
+}
+
+__bdd_node__ *__bdd_node_create__(int id, char *name, __bdd_node_type__ type, __bdd_node_flags__ flags) {
+    __bdd_node__ *n = __bdd_malloc__(sizeof(__bdd_node__));
+    if (!n) {
+        perror("malloc(node)");
+        abort();
+    }
+    n->id = id;
+    n->next_node_id = id + 1;
+    n->name = name; // node takes ownership of name
+    n->type = type;
+    n->flags = flags;
+    n->params[0] = 0;
+    n->params[1] = 0;
+    n->parent = NULL;
+    n->excluded = false;
+    n->duration_ns = 0;
+    n->timed = false;
+    n->trace_started_ns = 0;
+    n->trace_finished_ns = 0;
+    n->repeat = NULL;
+    n->payload = NULL;
+    n->free_payload = NULL;
+    n->list_before = __bdd_array_create__();
+    n->list_after = __bdd_array_create__();
+    n->list_before_each = __bdd_array_create__();
+    n->list_after_each = __bdd_array_create__();
+    n->list_children = __bdd_array_create__();
+    return n;
+}
+
+bool __bdd_node_is_leaf__(__bdd_node__ *node) {
+    return node->list_children->size == 0;
+}
+
+// Whether a hook is a `before` or `after` hook of its group
+bool __bdd_node_is_group_hook__(__bdd_node__ *node) {
+    __bdd_array__ *lists[] = { node->parent->list_before, node->parent->list_after };
+    for (size_t l = 0; l < sizeof(lists) / sizeof(lists[0]); ++l) {
+        for (size_t i = 0; i < lists[l]->size; ++i) {
+            if (lists[l]->values[i] == node) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void __bdd_node_flatten_internal__(
+    __bdd_config_type__ *config,
+    size_t level,
+    __bdd_node__ *node,
+    __bdd_array__  *steps,
+    __bdd_array__  *before_each_lists,
+    __bdd_array__  *after_each_lists
+) {
+    if (node->excluded) {
+        return;
+    }
+
+    if (__bdd_node_is_leaf__(node)) {
+        if (config->has_focus_nodes && !(node->flags & __bdd_node_flags_focus__)) {
+            return;
+        }
+
+        // Every batch of a `bench_variant` runs between the hooks instead
+        bool hooked = !(node->flags & __bdd_node_flags_bench__);
+        for (size_t listIndex = 0; hooked && listIndex < before_each_lists->size; ++listIndex) {
+            __bdd_array__ *list = before_each_lists->values[listIndex];
+            for (size_t i = 0; i < list->size; ++i) {
+                __bdd_array_push__(steps, __bdd_test_step_create__(level, list->values[i]));
+            }
+        }
+
+        __bdd_array_push__(steps, __bdd_test_step_create__(level, node));
+
+        for (size_t listIndex = 0; hooked && listIndex < after_each_lists->size; ++listIndex) {
+            size_t reverseListIndex = after_each_lists->size - listIndex - 1;
+            __bdd_array__ *list = after_each_lists->values[reverseListIndex];
+            for (size_t i = 0; i < list->size; ++i) {
+                __bdd_array_push__(steps, __bdd_test_step_create__(level, list->values[i]));
+            }
+        }
+        if (node->type == __BDD_NODE_TEST__) {
+            ((__bdd_test_step__ *)__bdd_array_last__(steps))->ends_test = true;
+        }
+        return;
+    }
+
+    __bdd_array_push__(steps, __bdd_test_step_create__(level, node));
+
+    for (size_t i = 0; i < node->list_before->size; ++i) {
+        __bdd_array_push__(steps, __bdd_test_step_create__(level + 1, node->list_before->values[i]));
+    }
+
+    __bdd_array_push__(before_each_lists, node->list_before_each);
+    __bdd_array_push__(after_each_lists, node->list_after_each);
+
+    for (size_t i = 0; i < node->list_children->size; ++i) {
+        __bdd_node_flatten_internal__(
+          config, level + 1, node->list_children->values[i], steps, before_each_lists, after_each_lists
+        );
+    }
+
+    __bdd_array_pop__(before_each_lists);
+    __bdd_array_pop__(after_each_lists);
+
+    for (size_t i = 0; i < node->list_after->size; ++i) {
+        __bdd_array_push__(steps, __bdd_test_step_create__(level + 1, node->list_after->values[i]));
+    }
+}
+
+__bdd_array__ *__bdd_node_flatten__(__bdd_config_type__ *config, __bdd_node__ *node, __bdd_array__ *steps) {
+    if (node == NULL) {
+        return steps;
+    }
+
+    __bdd_array__ *before_each_lists = __bdd_array_create__();
+    __bdd_array__ *after_each_lists = __bdd_array_create__();
+    __bdd_node_flatten_internal__(config, 0, node, steps, before_each_lists, after_each_lists);
+    __bdd_array_free__(before_each_lists);
+    __bdd_array_free__(after_each_lists);
+
+    return steps;
+}
+
+// Excludes the groups that have no tests left in them after
+// some of the tests were excluded, so that their hooks do not run.
+bool __bdd_node_prune__(__bdd_node__ *node) {
+    if (__bdd_node_is_leaf__(node)) {
+        return !node->excluded;
+    }
+    bool has_included = false;
+    for (size_t i = 0; i < node->list_children->size; ++i) {
+        has_included |= __bdd_node_prune__(node->list_children->values[i]);
+    }
+    node->excluded = !has_included;
+    return has_included;
+}
+
+// Full name of the node made of the names of all of its parent groups,
+// not including the name of the spec itself.
+char *__bdd_node_path__(__bdd_node__ *node, const char *separator) {
+    size_t length = 1;
+    for (__bdd_node__ *n = node; n && n->parent; n = n->parent) {
+        length += strlen(n->name) + strlen(separator);
+    }
+    char *path = __bdd_calloc__(length, sizeof(char));
+    if (!path) {
+        perror("calloc(path)");
+        abort();
+    }
+    size_t end = length - 1;
+    for (__bdd_node__ *n = node; n && n->parent; n = n->parent) {
+        size_t name_length = strlen(n->name);
+        end -= name_length;
+        memcpy(path + end, n->name, name_length);
+        if (n->parent->parent) {
+            end -= strlen(separator);
+            memcpy(path + end, separator, strlen(separator));
+        }
+    }
+    // Top level nodes do not get a separator so the path is shorter
+    memmove(path, path + end, length - end);
+    return path;
+}
+
+// Path of a node used as a key in the history and watch state files
+char *__bdd_timing_path__(__bdd_node__ *node) {
+    char *path = __bdd_node_path__(node, " / ");
+    for (char *c = path; *c; ++c) {
+        if (*c == '\t' || *c == '\n' || *c == '\r') {
+            *c = ' ';
+        }
+    }
+    return path;
+}
+
+void __bdd_node_free__(__bdd_node__ *n) {
+    if (n->free_payload) {
+        n->free_payload(n->payload);
+    }
+    if (n->repeat) {
+        free(n->repeat->durations);
+        free(n->repeat);
+    }
+    free(n->name);
+    __bdd_array_free__(n->list_before);
+    __bdd_array_free__(n->list_after);
+    __bdd_array_free__(n->list_before_each);
+    __bdd_array_free__(n->list_after_each);
+    __bdd_array_free__(n->list_children);
+    free(n);
+}
+
+char *__bdd_vformat__(const char *format, va_list va);
+
+void __bdd_indent__(FILE *fp, size_t level) {
+    for (size_t i = 0; i < level; ++i) {
+        fprintf(fp, "  ");
+    }
+}
+
+bool __bdd_enter_node__(__bdd_node_flags__ node_flags, __bdd_config_type__ *config, __bdd_node_type__ type, ptrdiff_t list_offset, const char *fmt, ...) {
+    va_list va;
+    va_start(va, fmt);
+    char *name = __bdd_vformat__(fmt, va);
+    va_end(va);
+
+    if (config->run == __BDD_INIT_RUN__) {
+        __BDD_STATS_ADD__(discovery_enters, 1);
+        __bdd_node__ *top = __bdd_array_last__(config->node_stack);
+        __bdd_array__ *list = *(__bdd_array__ **)((unsigned char *)top + list_offset);
+
+        int id = config->id++;
+        __bdd_node__ *node = __bdd_node_create__(id, name, type, node_flags);
+        node->parent = top;
+        node->params[0] = config->node_params[0];
+        node->params[1] = config->node_params[1];
+        config->node_params[0] = config->node_params[1] = 0;
+        if (node_flags & __bdd_node_flags_focus__) {
+            // Propagate focus to group nodes up the tree to print inly them
+            top->flags |= node_flags & __bdd_node_flags_focus__;
+            config->has_focus_nodes = true;
+        }
+        __bdd_array_push__(list, node);
+        __bdd_array_push__(config->nodes, node);
+        if (type == __BDD_NODE_GROUP__) {
+            __bdd_array_push__(config->node_stack, node);
+            return true;
+        }
+        return false;
+    }
+
+    config->node_params[0] = config->node_params[1] = 0;
+    if (config->id >= (int)config->nodes->size) {
+        fprintf(stderr, "non-deterministic spec\n");
+        abort();
+    }
+    __bdd_node__ *node = config->nodes->values[config->id];
+    if (node->type != type || strcmp(node->name, name) != 0) {
+        fprintf(stderr, "non-deterministic spec\n");
+        abort();
+    }
+    free(name);
+
+    __bdd_test_step__ *step = config->current_test;
+    bool should_enter = step->id >= node->id && step->id < node->next_node_id;
+    if (should_enter) {
+        __bdd_array_push__(config->node_stack, node);
+        config->id++;
+        if (node->id == step->id) {
+            __bdd_stats_body_start__(config);
+        }
+    } else {
+        config->id = node->next_node_id;
+    }
+    __BDD_STATS_ADD__(test_enters, 1);
+    if (should_enter) {
+        __BDD_STATS_ADD__(entered, 1);
+    } else {
+        __BDD_STATS_ADD__(skipped, 1);
+    }
+#if defined(BDD_PRINT_TRACE)
+    const char *color = config->use_color ? __BDD_COLOR_MAGENTA__ : "";
+    fprintf(stderr, "%s% 3d ", color, step->id);
+    __bdd_indent__(stderr, config->node_stack->size - 1 - (int)should_enter);
+    const char *reset = config->use_color ? __BDD_COLOR_RESET__ : "";
+    fprintf(stderr,
+        "%s [%d, %d) %s%s\n",
+        should_enter ? ">" : "|",
+        node->id,
+        node->next_node_id,
+        node->name,
+        reset);
+#endif
+    return should_enter;
+}
+
+// Stores extra arguments of node statements like `it_concurrently`
+// to be picked up by the following `__bdd_enter_node__` call.
+bool __bdd_node_params__(__bdd_config_type__ *config, unsigned long long param0, unsigned long long param1) {
+    config->node_params[0] = param0;
+    config->node_params[1] = param1;
+    return true;
+}
+
+void __bdd_exit_node__(__bdd_config_type__ *config) {
+    __bdd_node__ *top = __bdd_array_pop__(config->node_stack);
+    if (config->run == __BDD_INIT_RUN__) {
+        top->next_node_id = config->id;
+    } else if (top->id == config->current_test->id && !config->concurrent_thread && !config->interleaving_thread) {
+        __bdd_stats_body_end__();
+    }
+}
+
+unsigned long long __bdd_now_ns__() {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (unsigned long long)(counter.QuadPart * (1000000000.0 / frequency.QuadPart));
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ull + (unsigned long long)ts.tv_nsec;
+#endif
+}
+
+// Name of the step that is currently running, reported if it crashes
+const char *volatile __bdd_running_step_name__ = NULL;
+FILE *volatile __bdd_running_output__ = NULL;
+
+// State of a `fuzz_it` test, the input that is running is saved if it crashes
+struct __bdd_fuzz__ {
+    char *directory; // of the seeds, where the crashing inputs are saved too
+    __bdd_array__ *seeds; // file names
+    size_t next_seed;
+    char *seed; // the seed that is running, NULL for mutated inputs
+    bool has_input; // the body has not run the input yet
+    __bdd_array__ *corpus; // the seeds and the inputs that found new coverage
+    __bdd_array__ *dictionary;
+    bool fuzzing;
+    unsigned char *input;
+    size_t size;
+    size_t max_size;
+    unsigned long long executions;
+    unsigned long long max_executions;
+    unsigned long long started_at;
+    unsigned long long duration_ns;
+    unsigned long long random;
+    unsigned char *seen; // buckets of hit counts seen for every edge
+    size_t seen_size;
+    size_t new_inputs;
+    size_t edges;
+    __bdd_arena_mark__ arena_mark;
+};
+
+__bdd_fuzz__ *volatile __bdd_fuzz_running__ = NULL;
+
+void __bdd_write_all__(int fd, const char *text) {
+    size_t length = strlen(text);
+    while (length > 0) {
+#ifdef _WIN32
+        int written = _write(fd, text, (unsigned)length);
+#else
+        ssize_t written = write(fd, text, length);
+#endif
+        if (written <= 0) {
+            return;
+        }
+        text += written;
+        length -= (size_t)written;
+    }
+}
+
+// Appends the name of a saved input to the directory, without allocating
+// or formatting so that it can be done in the crash handler too.
+void __bdd_fuzz_input_path__(
+    char *buffer, size_t buffer_size, const char *directory, const char *prefix, const unsigned char *data, size_t size
+) {
+    unsigned long long hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash = (hash ^ data[i]) * 1099511628211ull;
+    }
+    size_t length = 0;
+    for (const char *c = directory; *c && length + 1 < buffer_size; ++c) {
+        buffer[length++] = *c;
+    }
+    for (const char *c = "/"; *c && length + 1 < buffer_size; ++c) {
+        buffer[length++] = *c;
+    }
+    for (const char *c = prefix; *c && length + 1 < buffer_size; ++c) {
+        buffer[length++] = *c;
+    }
+    for (int shift = 60; shift >= 0 && length + 1 < buffer_size; shift -= 4) {
+        buffer[length++] = "0123456789abcdef"[(hash >> shift) & 15];
+    }
+    buffer[length] = '\0';
+}
+
+void __bdd_fuzz_crashed__() {
+    __bdd_fuzz__ *fuzz = __bdd_fuzz_running__;
+    if (!fuzz) {
+        return;
+    }
+    if (fuzz->seed) {
+        __bdd_write_all__(2, " with the seed ");
+        __bdd_write_all__(2, fuzz->seed);
+        return;
+    }
+#ifndef _WIN32
+    char path[4096];
+    __bdd_fuzz_input_path__(path, sizeof(path), fuzz->directory, "crash-", fuzz->input, fuzz->size);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        for (size_t written = 0; written < fuzz->size;) {
+            ssize_t result = write(fd, fuzz->input + written, fuzz->size - written);
+            if (result <= 0) {
+                break;
+            }
+            written += (size_t)result;
+        }
+        close(fd);
+        __bdd_write_all__(2, "\nThe input was saved to ");
+        __bdd_write_all__(2, path);
+    }
+#endif
+}
+
+void __bdd_crash_handler__(int signal_number) {
+    FILE *output = __bdd_running_output__ ? __bdd_running_output__ : stdout;
+#ifdef _WIN32
+    fflush(output);
+#else
+    // stdio is not async-signal-safe, so only flush the pending output when
+    // no other thread is in the middle of writing it to avoid a deadlock.
+    if (ftrylockfile(output) == 0) {
+        fflush(output);
+        funlockfile(output);
+    }
+#endif
+
+    // Only async-signal-safe calls from here on
+    char number[16];
+    size_t digits = sizeof(number) - 1;
+    number[digits] = '\0';
+    int value = signal_number;
+    do {
+        number[--digits] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0 && digits > 0);
+
+    __bdd_write_all__(2, "\nCrashed with signal ");
+    __bdd_write_all__(2, &number[digits]);
+    if (__bdd_running_step_name__) {
+        __bdd_write_all__(2, " while running: ");
+        __bdd_write_all__(2, __bdd_running_step_name__);
+    }
+    __bdd_fuzz_crashed__();
+    __bdd_write_all__(2, "\n");
+
+    signal(signal_number, SIG_DFL);
+    raise(signal_number);
+}
+
+const int __bdd_crash_signals__[] = {
+    SIGSEGV, SIGABRT, SIGFPE, SIGILL,
+#ifdef SIGBUS
+    SIGBUS,
+#endif
+};
+
+#define __BDD_CRASH_SIGNAL_COUNT__ (sizeof(__bdd_crash_signals__) / sizeof(__bdd_crash_signals__[0]))
+
+// The handlers of the host program, restored when `bdd_run` returns
+typedef struct __bdd_crash_handlers__ {
+#ifdef _WIN32
+    void (*previous[__BDD_CRASH_SIGNAL_COUNT__])(int);
+#else
+    struct sigaction previous[__BDD_CRASH_SIGNAL_COUNT__];
+#endif
+} __bdd_crash_handlers__;
+
+void __bdd_install_crash_handlers__(__bdd_crash_handlers__ *handlers) {
+    for (size_t i = 0; i < __BDD_CRASH_SIGNAL_COUNT__; ++i) {
+#ifdef _WIN32
+        handlers->previous[i] = signal(__bdd_crash_signals__[i], __bdd_crash_handler__);
+#else
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = __bdd_crash_handler__;
+#ifdef SA_RESETHAND
+        // A crash in the handler itself ends the process instead of looping
+        action.sa_flags = SA_RESETHAND;
+#endif
+        sigemptyset(&action.sa_mask);
+        sigaction(__bdd_crash_signals__[i], &action, &handlers->previous[i]);
+#endif
+    }
+}
+
+void __bdd_restore_crash_handlers__(__bdd_crash_handlers__ *handlers) {
+    for (size_t i = 0; i < __BDD_CRASH_SIGNAL_COUNT__; ++i) {
+#ifdef _WIN32
+        signal(__bdd_crash_signals__[i], handlers->previous[i]);
+#else
+        sigaction(__bdd_crash_signals__[i], &handlers->previous[i], NULL);
+#endif
+    }
+}
+
+bool __bdd_step_is_skipped__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    if (config->has_focus_nodes && !(step->flags & __bdd_node_flags_focus__)) {
+        return true;
+    }
+    return (step->flags & __bdd_node_flags_skip__) != 0;
+}
+
+void __bdd_print_test_name__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    if (config->run == __BDD_TEST_RUN__ && !config->use_tap && !config->quiet) {
+        __bdd_indent__(config->output, step->level);
+        fprintf(config->output, "%s ", step->name);
+    }
+}
+
+// Failures of the later `BDD_REPEAT` rounds are printed with their round
+// and the full path of the test, since the tree is not printed again.
+void __bdd_print_repeated_failure__(
+    __bdd_config_type__ *config,
+    __bdd_test_step__ *step,
+    char *error,
+    const char *location
+) {
+    const char *prefix = config->use_tap ? "# " : "";
+    char *path = __bdd_node_path__(config->nodes->values[step->id], " / ");
+    fprintf(
+        config->output, "%sround %zu: %s %s(FAIL)%s\n", prefix, config->round + 1, path,
+        config->use_color ? __BDD_COLOR_RED__ : "",
+        config->use_color ? __BDD_COLOR_RESET__ : ""
+    );
+    free(path);
+    for (const char *line = error; line;) {
+        const char *end = strchr(line, '\n');
+        fprintf(config->output, "%s  %.*s\n", prefix, (int)(end ? (size_t)(end - line) : strlen(line)), line);
+        line = end ? end + 1 : NULL;
+    }
+    if (location && *location) {
+        fprintf(config->output, "%s    %s\n", prefix, location);
+    }
+}
+
+// Status of a test in the previous run of `BDD_WATCH`, by path
+typedef struct __bdd_watch_entry__ {
+    char *path;
+    bool failed;
+} __bdd_watch_entry__;
+
+int __bdd_compare_watch_entries__(const void *a, const void *b) {
+    const __bdd_watch_entry__ *x = *(__bdd_watch_entry__ *const *)a;
+    const __bdd_watch_entry__ *y = *(__bdd_watch_entry__ *const *)b;
+    return strcmp(x->path, y->path);
+}
+
+__bdd_watch_entry__ *__bdd_watch_find__(__bdd_array__ *entries, const char *path) {
+    if (!entries || !entries->size) {
+        return NULL;
+    }
+    __bdd_watch_entry__ key = { (char *)path, false };
+    __bdd_watch_entry__ *key_pointer = &key;
+    __bdd_watch_entry__ **found = bsearch(
+        &key_pointer, entries->values, entries->size, sizeof(void *), __bdd_compare_watch_entries__
+    );
+    return found ? *found : NULL;
+}
+
+// After a rebuild only the tests that changed their status are printed
+void __bdd_watch_result__(
+    __bdd_config_type__ *config,
+    __bdd_test_step__ *step,
+    char *error,
+    const char *location
+) {
+    __bdd_watch_entry__ *entry = __bdd_calloc__(1, sizeof(__bdd_watch_entry__));
+    if (!entry) {
+        perror("calloc(watch)");
+        abort();
+    }
+    entry->path = __bdd_timing_path__(config->nodes->values[step->id]);
+    entry->failed = error != NULL;
+    __bdd_array_push__(config->watch_results, entry);
+    if (!config->watch_previous) {
+        return;
+    }
+
+    __bdd_watch_entry__ *previous = __bdd_watch_find__(config->watch_previous, entry->path);
+    if (previous ? previous->failed == entry->failed : !entry->failed) {
+        return;
+    }
+    fprintf(
+        config->output, "%s%s%s %s\n",
+        config->use_color ? (entry->failed ? __BDD_COLOR_RED__ : __BDD_COLOR_GREEN__) : "",
+        entry->failed ? "FAILED" : "FIXED ",
+        config->use_color ? __BDD_COLOR_RESET__ : "",
+        entry->path
+    );
+    for (const char *line = error; line;) {
+        const char *end = strchr(line, '\n');
+        fprintf(config->output, "  %.*s\n", (int)(end ? (size_t)(end - line) : strlen(line)), line);
+        line = end ? end + 1 : NULL;
+    }
+    if (error && location && *location) {
+        fprintf(config->output, "    %s\n", location);
+    }
+}
+
+void __bdd_print_test_result__(
+    __bdd_config_type__ *config,
+    __bdd_test_step__ *step,
+    size_t tap_index,
+    bool skipped,
+    char *error,
+    const char *location
+) {
+    if (config->watch_results && !skipped && config->round == 0) {
+        __bdd_watch_result__(config, step, error, location);
+        if (config->watch_previous) {
+            config->failed_test_count += error != NULL;
+            return;
+        }
+    }
+    if (config->quiet) {
+        if (!skipped && error != NULL) {
+            ++config->failed_test_count;
+            __bdd_print_repeated_failure__(config, step, error, location);
+        }
+        return;
+    }
+    if (skipped) {
+        if (config->run == __BDD_TEST_RUN__) {
+            if (!config->has_focus_nodes) {
+              if (config->use_tap) {
+                  // We only to report tests and not setup / teardown success
+                  if (tap_index) {
+                      fprintf(config->output, "skipped %zu - %s\n", tap_index, step->name);
+                  }
+              } else {
+                  fprintf(
+                      config->output, "%s(SKIP)%s\n",
+                      config->use_color ? __BDD_COLOR_YELLOW__ : "",
+                      config->use_color ? __BDD_COLOR_RESET__ : ""
+                  );
+              }
+            }
+        }
+    } else if (error == NULL) {
+        if (config->run == __BDD_TEST_RUN__) {
+            if (config->use_tap) {
+                // We only to report tests and not setup / teardown success
+                if (tap_index) {
+                    fprintf(config->output, "ok %zu - %s\n", tap_index, step->name);
+                }
+            } else {
+                fprintf(
+                    config->output, "%s(OK)%s\n",
+                    config->use_color ? __BDD_COLOR_GREEN__ : "",
+                    config->use_color ? __BDD_COLOR_RESET__ : ""
+                );
+            }
+        }
+    } else {
+        ++config->failed_test_count;
+        if (config->use_tap) {
+            // We only to report tests and not setup / teardown errors
+            if (tap_index) {
+                fprintf(config->output, "not ok %zu - %s\n", tap_index, step->name);
+            }
+        } else {
+            fprintf(
+                config->output, "%s(FAIL)%s\n",
+                config->use_color ? __BDD_COLOR_RED__ : "",
+                config->use_color ? __BDD_COLOR_RESET__ : ""
+            );
+            // Every line of a multi-line error, like a hexdump, gets indented
+            for (const char *line = error; line;) {
+                const char *end = strchr(line, '\n');
+                __bdd_indent__(config->output, step->level + 1);
+                fprintf(config->output, "%.*s\n", (int)(end ? (size_t)(end - line) : strlen(line)), line);
+                line = end ? end + 1 : NULL;
+            }
+            if (location && *location) {
+                __bdd_indent__(config->output, step->level + 2);
+                fprintf(config->output, "%s\n", location);
+            }
+        }
+    }
+}
+
+void __bdd_print_diagnostic__(__bdd_config_type__ *config, size_t level, const char *format, ...) {
+    if (config->quiet) {
+        return;
+    }
+    va_list va;
+    va_start(va, format);
+    if (config->use_tap) {
+        fprintf(config->output, "# ");
+    } else {
+        __bdd_indent__(config->output, level + 1);
+    }
+    vfprintf(config->output, format, va);
+    fprintf(config->output, "\n");
+    va_end(va);
+}
+
+char *__bdd_format_duration__(char *buffer, size_t size, double ns) {
+    if (ns < 1e3) {
+        snprintf(buffer, size, "%.0f ns", ns);
+    } else if (ns < 1e6) {
+        snprintf(buffer, size, "%.2f us", ns / 1e3);
+    } else if (ns < 1e9) {
+        snprintf(buffer, size, "%.2f ms", ns / 1e6);
+    } else {
+        snprintf(buffer, size, "%.2f s", ns / 1e9);
+    }
+    return buffer;
+}
+
+char *__bdd_format_rate__(char *buffer, size_t size, double per_second) {
+    if (per_second < 1e3) {
+        snprintf(buffer, size, "%.1f", per_second);
+    } else if (per_second < 1e6) {
+        snprintf(buffer, size, "%.2fk", per_second / 1e3);
+    } else if (per_second < 1e9) {
+        snprintf(buffer, size, "%.2fM", per_second / 1e6);
+    } else {
+        snprintf(buffer, size, "%.2fG", per_second / 1e9);
+    }
+    return buffer;
+}
+
+// The trace is written in the Chrome trace event format, which can be
+// opened in chrome://tracing or https://ui.perfetto.dev. Tests and hooks
+// are written as soon as they finish; groups span all of their steps and
+// are written at the end of the run.
+void __bdd_trace_string__(FILE *fp, const char *text) {
+    fputc('"', fp);
+    for (const unsigned char *c = (const unsigned char *)text; *c; ++c) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(fp, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(fp, "\\u%04x", *c);
+        } else {
+            fputc(*c, fp);
+        }
+    }
+    fputc('"', fp);
+}
+
+int __bdd_trace_pid__() {
+#ifdef _WIN32
+    return (int)GetCurrentProcessId();
+#else
+    return (int)getpid();
+#endif
+}
+
+void __bdd_trace_begin_event__(__bdd_config_type__ *config, const char *phase, const char *name, size_t tid) {
+    fprintf(
+        config->trace, "%s\n{\"ph\":\"%s\",\"pid\":%d,\"tid\":%zu,\"name\":",
+        config->trace_events++ ? "," : "", phase, __bdd_trace_pid__(), tid
+    );
+    __bdd_trace_string__(config->trace, name);
+}
+
+void __bdd_trace_name_thread__(__bdd_config_type__ *config, size_t tid) {
+    while (config->trace_threads <= tid) {
+        char name[32];
+        if (config->trace_threads == 0) {
+            snprintf(name, sizeof(name), "main");
+        } else {
+            snprintf(name, sizeof(name), "thread %zu", config->trace_threads - 1);
+        }
+        __bdd_trace_begin_event__(config, "M", "thread_name", config->trace_threads);
+        fprintf(config->trace, ",\"args\":{\"name\":");
+        __bdd_trace_string__(config->trace, name);
+        fprintf(config->trace, "}}");
+        ++config->trace_threads;
+    }
+}
+
+void __bdd_trace_open__(__bdd_config_type__ *config, const char *file_name) {
+    config->trace = fopen(file_name, "w");
+    if (!config->trace) {
+        perror(file_name);
+        return;
+    }
+    config->trace_origin_ns = __bdd_now_ns__();
+    fprintf(config->trace, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+    __bdd_trace_begin_event__(config, "M", "process_name", 0);
+    fprintf(config->trace, ",\"args\":{\"name\":");
+    __bdd_trace_string__(config->trace, __bdd_spec_name__);
+    fprintf(config->trace, "}}");
+    __bdd_trace_name_thread__(config, 0);
+}
+
+// Writes the event with the id and the full path of the node
+void __bdd_trace_node__(
+    __bdd_config_type__ *config,
+    __bdd_node__ *node,
+    const char *phase,
+    const char *category,
+    size_t tid,
+    unsigned long long timestamp_ns,
+    unsigned long long duration_ns
+) {
+    __bdd_trace_name_thread__(config, tid);
+    __bdd_trace_begin_event__(config, phase, node->name, tid);
+    fprintf(
+        config->trace, ",\"cat\":\"%s\",\"ts\":%.3f",
+        category, (double)(timestamp_ns - config->trace_origin_ns) / 1e3
+    );
+    if (*phase == 'X') {
+        fprintf(config->trace, ",\"dur\":%.3f", (double)duration_ns / 1e3);
+    } else {
+        // Async tests overlap, so they get their own tracks by id
+        fprintf(config->trace, ",\"id\":%d", node->id);
+    }
+    char *path = __bdd_node_path__(node, " / ");
+    fprintf(config->trace, ",\"args\":{\"id\":%d,\"path\":", node->id);
+    __bdd_trace_string__(config->trace, path);
+    fprintf(config->trace, "}}");
+    free(path);
+}
+
+void __bdd_trace_extend_groups__(__bdd_node__ *node, unsigned long long started_at, unsigned long long finished_at) {
+    for (__bdd_node__ *group = node->parent; group; group = group->parent) {
+        if (!group->trace_finished_ns || started_at < group->trace_started_ns) {
+            group->trace_started_ns = started_at;
+        }
+        if (finished_at > group->trace_finished_ns) {
+            group->trace_finished_ns = finished_at;
+        }
+    }
+}
+
+void __bdd_trace_step__(
+    __bdd_config_type__ *config,
+    __bdd_test_step__ *step,
+    unsigned long long started_at,
+    unsigned long long finished_at
+) {
+    __bdd_node__ *node = config->nodes->values[step->id];
+    const char *category = step->type == __BDD_NODE_TEST__ ? "test" : "hook";
+    __bdd_trace_node__(config, node, "X", category, 0, started_at, finished_at - started_at);
+    __bdd_trace_extend_groups__(node, started_at, finished_at);
+}
+
+void __bdd_trace_async__(
+    __bdd_config_type__ *config,
+    __bdd_test_step__ *step,
+    unsigned long long started_at,
+    unsigned long long finished_at
+) {
+    __bdd_node__ *node = config->nodes->values[step->id];
+    __bdd_trace_node__(config, node, "b", "async", 0, started_at, 0);
+    __bdd_trace_node__(config, node, "e", "async", 0, finished_at, 0);
+    __bdd_trace_extend_groups__(node, started_at, finished_at);
+}
+
+void __bdd_trace_close__(__bdd_config_type__ *config, __bdd_node__ *root) {
+    for (size_t i = 0; i < config->nodes->size; ++i) {
+        __bdd_node__ *node = config->nodes->values[i];
+        if (node->type == __BDD_NODE_GROUP__ && node->trace_finished_ns) {
+            __bdd_trace_node__(
+                config, node, "X", "group", 0,
+                node->trace_started_ns, node->trace_finished_ns - node->trace_started_ns
+            );
+        }
+    }
+    if (root->trace_finished_ns) {
+        __bdd_trace_begin_event__(config, "X", root->name, 0);
+        fprintf(
+            config->trace, ",\"cat\":\"spec\",\"ts\":%.3f,\"dur\":%.3f}",
+            (double)(root->trace_started_ns - config->trace_origin_ns) / 1e3,
+            (double)(root->trace_finished_ns - root->trace_started_ns) / 1e3
+        );
+    }
+    fprintf(config->trace, "\n]}\n");
+    fclose(config->trace);
+    config->trace = NULL;
+}
+
+void __bdd_repeat_record__(__bdd_config_type__ *config, __bdd_test_step__ *step, bool failed, unsigned long long duration_ns) {
+    __bdd_node__ *node = config->nodes->values[step->id];
+    if (!node->repeat) {
+        node->repeat = __bdd_calloc__(1, sizeof(__bdd_repeat_stats__));
+        if (!node->repeat) {
+            perror("calloc(repeat)");
+            abort();
+        }
+    }
+    __bdd_repeat_stats__ *stats = node->repeat;
+    size_t count = stats->passed + stats->failed;
+    if (count == stats->capacity) {
+        stats->capacity = stats->capacity ? stats->capacity * 2 : 16;
+        unsigned long long *durations = __bdd_realloc__(stats->durations, stats->capacity * sizeof(unsigned long long));
+        if (!durations) {
+            perror("realloc(durations)");
+            abort();
+        }
+        stats->durations = durations;
+    }
+    stats->durations[count] = duration_ns;
+    if (failed) {
+        ++stats->failed;
+    } else {
+        ++stats->passed;
+    }
+}
+
+// State of a single `it_async` test. It stays alive until all of the
+// adjacent async tests in the plan have finished and have been reported.
+struct bdd_async {
+    __bdd_config_type__ *config;
+    __bdd_test_step__ *step;
+    size_t tap_index;
+    unsigned long long timeout_ms;
+    unsigned long long deadline;
+    unsigned long long started_at; // only measured for the trace
+    bool finished;
+    char *error;
+    const char *location;
+};
+
+typedef struct __bdd_async_watch__ {
+    bdd_async *async;
+    int fd;
+    int events;
+    bdd_io_callback callback;
+    void *user_data;
+} __bdd_async_watch__;
+
+typedef struct __bdd_async_timer__ {
+    bdd_async *async;
+    unsigned long long at;
+    bdd_timer_callback callback;
+    void *user_data;
+} __bdd_async_timer__;
+
+#ifdef __linux__
+// Tests in flight can watch the same descriptor, but epoll only takes it
+// once, so it is registered for the events of all of its watches, and
+// removed with the last one of them
+int __bdd_async_update_fd__(__bdd_config_type__ *config, int fd, bool was_registered) {
+    struct epoll_event event = { .events = 0, .data = { .fd = fd } };
+    size_t watch_count = 0;
+    for (size_t i = 0; i < config->async_watches->size; ++i) {
+        __bdd_async_watch__ *watch = config->async_watches->values[i];
+        if (watch->fd == fd) {
+            event.events |= (watch->events & BDD_READABLE ? EPOLLIN : 0) | (watch->events & BDD_WRITABLE ? EPOLLOUT : 0);
+            ++watch_count;
+        }
+    }
+    if (watch_count == 0) {
+        return epoll_ctl(config->async_poll_fd, EPOLL_CTL_DEL, fd, NULL);
+    }
+    return epoll_ctl(config->async_poll_fd, was_registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event);
+}
+#endif
+
+void __bdd_async_forget_fd__(__bdd_config_type__ *config, size_t index) {
+    __bdd_async_watch__ *watch = __bdd_array_remove__(config->async_watches, index);
+#ifdef __linux__
+    __bdd_async_update_fd__(config, watch->fd, true);
+#endif
+    free(watch);
+}
+
+void __bdd_async_finish__(bdd_async *async, char *error, const char *location) {
+    if (async->finished) {
+        // Only the first outcome counts, e.g. a late `bdd_done` after a timeout
+        free(error);
+        return;
+    }
+    async->finished = true;
+    async->error = error;
+    async->location = location;
+
+    __bdd_config_type__ *config = async->config;
+    if (config->trace || config->repeating) {
+        unsigned long long finished_at = __bdd_now_ns__();
+        if (config->trace) {
+            __bdd_trace_async__(config, async->step, async->started_at, finished_at);
+        }
+        if (config->repeating) {
+            __bdd_repeat_record__(config, async->step, error != NULL, finished_at - async->started_at);
+        }
+    }
+    for (size_t i = config->async_watches->size; i > 0; --i) {
+        __bdd_async_watch__ *watch = config->async_watches->values[i - 1];
+        if (watch->async == async) {
+            __bdd_async_forget_fd__(config, i - 1);
+        }
+    }
+    for (size_t i = config->async_timers->size; i > 0; --i) {
+        __bdd_async_timer__ *timer = config->async_timers->values[i - 1];
+        if (timer->async == async) {
+            free(__bdd_array_remove__(config->async_timers, i - 1));
+        }
+    }
+}
+
+void bdd_done(bdd_async *async) {
+    __bdd_async_finish__(async, NULL, NULL);
+}
+
+void __bdd_async_fail__(bdd_async *async, const char *location, char *message) {
+    __bdd_async_finish__(async, message, location);
+}
+
+void bdd_async_timeout(bdd_async *async, unsigned long long ms) {
+    async->timeout_ms = ms;
+    async->deadline = __bdd_now_ns__() + ms * 1000000ull;
+}
+
+void bdd_async_timer(bdd_async *async, unsigned long long ms, bdd_timer_callback callback, void *user_data) {
+    if (async->finished) {
+        return;
+    }
+    __bdd_async_timer__ *timer = __bdd_malloc__(sizeof(__bdd_async_timer__));
+    if (!timer) {
+        perror("malloc(timer)");
+        abort();
+    }
+    timer->async = async;
+    timer->at = __bdd_now_ns__() + ms * 1000000ull;
+    timer->callback = callback;
+    timer->user_data = user_data;
+    __bdd_array_push__(async->config->async_timers, timer);
+}
+
+void bdd_async_unwatch(bdd_async *async, int fd) {
+    __bdd_config_type__ *config = async->config;
+    for (size_t i = 0; i < config->async_watches->size; ++i) {
+        __bdd_async_watch__ *watch = config->async_watches->values[i];
+        // Another test in flight can be watching the same descriptor
+        if (watch->fd == fd && watch->async == async) {
+            __bdd_async_forget_fd__(config, i);
+            return;
+        }
+    }
+}
+
+void bdd_async_watch(bdd_async *async, int fd, int events, bdd_io_callback callback, void *user_data) {
+    if (async->finished) {
+        return;
+    }
+    __bdd_config_type__ *config = async->config;
+#ifdef _WIN32
+    (void)fd; (void)events; (void)callback; (void)user_data;
+    __bdd_async_finish__(async, __bdd_format__("watching file descriptors is not supported on Windows"), "");
+#else
+    bdd_async_unwatch(async, fd);
+#ifdef __linux__
+    if (config->async_poll_fd < 0) {
+        config->async_poll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (config->async_poll_fd < 0) {
+            perror("epoll_create1");
+            abort();
+        }
+    }
+    bool was_registered = false;
+    for (size_t i = 0; i < config->async_watches->size && !was_registered; ++i) {
+        was_registered = ((__bdd_async_watch__ *)config->async_watches->values[i])->fd == fd;
+    }
+#endif
+    __bdd_async_watch__ *watch = __bdd_malloc__(sizeof(__bdd_async_watch__));
+    if (!watch) {
+        perror("malloc(watch)");
+        abort();
+    }
+    watch->async = async;
+    watch->fd = fd;
+    watch->events = events;
+    watch->callback = callback;
+    watch->user_data = user_data;
+    __bdd_array_push__(config->async_watches, watch);
+#ifdef __linux__
+    if (__bdd_async_update_fd__(config, fd, was_registered) != 0) {
+        char *error = __bdd_format__("cannot watch fd %d: %s", fd, strerror(errno));
+        free(__bdd_array_remove__(config->async_watches, config->async_watches->size - 1));
+        __bdd_async_finish__(async, error, "");
+        return;
+    }
+#endif
+#endif
+}
+
+// Calls every watch of the descriptor that waits for one of the events
+void __bdd_async_dispatch_fd__(__bdd_config_type__ *config, int fd, int events) {
+    __bdd_array__ *asyncs = __bdd_array_create__();
+    for (size_t i = 0; i < config->async_watches->size; ++i) {
+        __bdd_async_watch__ *watch = config->async_watches->values[i];
+        if (watch->fd == fd && (watch->events & events)) {
+            __bdd_array_push__(asyncs, watch->async);
+        }
+    }
+    // Looking the watch up again instead of caching a pointer allows
+    // callbacks to unwatch any fd, including ones not yet dispatched.
+    for (size_t a = 0; a < asyncs->size; ++a) {
+        for (size_t i = 0; i < config->async_watches->size; ++i) {
+            __bdd_async_watch__ *watch = config->async_watches->values[i];
+            if (watch->fd == fd && watch->async == asyncs->values[a]) {
+                __bdd_running_step_name__ = watch->async->step->name;
+                watch->callback(watch->async, fd, events, watch->user_data);
+                __bdd_running_step_name__ = NULL;
+                break;
+            }
+        }
+    }
+    __bdd_array_free__(asyncs);
+}
+
+void __bdd_async_wait_io__(__bdd_config_type__ *config, int timeout_ms) {
+#if defined(_WIN32)
+    (void)config;
+    Sleep(timeout_ms);
+#elif defined(__linux__)
+    if (config->async_poll_fd < 0) {
+        poll(NULL, 0, timeout_ms);
+        return;
+    }
+    struct epoll_event events[16];
+    int count = epoll_wait(config->async_poll_fd, events, 16, timeout_ms);
+    for (int i = 0; i < count; ++i) {
+        int ready = 0;
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) ready |= BDD_READABLE;
+        if (events[i].events & (EPOLLOUT | EPOLLERR)) ready |= BDD_WRITABLE;
+        __bdd_async_dispatch_fd__(config, events[i].data.fd, ready);
+    }
+#else
+    // A descriptor that several tests watch is only polled once
+    size_t count = 0;
+    struct pollfd *fds = __bdd_calloc__(config->async_watches->size ? config->async_watches->size : 1, sizeof(struct pollfd));
+    if (!fds) {
+        perror("calloc(pollfd)");
+        abort();
+    }
+    for (size_t i = 0; i < config->async_watches->size; ++i) {
+        __bdd_async_watch__ *watch = config->async_watches->values[i];
+        size_t at = 0;
+        while (at < count && fds[at].fd != watch->fd) {
+            ++at;
+        }
+        count += at == count;
+        fds[at].fd = watch->fd;
+        fds[at].events |= (watch->events & BDD_READABLE ? POLLIN : 0) | (watch->events & BDD_WRITABLE ? POLLOUT : 0);
+    }
+    if (poll(fds, count, timeout_ms) > 0) {
+        for (size_t i = 0; i < count; ++i) {
+            int ready = 0;
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) ready |= BDD_READABLE;
+            if (fds[i].revents & (POLLOUT | POLLERR)) ready |= BDD_WRITABLE;
+            if (ready) {
+                __bdd_async_dispatch_fd__(config, fds[i].fd, ready);
+            }
+        }
+    }
+    free(fds);
+#endif
+}
+
+// Runs one iteration of the event loop: waits for I/O until the closest
+// timer or deadline, then fires expired timers and times out overdue tests.
+void __bdd_async_poll__(__bdd_config_type__ *config) {
+    unsigned long long now = __bdd_now_ns__();
+    unsigned long long wake = (unsigned long long)-1;
+    for (size_t i = 0; i < config->async_pending->size; ++i) {
+        bdd_async *async = config->async_pending->values[i];
+        if (!async->finished && async->deadline < wake) {
+            wake = async->deadline;
+        }
+    }
+    for (size_t i = 0; i < config->async_timers->size; ++i) {
+        __bdd_async_timer__ *timer = config->async_timers->values[i];
+        if (timer->at < wake) {
+            wake = timer->at;
+        }
+    }
+
+    int timeout_ms = wake <= now ? 0 : (int)((wake - now + 999999) / 1000000);
+    __bdd_async_wait_io__(config, timeout_ms);
+
+    now = __bdd_now_ns__();
+    for (size_t i = 0; i < config->async_timers->size;) {
+        __bdd_async_timer__ *timer = config->async_timers->values[i];
+        if (timer->at > now) {
+            ++i;
+            continue;
+        }
+        __bdd_array_remove__(config->async_timers, i);
+        __bdd_running_step_name__ = timer->async->step->name;
+        timer->callback(timer->async, timer->user_data);
+        __bdd_running_step_name__ = NULL;
+        free(timer);
+        // The callback might have added or removed timers so start over
+        i = 0;
+    }
+
+    for (size_t i = 0; i < config->async_pending->size; ++i) {
+        bdd_async *async = config->async_pending->values[i];
+        if (!async->finished && async->deadline <= now) {
+            __bdd_async_finish__(
+                async,
+                __bdd_format__("Timed out after %llu ms waiting for bdd_done()", async->timeout_ms),
+                ""
+            );
+        }
+    }
+}
+
+bool __bdd_async_has_running__(__bdd_config_type__ *config) {
+    for (size_t i = 0; i < config->async_pending->size; ++i) {
+        bdd_async *async = config->async_pending->values[i];
+        if (!async->finished) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Waits for all in-flight async tests and reports them in the plan order.
+void __bdd_async_drain__(__bdd_config_type__ *config) {
+    while (__bdd_async_has_running__(config)) {
+        __bdd_async_poll__(config);
+    }
+    for (size_t i = 0; i < config->async_pending->size; ++i) {
+        bdd_async *async = config->async_pending->values[i];
+        __bdd_print_test_name__(config, async->step);
+        __bdd_print_test_result__(config, async->step, async->tap_index, false, async->error, async->location);
+        free(async->error);
+        free(async);
+    }
+    config->async_pending->size = 0;
+}
+
+void __bdd_async_start__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    bdd_async *async = __bdd_calloc__(1, sizeof(bdd_async));
+    if (!async) {
+        perror("calloc(async)");
+        abort();
+    }
+    async->config = config;
+    async->step = step;
+    async->tap_index = config->test_tap_index;
+    async->started_at = config->trace || config->repeating ? __bdd_now_ns__() : 0;
+    bdd_async_timeout(async, config->async_timeout_ms);
+    __bdd_array_push__(config->async_pending, async);
+
+    config->async_current = async;
+    __bdd_running_step_name__ = step->name;
+    __bdd_call_test_main__(config);
+    __bdd_running_step_name__ = NULL;
+    config->async_current = NULL;
+
+    if (config->error != NULL) {
+        // A `check` failed before the test got to wait for anything
+        __bdd_async_finish__(async, config->error, config->location);
+        config->error = NULL;
+    }
+}
+
+#if defined(__GNUC__)
+#define __BDD_ATOMIC_LOAD__(ptr) __atomic_load_n((ptr), __ATOMIC_RELAXED)
+#define __BDD_ATOMIC_STORE__(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELAXED)
+#else
+#define __BDD_ATOMIC_LOAD__(ptr) (*(volatile int *)(ptr))
+#define __BDD_ATOMIC_STORE__(ptr, value) (*(volatile int *)(ptr) = (value))
+#endif
+
+typedef struct __bdd_concurrent__ {
+    size_t thread_count;
+    unsigned long long iterations; // zero when running for `duration_ns`
+    unsigned long long duration_ns;
+    unsigned long long started_at;
+    unsigned long long elapsed_ns;
+    size_t ready;
+    bool go;
+    int stop;
+    char *error;
+    char *location;
+    __bdd_concurrent_thread__ *threads;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+} __bdd_concurrent__;
+
+// Each thread navigates the spec with its own copy of the config,
+// so `check` failures never race on the shared `config->error`.
+struct __bdd_concurrent_thread__ {
+    __bdd_config_type__ config;
+    __bdd_concurrent__ *shared;
+    size_t index;
+    bool started;
+    unsigned long long operations;
+    unsigned long long elapsed_ns;
+#ifndef _WIN32
+    pthread_t thread;
+#endif
+};
+
+#ifndef _WIN32
+
+void __bdd_concurrent_arrive__(__bdd_concurrent_thread__ *thread) {
+    __bdd_concurrent__ *shared = thread->shared;
+    thread->started = true;
+    pthread_mutex_lock(&shared->lock);
+    ++shared->ready;
+    pthread_cond_broadcast(&shared->cond);
+    while (!shared->go) {
+        pthread_cond_wait(&shared->cond, &shared->lock);
+    }
+    pthread_mutex_unlock(&shared->lock);
+}
+
+// Drives the loop around the body of `it_concurrently`. The first call
+// blocks until all of the threads are ready to start at the same time.
+bool __bdd_concurrent_next__(__bdd_config_type__ *config) {
+    __bdd_concurrent_thread__ *thread = config->concurrent_thread;
+    if (!thread) {
+        return false;
+    }
+    __bdd_concurrent__ *shared = thread->shared;
+    if (!thread->started) {
+        __bdd_concurrent_arrive__(thread);
+    } else {
+        ++thread->operations;
+    }
+    if (shared->iterations) {
+        return thread->operations < shared->iterations && !__BDD_ATOMIC_LOAD__(&shared->stop);
+    }
+    // Reading the clock is not free so only do it every so often
+    if ((thread->operations & 63) == 0) {
+        if (__BDD_ATOMIC_LOAD__(&shared->stop)) {
+            return false;
+        }
+        return __bdd_now_ns__() - shared->started_at < shared->duration_ns;
+    }
+    return true;
+}
+
+void *__bdd_concurrent_thread_main__(void *arg) {
+    __bdd_concurrent_thread__ *thread = arg;
+    __bdd_concurrent__ *shared = thread->shared;
+
+    __bdd_call_test_main__(&thread->config);
+    if (!thread->started) {
+        // Never reached the body, but the others are still waiting for us
+        __bdd_concurrent_arrive__(thread);
+    }
+    thread->elapsed_ns = __bdd_now_ns__() - shared->started_at;
+
+    pthread_mutex_lock(&shared->lock);
+    if (thread->config.error) {
+        if (shared->error == NULL) {
+            shared->error = thread->config.error;
+            shared->location = thread->config.location;
+        } else {
+            free(thread->config.error);
+        }
+        thread->config.error = NULL;
+        __BDD_ATOMIC_STORE__(&shared->stop, 1);
+    }
+    pthread_mutex_unlock(&shared->lock);
+    return NULL;
+}
+
+__bdd_concurrent__ *__bdd_concurrent_run__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    __bdd_node__ *node = config->nodes->values[step->id];
+    __bdd_concurrent__ *shared = __bdd_calloc__(1, sizeof(__bdd_concurrent__));
+    if (!shared) {
+        perror("calloc(concurrent)");
+        abort();
+    }
+    shared->thread_count = node->params[0] ? (size_t)node->params[0] : 1;
+    if (node->flags & __bdd_node_flags_timed__) {
+        shared->duration_ns = node->params[1] * 1000000ull;
+    } else {
+        shared->iterations = node->params[1];
+    }
+    pthread_mutex_init(&shared->lock, NULL);
+    pthread_cond_init(&shared->cond, NULL);
+    shared->threads = __bdd_calloc__(shared->thread_count, sizeof(__bdd_concurrent_thread__));
+    if (!shared->threads) {
+        perror("calloc(threads)");
+        abort();
+    }
+
+    for (size_t i = 0; i < shared->thread_count; ++i) {
+        __bdd_concurrent_thread__ *thread = &shared->threads[i];
+        thread->config = *config;
+        thread->config.node_stack = __bdd_array_create__();
+        __bdd_array_push__(thread->config.node_stack, config->node_stack->values[0]);
+        thread->config.error = NULL;
+        thread->config.arena = __bdd_arena_create__(); // no locking in `bdd_alloc`
+        thread->config.concurrent_thread = thread;
+        thread->shared = shared;
+        thread->index = i;
+        if (pthread_create(&thread->thread, NULL, __bdd_concurrent_thread_main__, thread) != 0) {
+            perror("pthread_create");
+            abort();
+        }
+    }
+
+    // Release all of the threads at once when they are ready
+    pthread_mutex_lock(&shared->lock);
+    while (shared->ready < shared->thread_count) {
+        pthread_cond_wait(&shared->cond, &shared->lock);
+    }
+    shared->started_at = __bdd_now_ns__();
+    shared->go = true;
+    pthread_cond_broadcast(&shared->cond);
+    pthread_mutex_unlock(&shared->lock);
+
+    for (size_t i = 0; i < shared->thread_count; ++i) {
+        pthread_join(shared->threads[i].thread, NULL);
+        __bdd_array_free__(shared->threads[i].config.node_stack);
+        // The memory of all threads was in use at the same time
+        __bdd_arena__ *arena = shared->threads[i].config.arena;
+        config->arena->allocated += arena->allocated;
+        config->arena->allocations += arena->allocations;
+        __bdd_arena_free__(arena);
+    }
+    shared->elapsed_ns = __bdd_now_ns__() - shared->started_at;
+    pthread_mutex_destroy(&shared->lock);
+    pthread_cond_destroy(&shared->cond);
+
+    config->error = shared->error;
+    config->location = shared->location;
+    return shared;
+}
+
+#else
+
+bool __bdd_concurrent_next__(__bdd_config_type__ *config) {
+    (void)config;
+    return false;
+}
+
+__bdd_concurrent__ *__bdd_concurrent_run__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    (void)step;
+    config->error = __bdd_format__("it_concurrently is not supported on Windows");
+    config->location = "";
+    return NULL;
+}
+
+#endif
+
+void __bdd_concurrent_report__(__bdd_config_type__ *config, __bdd_test_step__ *step, __bdd_concurrent__ *shared) {
+    char duration[32], rate[32];
+    unsigned long long total = 0;
+    for (size_t i = 0; i < shared->thread_count; ++i) {
+        total += shared->threads[i].operations;
+    }
+    __bdd_print_diagnostic__(
+        config, step->level,
+        "%zu thread%s, %llu operations in %s: %s ops/s",
+        shared->thread_count, shared->thread_count == 1 ? "" : "s", total,
+        __bdd_format_duration__(duration, sizeof(duration), (double)shared->elapsed_ns),
+        __bdd_format_rate__(rate, sizeof(rate), shared->elapsed_ns ? total * 1e9 / shared->elapsed_ns : 0)
+    );
+    for (size_t i = 0; i < shared->thread_count; ++i) {
+        __bdd_concurrent_thread__ *thread = &shared->threads[i];
+        __bdd_print_diagnostic__(
+            config, step->level,
+            "  thread %zu: %llu operations, %s ops/s",
+            i, thread->operations,
+            __bdd_format_rate__(rate, sizeof(rate), thread->elapsed_ns ? thread->operations * 1e9 / thread->elapsed_ns : 0)
+        );
+    }
+}
+
+// Every thread of a concurrent test gets its own track in the trace
+void __bdd_concurrent_trace__(__bdd_config_type__ *config, __bdd_test_step__ *step, __bdd_concurrent__ *shared) {
+    __bdd_node__ *node = config->nodes->values[step->id];
+    for (size_t i = 0; i < shared->thread_count; ++i) {
+        __bdd_trace_node__(
+            config, node, "X", "thread", i + 1, shared->started_at, shared->threads[i].elapsed_ns
+        );
+    }
+}
+
+void __bdd_concurrent_free__(__bdd_concurrent__ *shared) {
+    if (shared) {
+        free(shared->threads);
+        free(shared);
+    }
+}
+
+// A decision of the scheduler of `it_interleaved` at a `bdd_yield`
+// or when a thread finishes, where more than one thread could run.
+typedef struct __bdd_interleaving_point__ {
+    size_t chosen; // index into the options, the running thread comes first
+    size_t option_count;
+    size_t thread;
+    size_t preemptions_before;
+    bool forced; // the running thread could not continue
+} __bdd_interleaving_point__;
+
+typedef struct __bdd_interleaving__ {
+    size_t thread_count;
+    size_t preemption_bound;
+    size_t max_schedules;
+    size_t schedule_count;
+    unsigned long long seed; // schedules are sampled at random when non-zero
+    unsigned long long random;
+    size_t *replay; // thread indices from `BDD_INTERLEAVING_SCHEDULE`
+    size_t replay_count;
+    size_t *plan; // option indices of the next schedule to explore
+    size_t plan_size;
+    __bdd_interleaving_point__ *points;
+    size_t point_count;
+    size_t point_capacity;
+    size_t preemptions;
+    size_t steps;
+    const char *spin_location; // the `bdd_yield` that the running thread keeps reaching
+    size_t spins;
+    size_t current;
+    size_t generation;
+    bool *done;
+    size_t done_count;
+    bool running;
+    bool in_setup;
+    bool verify_pending;
+    bool finished;
+    bool exhausted;
+    bool overflowed;
+    unsigned long long elapsed_ns;
+    char *error;
+    char *location;
+    __bdd_interleaving_thread__ *threads;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+#endif
+} __bdd_interleaving__;
+
+struct __bdd_interleaving_thread__ {
+    __bdd_config_type__ config;
+    __bdd_interleaving__ *shared;
+    size_t index;
+    size_t generation;
+    bool in_schedule;
+    bool exited;
+#ifndef _WIN32
+    pthread_t thread;
+#endif
+};
+
+#ifndef _WIN32
+
+// Lets `bdd_yield` be called from the code under test
+__thread __bdd_interleaving_thread__ *__bdd_interleaving_current__ = NULL;
+
+size_t __bdd_interleaving_options__(__bdd_interleaving__ *shared, size_t running, bool forced, size_t *options) {
+    size_t count = 0;
+    if (!forced) {
+        options[count++] = running;
+    }
+    for (size_t i = 0; i < shared->thread_count; ++i) {
+        if (!shared->done[i] && i != running) {
+            options[count++] = i;
+        }
+    }
+    return count;
+}
+
+// Picks the thread to run next and records the decision, so that the
+// following schedules can explore the alternatives. Called with the lock held.
+void __bdd_interleaving_choose__(
+    __bdd_interleaving__ *shared,
+    size_t running,
+    bool forced,
+    const char *location
+) {
+    // A thread that keeps coming back to the same `bdd_yield` while nobody
+    // else runs is waiting for one of the others, so it gives way as it
+    // would under a fair scheduler. This does not count as a preemption.
+    bool spinning = !forced && location == shared->spin_location && shared->spins + 1 >= BDD_INTERLEAVING_SPINS;
+    forced |= spinning;
+    ++shared->steps;
+    size_t *options = __bdd_calloc__(shared->thread_count, sizeof(size_t));
+    if (!options) {
+        perror("calloc(options)");
+        abort();
+    }
+    size_t count = __bdd_interleaving_options__(shared, running, forced, options);
+    if (count == 0 && spinning) {
+        shared->current = running;
+    } else if (count == 0) {
+        // Everyone is done, unless thread 0 still has to verify the result
+        if (shared->verify_pending) {
+            shared->current = 0;
+        } else {
+            shared->running = false;
+        }
+    } else if (count == 1) {
+        shared->current = options[0];
+    } else if (spinning || shared->steps > BDD_INTERLEAVING_STEPS) {
+        // Waiting threads go round robin instead of exploring the order
+        // in which they wait. Too many steps likely means that they wait
+        // for each other, so let all of them try to finish the schedule.
+        shared->overflowed |= !spinning;
+        size_t next = (running + 1) % shared->thread_count;
+        while (shared->done[next] && next != running) {
+            next = (next + 1) % shared->thread_count;
+        }
+        shared->current = next;
+    } else {
+        size_t p = shared->point_count;
+        size_t chosen = 0;
+        if (shared->replay) {
+            for (size_t i = 0; p < shared->replay_count && i < count; ++i) {
+                if (options[i] == shared->replay[p]) {
+                    chosen = i;
+                }
+            }
+        } else if (p < shared->plan_size) {
+            chosen = shared->plan[p] < count ? shared->plan[p] : 0;
+        } else if (shared->seed && (forced || shared->preemptions < shared->preemption_bound)) {
+            shared->random ^= shared->random << 13;
+            shared->random ^= shared->random >> 7;
+            shared->random ^= shared->random << 17;
+            chosen = (size_t)(shared->random % count);
+        }
+
+        if (shared->point_count == shared->point_capacity) {
+            shared->point_capacity = shared->point_capacity ? shared->point_capacity * 2 : 64;
+            shared->points = __bdd_realloc__(
+                shared->points, shared->point_capacity * sizeof(__bdd_interleaving_point__)
+            );
+            if (!shared->points) {
+                perror("realloc(points)");
+                abort();
+            }
+        }
+        __bdd_interleaving_point__ *point = &shared->points[shared->point_count++];
+        point->chosen = chosen;
+        point->option_count = count;
+        point->thread = options[chosen];
+        point->preemptions_before = shared->preemptions;
+        point->forced = forced;
+        if (!forced && chosen > 0) {
+            ++shared->preemptions;
+        }
+        shared->current = options[chosen];
+    }
+    if (!forced && shared->current == running) {
+        shared->spins = location == shared->spin_location ? shared->spins + 1 : 1;
+        shared->spin_location = location;
+    } else {
+        shared->spins = 0;
+        shared->spin_location = NULL;
+    }
+    free(options);
+    pthread_cond_broadcast(&shared->cond);
+}
+
+// Marks the thread as done with the current schedule and passes the
+// execution on. Called with the lock held.
+void __bdd_interleaving_finish__(__bdd_interleaving__ *shared, __bdd_interleaving_thread__ *thread) {
+    thread->in_schedule = false;
+    if (!shared->done[thread->index]) {
+        shared->done[thread->index] = true;
+        ++shared->done_count;
+    }
+    if (shared->current == thread->index) {
+        __bdd_interleaving_choose__(shared, thread->index, true, NULL);
+    }
+}
+
+void __bdd_interleaving_yield__(const char *location) {
+    __bdd_interleaving_thread__ *thread = __bdd_interleaving_current__;
+    if (!thread || !thread->in_schedule) {
+        return;
+    }
+    __bdd_interleaving__ *shared = thread->shared;
+    pthread_mutex_lock(&shared->lock);
+    if (!shared->in_setup) {
+        __bdd_interleaving_choose__(shared, thread->index, false, location);
+        while (shared->current != thread->index) {
+            pthread_cond_wait(&shared->cond, &shared->lock);
+        }
+    }
+    pthread_mutex_unlock(&shared->lock);
+}
+
+// Drives the loop around the body of `it_interleaved`, one iteration for
+// every schedule. A thread only runs when the scheduler has chosen it.
+bool __bdd_interleaving_next__(__bdd_config_type__ *config) {
+    __bdd_interleaving_thread__ *thread = config->interleaving_thread;
+    if (!thread) {
+        return false;
+    }
+    __bdd_interleaving__ *shared = thread->shared;
+    pthread_mutex_lock(&shared->lock);
+    if (thread->in_schedule) {
+        __bdd_interleaving_finish__(shared, thread);
+    }
+    while (!shared->finished && (shared->generation == thread->generation || shared->current != thread->index)) {
+        pthread_cond_wait(&shared->cond, &shared->lock);
+    }
+    thread->generation = shared->generation;
+    thread->in_schedule = !shared->finished;
+    pthread_mutex_unlock(&shared->lock);
+    return thread->in_schedule;
+}
+
+// The setup of a schedule runs on thread 0, which always starts first,
+// and cannot be interrupted by `bdd_yield` in the code that it calls.
+bool __bdd_interleaving_setup__(__bdd_config_type__ *config, bool begin) {
+    __bdd_interleaving_thread__ *thread = config->interleaving_thread;
+    if (!thread || thread->index != 0) {
+        return false;
+    }
+    pthread_mutex_lock(&thread->shared->lock);
+    thread->shared->in_setup = begin;
+    pthread_mutex_unlock(&thread->shared->lock);
+    return begin;
+}
+
+// The verification runs on thread 0 once all of the threads are done
+bool __bdd_interleaving_verify__(__bdd_config_type__ *config) {
+    __bdd_interleaving_thread__ *thread = config->interleaving_thread;
+    if (!thread || !thread->in_schedule) {
+        return false;
+    }
+    __bdd_interleaving__ *shared = thread->shared;
+    pthread_mutex_lock(&shared->lock);
+    if (thread->index != 0) {
+        __bdd_interleaving_finish__(shared, thread);
+        pthread_mutex_unlock(&shared->lock);
+        return false;
+    }
+    shared->verify_pending = true;
+    shared->done[0] = true;
+    ++shared->done_count;
+    __bdd_interleaving_choose__(shared, 0, true, NULL);
+    while (shared->current != 0 || shared->done_count < shared->thread_count) {
+        pthread_cond_wait(&shared->cond, &shared->lock);
+    }
+    shared->verify_pending = false;
+    pthread_mutex_unlock(&shared->lock);
+    return true;
+}
+
+void *__bdd_interleaving_thread_main__(void *arg) {
+    __bdd_interleaving_thread__ *thread = arg;
+    __bdd_interleaving__ *shared = thread->shared;
+    __bdd_interleaving_current__ = thread;
+
+    __bdd_call_test_main__(&thread->config);
+
+    pthread_mutex_lock(&shared->lock);
+    thread->exited = true;
+    if (thread->config.error) {
+        if (shared->error == NULL) {
+            shared->error = thread->config.error;
+            shared->location = thread->config.location;
+        } else {
+            free(thread->config.error);
+        }
+        thread->config.error = NULL;
+    }
+    // A failed `check` leaves the body in the middle of a schedule
+    shared->in_setup = false;
+    shared->verify_pending &= thread->index != 0;
+    __bdd_interleaving_finish__(shared, thread);
+    pthread_mutex_unlock(&shared->lock);
+    return NULL;
+}
+
+// Finds the next schedule in depth-first order that differs from
+// the last one in the latest decision that still has alternatives
+// within the preemption bound.
+bool __bdd_interleaving_advance__(__bdd_interleaving__ *shared) {
+    for (size_t p = shared->point_count; p-- > 0;) {
+        __bdd_interleaving_point__ *point = &shared->points[p];
+        size_t chosen = point->chosen + 1;
+        if (chosen >= point->option_count) {
+            continue;
+        }
+        if (!point->forced && point->chosen == 0 && point->preemptions_before >= shared->preemption_bound) {
+            continue;
+        }
+        shared->plan = __bdd_realloc__(shared->plan, (p + 1) * sizeof(size_t));
+        if (!shared->plan) {
+            perror("realloc(plan)");
+            abort();
+        }
+        for (size_t i = 0; i < p; ++i) {
+            shared->plan[i] = shared->points[i].chosen;
+        }
+        shared->plan[p] = chosen;
+        shared->plan_size = p + 1;
+        return true;
+    }
+    return false;
+}
+
+char *__bdd_interleaving_schedule__(__bdd_interleaving__ *shared) {
+    char *schedule = __bdd_calloc__(shared->point_count * 21 + 2, sizeof(char));
+    if (!schedule) {
+        perror("calloc(schedule)");
+        abort();
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < shared->point_count; ++i) {
+        length += (size_t)sprintf(schedule + length, "%s%zu", i ? "," : "", shared->points[i].thread);
+    }
+    if (length == 0) {
+        strcpy(schedule, "0");
+    }
+    return schedule;
+}
+
+__bdd_interleaving__ *__bdd_interleaving_run__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    __bdd_node__ *node = config->nodes->values[step->id];
+    __bdd_interleaving__ *shared = __bdd_calloc__(1, sizeof(__bdd_interleaving__));
+    if (!shared) {
+        perror("calloc(interleaving)");
+        abort();
+    }
+    shared->thread_count = node->params[0] ? (size_t)node->params[0] : 1;
+    shared->preemption_bound = (size_t)node->params[1];
+    shared->max_schedules = BDD_INTERLEAVINGS;
+
+    const char *limit_env = getenv("BDD_INTERLEAVINGS");
+    if (limit_env && *limit_env) {
+        shared->max_schedules = strtoul(limit_env, NULL, 10);
+    }
+    const char *seed_env = getenv("BDD_INTERLEAVING_SEED");
+    if (seed_env && *seed_env) {
+        shared->seed = strtoull(seed_env, NULL, 10);
+        shared->seed += shared->seed == 0;
+    }
+    const char *replay_env = getenv("BDD_INTERLEAVING_SCHEDULE");
+    if (replay_env && *replay_env) {
+        shared->replay = __bdd_calloc__(strlen(replay_env), sizeof(size_t));
+        if (!shared->replay) {
+            perror("calloc(replay)");
+            abort();
+        }
+        for (const char *c = replay_env; *c;) {
+            char *end = NULL;
+            shared->replay[shared->replay_count++] = strtoul(c, &end, 10);
+            c = *end ? end + 1 : end;
+        }
+        shared->max_schedules = 1;
+    }
+
+    shared->done = __bdd_calloc__(shared->thread_count, sizeof(bool));
+    shared->threads = __bdd_calloc__(shared->thread_count, sizeof(__bdd_interleaving_thread__));
+    if (!shared->done || !shared->threads) {
+        perror("calloc(threads)");
+        abort();
+    }
+    pthread_mutex_init(&shared->lock, NULL);
+    pthread_cond_init(&shared->cond, NULL);
+    for (size_t i = 0; i < shared->thread_count; ++i) {
+        __bdd_interleaving_thread__ *thread = &shared->threads[i];
+        thread->config = *config;
+        thread->config.node_stack = __bdd_array_create__();
+        __bdd_array_push__(thread->config.node_stack, config->node_stack->values[0]);
+        thread->config.error = NULL;
+        thread->config.interleaving_thread = thread;
+        thread->shared = shared;
+        thread->index = i;
+        if (pthread_create(&thread->thread, NULL, __bdd_interleaving_thread_main__, thread) != 0) {
+            perror("pthread_create");
+            abort();
+        }
+    }
+
+    // Every schedule starts with the scratch memory of the hooks
+    __bdd_arena_mark__ arena_mark = __bdd_arena_save__(config->arena);
+    unsigned long long started_at = __bdd_now_ns__();
+    pthread_mutex_lock(&shared->lock);
+    while (!shared->finished) {
+        shared->point_count = 0;
+        shared->preemptions = 0;
+        shared->steps = 0;
+        shared->spins = 0;
+        shared->spin_location = NULL;
+        shared->done_count = 0;
+        shared->verify_pending = false;
+        shared->random = shared->seed + shared->schedule_count;
+        shared->current = shared->thread_count;
+        for (size_t i = 0; i < shared->thread_count; ++i) {
+            shared->done[i] = shared->threads[i].exited;
+            shared->done_count += shared->done[i];
+            if (!shared->done[i] && shared->current == shared->thread_count) {
+                shared->current = i;
+            }
+        }
+        if (shared->done_count == shared->thread_count) {
+            break;
+        }
+        shared->running = true;
+        ++shared->generation;
+        pthread_cond_broadcast(&shared->cond);
+        while (shared->running) {
+            pthread_cond_wait(&shared->cond, &shared->lock);
+        }
+        ++shared->schedule_count;
+        __bdd_arena_rewind__(config->arena, arena_mark);
+
+        if (shared->error || shared->overflowed) {
+            char *schedule = __bdd_interleaving_schedule__(shared);
+            char *error = __bdd_format__(
+                "%s\nFailed on schedule %zu: %s (replay with BDD_INTERLEAVING_SCHEDULE=%s)",
+                shared->error ? shared->error : "A schedule did not finish in " __BDD_STRING__(BDD_INTERLEAVING_STEPS)
+                    " decisions, are the threads waiting for each other in a loop?",
+                shared->schedule_count, schedule, schedule
+            );
+            free(shared->error);
+            free(schedule);
+            shared->error = error;
+            if (!shared->location) {
+                shared->location = "";
+            }
+            shared->finished = true;
+        } else if (shared->seed) {
+            shared->finished = shared->schedule_count >= shared->max_schedules;
+        } else {
+            shared->exhausted = !__bdd_interleaving_advance__(shared);
+            shared->finished = shared->exhausted || shared->schedule_count >= shared->max_schedules;
+        }
+    }
+    shared->finished = true;
+    pthread_cond_broadcast(&shared->cond);
+    pthread_mutex_unlock(&shared->lock);
+
+    for (size_t i = 0; i < shared->thread_count; ++i) {
+        pthread_join(shared->threads[i].thread, NULL);
+        __bdd_array_free__(shared->threads[i].config.node_stack);
+    }
+    shared->elapsed_ns = __bdd_now_ns__() - started_at;
+    pthread_mutex_destroy(&shared->lock);
+    pthread_cond_destroy(&shared->cond);
+
+    config->error = shared->error;
+    config->location = shared->location;
+    shared->error = NULL;
+    return shared;
+}
+
+#else
+
+void __bdd_interleaving_yield__(const char *location) {
+    (void)location;
+}
+
+bool __bdd_interleaving_next__(__bdd_config_type__ *config) {
+    (void)config;
+    return false;
+}
+
+bool __bdd_interleaving_setup__(__bdd_config_type__ *config, bool begin) {
+    (void)config;
+    (void)begin;
+    return false;
+}
+
+bool __bdd_interleaving_verify__(__bdd_config_type__ *config) {
+    (void)config;
+    return false;
+}
+
+__bdd_interleaving__ *__bdd_interleaving_run__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    (void)step;
+    config->error = __bdd_format__("it_interleaved is not supported on Windows");
+    config->location = "";
+    return NULL;
+}
+
+#endif
+
+void __bdd_interleaving_report__(__bdd_config_type__ *config, __bdd_test_step__ *step, __bdd_interleaving__ *shared) {
+    char duration[32];
+    __bdd_format_duration__(duration, sizeof(duration), (double)shared->elapsed_ns);
+    if (shared->replay) {
+        __bdd_print_diagnostic__(config, step->level, "replayed 1 schedule in %s", duration);
+    } else if (shared->seed) {
+        __bdd_print_diagnostic__(
+            config, step->level, "%zu schedule%s sampled from seed %llu in %s",
+            shared->schedule_count, shared->schedule_count == 1 ? "" : "s", shared->seed, duration
+        );
+    } else {
+        __bdd_print_diagnostic__(
+            config, step->level, "%zu schedule%s with up to %zu preemption%s explored in %s%s",
+            shared->schedule_count, shared->schedule_count == 1 ? "" : "s",
+            shared->preemption_bound, shared->preemption_bound == 1 ? "" : "s", duration,
+            shared->schedule_count < shared->max_schedules || shared->exhausted
+                ? "" : " (limit reached, set BDD_INTERLEAVINGS for more)"
+        );
+    }
+}
+
+void __bdd_interleaving_free__(__bdd_interleaving__ *shared) {
+    if (shared) {
+        free(shared->error);
+        free(shared->replay);
+        free(shared->plan);
+        free(shared->points);
+        free(shared->done);
+        free(shared->threads);
+        free(shared);
+    }
+}
+
+size_t __bdd_thread_index__(__bdd_config_type__ *config) {
+    if (config->interleaving_thread) {
+        return config->interleaving_thread->index;
+    }
+    return config->concurrent_thread ? config->concurrent_thread->index : 0;
+}
+
+typedef struct __bdd_corpus__ {
+    char *directory;
+    __bdd_array__ *files;
+    char *error;
+} __bdd_corpus__;
+
+void __bdd_corpus_free__(void *payload) {
+    __bdd_corpus__ *corpus = payload;
+    for (size_t i = 0; i < corpus->files->size; ++i) {
+        free(corpus->files->values[i]);
+    }
+    __bdd_array_free__(corpus->files);
+    free(corpus->directory);
+    free(corpus->error);
+    free(corpus);
+}
+
+int __bdd_compare_strings__(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+// Lists the regular, non-hidden files of the directory in a stable order
+__bdd_corpus__ *__bdd_corpus_scan__(const char *directory) {
+    __bdd_corpus__ *corpus = __bdd_calloc__(1, sizeof(__bdd_corpus__));
+    if (!corpus) {
+        perror("calloc(corpus)");
+        abort();
+    }
+    corpus->directory = __bdd_strdup__(directory);
+    corpus->files = __bdd_array_create__();
+#ifdef _WIN32
+    corpus->error = __bdd_format__("it_corpus is not supported on Windows");
+#else
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        corpus->error = __bdd_format__("cannot open %s: %s", directory, strerror(errno));
+        return corpus;
+    }
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        char *path = __bdd_format__("%s/%s", directory, entry->d_name);
+        struct stat info;
+        if (stat(path, &info) == 0 && S_ISREG(info.st_mode)) {
+            __bdd_array_push__(corpus->files, __bdd_strdup__(entry->d_name));
+        }
+        free(path);
+    }
+    closedir(dir);
+    qsort(corpus->files->values, corpus->files->size, sizeof(void *), __bdd_compare_strings__);
+#endif
+    return corpus;
+}
+
+// Relative paths are relative to the directory of the spec file, so the
+// names of the nodes do not depend on where the spec is built or run
+char *__bdd_spec_relative__(const char *spec_file, const char *path) {
+    if (path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':')) {
+        return __bdd_strdup__(path);
+    }
+    size_t length = strlen(spec_file);
+    while (length && spec_file[length - 1] != '/' && spec_file[length - 1] != '\\') {
+        --length;
+    }
+    return __bdd_format__("%.*s%s", (int)length, spec_file, path);
+}
+
+// The directory is only listed during the first run, the test
+// runs iterate over the same files to keep the spec deterministic.
+__bdd_corpus__ *__bdd_corpus_of__(__bdd_config_type__ *config, const char *spec_file) {
+    __bdd_node__ *group = __bdd_array_last__(config->node_stack);
+    if (!group->payload) {
+        char *directory = __bdd_spec_relative__(spec_file, group->name);
+        group->payload = __bdd_corpus_scan__(directory);
+        group->free_payload = __bdd_corpus_free__;
+        free(directory);
+    }
+    return group->payload;
+}
+
+size_t __bdd_corpus_count__(__bdd_config_type__ *config, const char *spec_file) {
+    __bdd_corpus__ *corpus = __bdd_corpus_of__(config, spec_file);
+    // A directory that can not be read gets a single failing test
+    return corpus->error ? 1 : corpus->files->size;
+}
+
+// Only called after `__bdd_corpus_count__`, which lists the directory
+const char *__bdd_corpus_file__(__bdd_config_type__ *config, size_t index) {
+    __bdd_corpus__ *corpus = ((__bdd_node__ *)__bdd_array_last__(config->node_stack))->payload;
+    return corpus->error ? corpus->error : corpus->files->values[index];
+}
+
+// Maps the file of the running corpus test, which stays mapped until
+// the test is done. Returns NULL and fails the test on errors.
+const unsigned char *__bdd_corpus_map__(__bdd_config_type__ *config) {
+    static const unsigned char empty[1] = { 0 };
+    __bdd_node__ *test = __bdd_array_last__(config->node_stack);
+    __bdd_corpus__ *corpus = test->parent->payload;
+    config->corpus_data = NULL;
+    config->corpus_size = 0;
+    if (corpus->error) {
+        config->error = __bdd_format__("the corpus directory could not be listed");
+        config->location = "";
+        return NULL;
+    }
+#ifdef _WIN32
+    return NULL;
+#else
+    char *path = __bdd_format__("%s/%s", corpus->directory, test->name);
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        config->error = __bdd_format__("cannot open %s: %s", path, strerror(errno));
+        config->location = "";
+        if (fd >= 0) {
+            close(fd);
+        }
+        free(path);
+        return NULL;
+    }
+    free(path);
+    if (info.st_size == 0) {
+        close(fd);
+        return empty;
+    }
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        config->error = __bdd_format__("cannot map %s: %s", test->name, strerror(errno));
+        config->location = "";
+        return NULL;
+    }
+    config->corpus_data = data;
+    config->corpus_size = (size_t)info.st_size;
+    return data;
+#endif
+}
+
+void __bdd_corpus_unmap__(__bdd_config_type__ *config) {
+#ifndef _WIN32
+    if (config->corpus_data) {
+        munmap((void *)config->corpus_data, config->corpus_size);
+    }
+#endif
+    config->corpus_data = NULL;
+    config->corpus_size = 0;
+}
+
+#define __BDD_PC_COVERAGE_SIZE__ 65536
+
+// Hit counts of the edges of the code compiled with `-fsanitize-coverage=trace-pc-guard`,
+// or of the hashed addresses of the blocks with `-fsanitize-coverage=trace-pc` of GCC.
+// The counters that were hit are listed, so that only they are read and reset.
+typedef struct __bdd_coverage__ {
+    unsigned char *counters; // indexed from 1
+    uint32_t *hits;
+    size_t hit_count;
+    size_t size;
+} __bdd_coverage__;
+
+__bdd_coverage__ __bdd_guard_coverage__ = { NULL, NULL, 0, 0 };
+unsigned char __bdd_pc_counters__[__BDD_PC_COVERAGE_SIZE__ + 1];
+uint32_t __bdd_pc_hits__[__BDD_PC_COVERAGE_SIZE__];
+__bdd_coverage__ __bdd_pc_coverage__ = { __bdd_pc_counters__, __bdd_pc_hits__, 0, 0 };
+
+void __bdd_coverage_hit__(__bdd_coverage__ *coverage, uint32_t index) {
+    unsigned char *counter = &coverage->counters[index];
+    if (*counter == 0 && coverage->hit_count < coverage->size) {
+        coverage->hits[coverage->hit_count++] = index;
+    }
+    if (*counter != 255) {
+        ++*counter;
+    }
+}
+
+#if defined(__GNUC__) && !defined(_WIN32)
+// The callbacks are weak, so that a fuzzer linked into the test can replace them
+__attribute__((weak)) void __sanitizer_cov_trace_pc_guard_init(uint32_t *start, uint32_t *stop) {
+    __bdd_coverage__ *coverage = &__bdd_guard_coverage__;
+    if (start == stop || *start) {
+        return;
+    }
+    size_t first = coverage->size ? coverage->size + 1 : 0;
+    for (uint32_t *guard = start; guard < stop; ++guard) {
+        *guard = (uint32_t)++coverage->size;
+    }
+    unsigned char *counters = __bdd_realloc__(coverage->counters, coverage->size + 1);
+    uint32_t *hits = __bdd_realloc__(coverage->hits, coverage->size * sizeof(uint32_t));
+    if (!counters || !hits) {
+        perror("realloc(coverage)");
+        abort();
+    }
+    memset(counters + first, 0, coverage->size + 1 - first);
+    coverage->counters = counters;
+    coverage->hits = hits;
+}
+
+__attribute__((weak)) void __sanitizer_cov_trace_pc_guard(uint32_t *guard) {
+    __bdd_coverage_hit__(&__bdd_guard_coverage__, *guard);
+}
+
+__attribute__((weak)) void __sanitizer_cov_trace_pc(void) {
+    uintptr_t pc = (uintptr_t)__builtin_return_address(0);
+    __bdd_pc_coverage__.size = __BDD_PC_COVERAGE_SIZE__;
+    __bdd_coverage_hit__(&__bdd_pc_coverage__, (uint32_t)(1 + ((pc ^ (pc >> 16)) & (__BDD_PC_COVERAGE_SIZE__ - 1))));
+}
+#endif
+
+// Returns NULL if nothing is instrumented
+__bdd_coverage__ *__bdd_coverage_of_run__() {
+    if (__bdd_guard_coverage__.size) {
+        return &__bdd_guard_coverage__;
+    }
+    return __bdd_pc_coverage__.size ? &__bdd_pc_coverage__ : NULL;
+}
+
+void __bdd_coverage_reset__(__bdd_coverage__ *coverage) {
+    for (size_t i = 0; i < coverage->hit_count; ++i) {
+        coverage->counters[coverage->hits[i]] = 0;
+    }
+    coverage->hit_count = 0;
+}
+
+typedef struct __bdd_fuzz_input__ {
+    unsigned char *data;
+    size_t size;
+} __bdd_fuzz_input__;
+
+__bdd_fuzz_input__ *__bdd_fuzz_input_create__(const unsigned char *data, size_t size) {
+    __bdd_fuzz_input__ *input = __bdd_malloc__(sizeof(__bdd_fuzz_input__));
+    unsigned char *copy = __bdd_malloc__(size ? size : 1);
+    if (!input || !copy) {
+        perror("malloc(fuzz input)");
+        abort();
+    }
+    memcpy(copy, data, size);
+    input->data = copy;
+    input->size = size;
+    return input;
+}
+
+void __bdd_fuzz_inputs_free__(__bdd_array__ *inputs) {
+    for (size_t i = 0; i < inputs->size; ++i) {
+        __bdd_fuzz_input__ *input = inputs->values[i];
+        free(input->data);
+        free(input);
+    }
+    __bdd_array_free__(inputs);
+}
+
+// Reads a dictionary in the format of AFL and libFuzzer, with one
+// quoted token per line, e.g. `kw_null="null"` or `"\xff\xfe"`.
+__bdd_array__ *__bdd_fuzz_dictionary__(const char *file_name) {
+    __bdd_array__ *dictionary = __bdd_array_create__();
+    FILE *fp = file_name ? fopen(file_name, "r") : NULL;
+    if (!fp) {
+        if (file_name) {
+            fprintf(stderr, "cannot read the dictionary %s: %s\n", file_name, strerror(errno));
+        }
+        return dictionary;
+    }
+    char line[4096];
+    unsigned char token[4096];
+    while (fgets(line, sizeof(line), fp)) {
+        char *start = strchr(line, '"');
+        char *end = strrchr(line, '"');
+        if (line[0] == '#' || !start || end == start) {
+            continue;
+        }
+        size_t size = 0;
+        for (char *c = start + 1; c < end; ++c) {
+            if (*c == '\\' && c + 1 < end && c[1] == 'x' && c + 3 < end) {
+                char hex[3] = { c[2], c[3], '\0' };
+                token[size++] = (unsigned char)strtoul(hex, NULL, 16);
+                c += 3;
+            } else if (*c == '\\' && c + 1 < end) {
+                token[size++] = (unsigned char)*++c;
+            } else {
+                token[size++] = (unsigned char)*c;
+            }
+        }
+        if (size) {
+            __bdd_array_push__(dictionary, __bdd_fuzz_input_create__(token, size));
+        }
+    }
+    fclose(fp);
+    return dictionary;
+}
+
+// The seeds of a test live next to the spec in `__fuzz__`,
+// in a directory named after the path of the test.
+__bdd_fuzz__ *__bdd_fuzz_start__(__bdd_config_type__ *config, const char *spec_file) {
+    __bdd_fuzz__ *fuzz = __bdd_calloc__(1, sizeof(__bdd_fuzz__));
+    if (!fuzz) {
+        perror("calloc(fuzz)");
+        abort();
+    }
+    size_t length = strlen(spec_file);
+    while (length && spec_file[length - 1] != '/' && spec_file[length - 1] != '\\') {
+        --length;
+    }
+    char *test_path = __bdd_node_path__(__bdd_array_last__(config->node_stack), ".");
+    for (char *c = test_path; *c; ++c) {
+        bool is_safe = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+            (*c >= '0' && *c <= '9') || *c == '-' || *c == '.';
+        if (!is_safe) {
+            *c = '_';
+        }
+    }
+    fuzz->directory = __bdd_format__("%.*s__fuzz__/%s", (int)length, spec_file, test_path);
+    free(test_path);
+
+    // A missing directory is the same as no seeds
+    __bdd_corpus__ *seeds = __bdd_corpus_scan__(fuzz->directory);
+    fuzz->seeds = seeds->files;
+    free(seeds->directory);
+    free(seeds->error);
+    free(seeds);
+
+    fuzz->corpus = __bdd_array_create__();
+    fuzz->max_size = BDD_FUZZ_MAX_SIZE;
+    fuzz->input = __bdd_malloc__(fuzz->max_size);
+    if (!fuzz->input) {
+        perror("malloc(fuzz input)");
+        abort();
+    }
+    fuzz->fuzzing = config->fuzz_target != NULL;
+    fuzz->arena_mark = __bdd_arena_save__(config->arena);
+    if (!fuzz->fuzzing) {
+        fuzz->dictionary = __bdd_array_create__();
+        return fuzz;
+    }
+
+    const char *runs_env = config->fuzz_runs;
+    const char *seconds_env = config->fuzz_seconds;
+    const char *seed_env = config->fuzz_seed;
+    const char *dictionary_env = config->fuzz_dictionary;
+    fuzz->max_executions = runs_env && *runs_env ? strtoull(runs_env, NULL, 10) : 0;
+    if (seconds_env && *seconds_env) {
+        fuzz->duration_ns = (unsigned long long)(strtod(seconds_env, NULL) * 1e9);
+    } else if (!fuzz->max_executions) {
+        fuzz->duration_ns = 10 * 1000000000ull;
+    }
+    fuzz->random = seed_env && *seed_env ? strtoull(seed_env, NULL, 10) : __bdd_now_ns__();
+    fuzz->random |= 1; // xorshift gets stuck on zero
+    fuzz->dictionary = __bdd_fuzz_dictionary__(dictionary_env && *dictionary_env ? dictionary_env : NULL);
+    size_t guards = __bdd_guard_coverage__.size;
+    fuzz->seen_size = (guards > __BDD_PC_COVERAGE_SIZE__ ? guards : __BDD_PC_COVERAGE_SIZE__) + 1;
+    fuzz->seen = __bdd_calloc__(fuzz->seen_size, 1);
+    if (!fuzz->seen) {
+        perror("calloc(fuzz coverage)");
+        abort();
+    }
+    // Only the edges hit by the inputs count, not by the discovery
+    __bdd_coverage_reset__(&__bdd_guard_coverage__);
+    __bdd_coverage_reset__(&__bdd_pc_coverage__);
+#ifndef _WIN32
+    // The crashing inputs are saved into it by the crash handler
+    char *parent = __bdd_format__("%.*s__fuzz__", (int)length, spec_file);
+    mkdir(parent, 0777);
+    mkdir(fuzz->directory, 0777);
+    free(parent);
+#endif
+    fuzz->started_at = __bdd_now_ns__();
+    return fuzz;
+}
+
+size_t __bdd_fuzz_below__(__bdd_fuzz__ *fuzz, size_t limit) {
+    fuzz->random ^= fuzz->random << 13;
+    fuzz->random ^= fuzz->random >> 7;
+    fuzz->random ^= fuzz->random << 17;
+    return limit ? (size_t)(fuzz->random % limit) : 0;
+}
+
+// Keeps the input that just passed in the corpus if it hit new
+// edges, or hit some of them a new number of times (bucketed)
+void __bdd_fuzz_learn__(__bdd_fuzz__ *fuzz) {
+    bool is_new = false;
+    __bdd_coverage__ *coverage = __bdd_coverage_of_run__();
+    for (size_t i = 0; coverage && i < coverage->hit_count; ++i) {
+        uint32_t edge = coverage->hits[i];
+        unsigned char count = coverage->counters[edge];
+        unsigned char bucket = count == 1 ? 1 : count == 2 ? 2 : count == 3 ? 4 : count < 8 ? 8 :
+            count < 16 ? 16 : count < 32 ? 32 : count < 128 ? 64 : 128;
+        if (edge < fuzz->seen_size && !(fuzz->seen[edge] & bucket)) {
+            fuzz->edges += fuzz->seen[edge] == 0;
+            fuzz->seen[edge] |= bucket;
+            is_new = true;
+        }
+    }
+    if (coverage) {
+        __bdd_coverage_reset__(coverage);
+    }
+    if (is_new || fuzz->seed) {
+        __bdd_array_push__(fuzz->corpus, __bdd_fuzz_input_create__(fuzz->input, fuzz->size));
+        fuzz->new_inputs += fuzz->seed == NULL;
+    }
+}
+
+// Changes a copy of an input of the corpus with a few random mutations
+void __bdd_fuzz_mutate__(__bdd_fuzz__ *fuzz) {
+    static const unsigned char interesting[] = { 0x00, 0x01, 0x7f, 0x80, 0xff };
+    unsigned char *data = fuzz->input;
+    size_t size = 0;
+    size_t max_size = fuzz->max_size;
+    if (fuzz->corpus->size) {
+        __bdd_fuzz_input__ *base = fuzz->corpus->values[__bdd_fuzz_below__(fuzz, fuzz->corpus->size)];
+        memcpy(data, base->data, base->size);
+        size = base->size;
+    }
+    for (size_t mutations = 1 + __bdd_fuzz_below__(fuzz, 4); mutations > 0; --mutations) {
+        switch (__bdd_fuzz_below__(fuzz, 7)) {
+        case 0: // flips a bit
+            if (size) {
+                data[__bdd_fuzz_below__(fuzz, size)] ^= (unsigned char)(1u << __bdd_fuzz_below__(fuzz, 8));
+            }
+            break;
+        case 1: // replaces a byte with an interesting or a random one
+            if (size) {
+                size_t at = __bdd_fuzz_below__(fuzz, size);
+                data[at] = __bdd_fuzz_below__(fuzz, 2)
+                    ? interesting[__bdd_fuzz_below__(fuzz, sizeof(interesting))]
+                    : (unsigned char)__bdd_fuzz_below__(fuzz, 256);
+            }
+            break;
+        case 2: // inserts a random byte
+            if (size < max_size) {
+                size_t at = __bdd_fuzz_below__(fuzz, size + 1);
+                memmove(data + at + 1, data + at, size - at);
+                data[at] = (unsigned char)__bdd_fuzz_below__(fuzz, 256);
+                ++size;
+            }
+            break;
+        case 3: // erases a few bytes
+            if (size) {
+                size_t at = __bdd_fuzz_below__(fuzz, size);
+                size_t count = 1 + __bdd_fuzz_below__(fuzz, size - at < 16 ? size - at : 16);
+                memmove(data + at, data + at + count, size - at - count);
+                size -= count;
+            }
+            break;
+        case 4: // copies a part of the input over another part of it
+            if (size > 1) {
+                size_t from = __bdd_fuzz_below__(fuzz, size);
+                size_t to = __bdd_fuzz_below__(fuzz, size);
+                size_t room = size - (from > to ? from : to);
+                memmove(data + to, data + from, 1 + __bdd_fuzz_below__(fuzz, room));
+            }
+            break;
+        case 5: // replaces the end of the input with the end of another one
+            if (fuzz->corpus->size) {
+                __bdd_fuzz_input__ *other = fuzz->corpus->values[__bdd_fuzz_below__(fuzz, fuzz->corpus->size)];
+                size_t at = __bdd_fuzz_below__(fuzz, size + 1);
+                size_t from = __bdd_fuzz_below__(fuzz, other->size + 1);
+                size_t count = other->size - from < max_size - at ? other->size - from : max_size - at;
+                memcpy(data + at, other->data + from, count);
+                size = at + count;
+            }
+            break;
+        case 6: // inserts or writes over a token of the dictionary
+            if (fuzz->dictionary->size) {
+                __bdd_fuzz_input__ *token =
+                    fuzz->dictionary->values[__bdd_fuzz_below__(fuzz, fuzz->dictionary->size)];
+                size_t at = __bdd_fuzz_below__(fuzz, size + 1);
+                if (__bdd_fuzz_below__(fuzz, 2) && at + token->size <= size) {
+                    memcpy(data + at, token->data, token->size);
+                } else if (size + token->size <= max_size) {
+                    memmove(data + at + token->size, data + at, size - at);
+                    memcpy(data + at, token->data, token->size);
+                    size += token->size;
+                }
+            }
+            break;
+        }
+    }
+    fuzz->size = size;
+}
+
+bool __bdd_fuzz_read_seed__(__bdd_config_type__ *config, __bdd_fuzz__ *fuzz) {
+    FILE *fp = fopen(fuzz->seed, "rb");
+    long length = -1;
+    if (fp && fseek(fp, 0, SEEK_END) == 0) {
+        length = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+    }
+    if (length < 0) {
+        config->error = __bdd_format__("cannot read %s: %s", fuzz->seed, strerror(errno));
+        config->location = "";
+        if (fp) {
+            fclose(fp);
+        }
+        return false;
+    }
+    if ((size_t)length > fuzz->max_size) {
+        // The mutations of a large seed can be as large
+        unsigned char *input = __bdd_realloc__(fuzz->input, (size_t)length);
+        if (!input) {
+            perror("realloc(fuzz input)");
+            abort();
+        }
+        fuzz->input = input;
+        fuzz->max_size = (size_t)length;
+    }
+    fuzz->size = fread(fuzz->input, 1, (size_t)length, fp);
+    fclose(fp);
+    return true;
+}
+
+// Picks the next input of `fuzz_it`. Every seed is run once, then with
+// `BDD_FUZZ` the mutated inputs until the time or the number of
+// executions runs out.
+bool __bdd_fuzz_advance__(__bdd_config_type__ *config) {
+    __bdd_fuzz__ *fuzz = config->fuzz;
+    free(fuzz->seed);
+    fuzz->seed = NULL;
+
+    if (fuzz->next_seed < (fuzz->seeds->size ? fuzz->seeds->size : 1)) {
+        // Without seeds the test still runs once, with an empty input
+        fuzz->size = 0;
+        if (fuzz->seeds->size) {
+            fuzz->seed = __bdd_format__("%s/%s", fuzz->directory, (char *)fuzz->seeds->values[fuzz->next_seed]);
+            if (!__bdd_fuzz_read_seed__(config, fuzz)) {
+                return false;
+            }
+        }
+        ++fuzz->next_seed;
+    } else if (!fuzz->fuzzing) {
+        return false;
+    } else {
+        if (fuzz->max_executions && fuzz->executions >= fuzz->max_executions) {
+            return false;
+        }
+        // Reading the clock is not free so only do it every so often
+        if (fuzz->duration_ns && (fuzz->executions & 63) == 0 &&
+            __bdd_now_ns__() - fuzz->started_at >= fuzz->duration_ns) {
+            return false;
+        }
+        __bdd_fuzz_mutate__(fuzz);
+        ++fuzz->executions;
+    }
+
+    config->fuzz_data = fuzz->input;
+    config->fuzz_size = fuzz->size;
+    fuzz->has_input = true;
+    return true;
+}
+
+// Lets the body of `fuzz_it` run once for the input that was picked, the
+// runner picks the next one and navigates to the body again
+bool __bdd_fuzz_next__(__bdd_config_type__ *config, const char *spec_file) {
+    __bdd_fuzz__ *fuzz = config->fuzz;
+    if (!fuzz) {
+        fuzz = config->fuzz = __bdd_fuzz_start__(config, spec_file);
+        __bdd_fuzz_running__ = fuzz;
+        if (!__bdd_fuzz_advance__(config)) {
+            return false;
+        }
+    }
+    bool has_input = fuzz->has_input;
+    fuzz->has_input = false;
+    return has_input;
+}
+
+// Adds the input that failed the test to the message. When
+// fuzzing, the input is saved next to the seeds to reproduce it.
+void __bdd_fuzz_finish__(__bdd_config_type__ *config) {
+    __bdd_fuzz__ *fuzz = config->fuzz;
+    __bdd_fuzz_running__ = NULL;
+    char *message = NULL;
+    if (!config->error) {
+        return;
+    } else if (fuzz->seed) {
+        message = __bdd_format__("%s\nWith the seed %s", config->error, fuzz->seed);
+    } else if (fuzz->fuzzing && fuzz->executions) {
+        char path[4096];
+        __bdd_fuzz_input_path__(path, sizeof(path), fuzz->directory, "failure-", fuzz->input, fuzz->size);
+        FILE *fp = fopen(path, "wb");
+        if (fp && fwrite(fuzz->input, 1, fuzz->size, fp) == fuzz->size && fclose(fp) == 0) {
+            message = __bdd_format__(
+                "%s\nFailed after %llu executions, the input was saved to %s", config->error, fuzz->executions, path
+            );
+        } else {
+            message = __bdd_format__("%s\nCannot save the failing input to %s: %s", config->error, path, strerror(errno));
+        }
+    } else {
+        return;
+    }
+    free(config->error);
+    config->error = message;
+}
+
+void __bdd_fuzz_report__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    __bdd_fuzz__ *fuzz = config->fuzz;
+    if (!fuzz->fuzzing) {
+        return;
+    }
+    char duration[32], rate[32];
+    unsigned long long elapsed_ns = __bdd_now_ns__() - fuzz->started_at;
+    __bdd_coverage__ *coverage = __bdd_coverage_of_run__();
+    __bdd_print_diagnostic__(
+        config, step->level, "%llu executions in %s (%s/s), %zu inputs in the corpus (%zu new), %s",
+        fuzz->executions,
+        __bdd_format_duration__(duration, sizeof(duration), (double)elapsed_ns),
+        __bdd_format_rate__(rate, sizeof(rate), elapsed_ns ? fuzz->executions * 1e9 / (double)elapsed_ns : 0),
+        fuzz->corpus->size, fuzz->new_inputs,
+        coverage ? "coverage-guided" : "not coverage-guided, build the code under test with -fsanitize-coverage"
+    );
+    if (coverage == &__bdd_guard_coverage__) {
+        __bdd_print_diagnostic__(config, step->level, "%zu of %zu edges covered", fuzz->edges, coverage->size);
+    } else if (coverage) {
+        __bdd_print_diagnostic__(config, step->level, "%zu blocks covered", fuzz->edges);
+    }
+}
+
+void __bdd_fuzz_free__(__bdd_config_type__ *config) {
+    __bdd_fuzz__ *fuzz = config->fuzz;
+    __bdd_fuzz_running__ = NULL;
+    for (size_t i = 0; i < fuzz->seeds->size; ++i) {
+        free(fuzz->seeds->values[i]);
+    }
+    __bdd_array_free__(fuzz->seeds);
+    __bdd_fuzz_inputs_free__(fuzz->corpus);
+    __bdd_fuzz_inputs_free__(fuzz->dictionary);
+    free(fuzz->directory);
+    free(fuzz->seed);
+    free(fuzz->input);
+    free(fuzz->seen);
+    free(fuzz);
+    config->fuzz = NULL;
+    config->fuzz_data = NULL;
+    config->fuzz_size = 0;
+}
+
+// Fails the running test the same way as `check` does
+void __bdd_check_failed__(__bdd_config_type__ *config, const char *location, char *message) {
+    config->error = __bdd_format__(config->use_color ? __BDD_FMT_COLOR__ : __BDD_FMT_PLAIN__, message);
+    config->location = (char *)location;
+    free(message);
+}
+
+// Snapshots live next to the spec in `__snapshots__`, in a file
+// named after the path of the test and the name of the snapshot.
+char *__bdd_snapshot_directory__(const char *spec_file) {
+    size_t length = strlen(spec_file);
+    while (length && spec_file[length - 1] != '/' && spec_file[length - 1] != '\\') {
+        --length;
+    }
+    return __bdd_format__("%.*s__snapshots__", (int)length, spec_file);
+}
+
+char *__bdd_snapshot_file__(__bdd_config_type__ *config, const char *directory, const char *name) {
+    __bdd_node__ *test = __bdd_array_last__(config->node_stack);
+    char *test_path = __bdd_node_path__(test, ".");
+    char *file_name = __bdd_format__("%s.%s", test_path, name);
+    for (char *c = file_name; *c; ++c) {
+        bool is_safe = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') ||
+            (*c >= '0' && *c <= '9') || *c == '-' || *c == '.';
+        if (!is_safe) {
+            *c = '_';
+        }
+    }
+    char *path = __bdd_format__("%s/%s.snap", directory, file_name);
+    free(file_name);
+    free(test_path);
+    return path;
+}
+
+// Maps the reference file into memory. Returns NULL if it does not exist.
+const unsigned char *__bdd_snapshot_load__(const char *path, size_t *size) {
+    static const unsigned char empty[1] = { 0 };
+    *size = 0;
+#ifdef _WIN32
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    long length = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    unsigned char *data = __bdd_malloc__(length > 0 ? (size_t)length : 1);
+    if (!data) {
+        perror("malloc(snapshot)");
+        abort();
+    }
+    *size = fread(data, 1, length > 0 ? (size_t)length : 0, fp);
+    fclose(fp);
+    return data;
+#else
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return NULL;
+    }
+    if (info.st_size == 0) {
+        close(fd);
+        return empty;
+    }
+    void *data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return NULL;
+    }
+    *size = (size_t)info.st_size;
+    return data;
+#endif
+}
+
+void __bdd_snapshot_unload__(const unsigned char *data, size_t size) {
+#ifdef _WIN32
+    (void)size;
+    free((void *)data);
+#else
+    if (size) {
+        munmap((void *)data, size);
+    }
+#endif
+}
+
+// Writes the snapshot to a temporary file first, so that an interrupted
+// update never leaves a truncated reference behind.
+bool __bdd_snapshot_save__(const char *directory, const char *path, const void *data, size_t size) {
+#ifdef _WIN32
+    CreateDirectoryA(directory, NULL);
+#else
+    mkdir(directory, 0777);
+#endif
+    char *temp_name = __bdd_format__("%s.tmp", path);
+    FILE *fp = fopen(temp_name, "wb");
+    bool saved = fp && fwrite(data, 1, size, fp) == size;
+    if (fp) {
+        saved = fclose(fp) == 0 && saved;
+    }
+#ifdef _WIN32
+    if (saved) {
+        remove(path);
+    }
+#endif
+    saved = saved && rename(temp_name, path) == 0;
+    if (!saved) {
+        int error = errno;
+        remove(temp_name);
+        errno = error;
+    }
+    free(temp_name);
+    return saved;
+}
+
+// Offset of the first byte that differs, skipping equal blocks with `memcmp`
+size_t __bdd_mismatch_offset__(const unsigned char *a, const unsigned char *b, size_t size) {
+    size_t offset = 0;
+    while (size - offset >= 4096 && memcmp(a + offset, b + offset, 4096) == 0) {
+        offset += 4096;
+    }
+    while (offset < size && a[offset] == b[offset]) {
+        ++offset;
+    }
+    return offset;
+}
+
+// Appends to the string in the buffer, cutting off whatever does not fit
+void __bdd_append__(char *buffer, size_t buffer_size, const char *fmt, ...) {
+    size_t length = strlen(buffer);
+    if (length + 1 >= buffer_size) {
+        return;
+    }
+    va_list va;
+    va_start(va, fmt);
+    vsnprintf(buffer + length, buffer_size - length, fmt, va);
+    va_end(va);
+}
+
+// Appends three rows of 16 bytes around the offset to the buffer
+void __bdd_hexdump__(char *buffer, size_t buffer_size, const unsigned char *data, size_t size, size_t offset) {
+    size_t start = offset / 16 * 16;
+    start = start >= 16 ? start - 16 : 0;
+    for (size_t row = start; row < start + 48 && row < size; row += 16) {
+        __bdd_append__(buffer, buffer_size, "\n%08zx ", row);
+        for (size_t i = row; i < row + 16; ++i) {
+            if (i < size) {
+                __bdd_append__(buffer, buffer_size, i == offset ? "[%02x]" : " %02x ", data[i]);
+            } else {
+                __bdd_append__(buffer, buffer_size, "    ");
+            }
+        }
+        __bdd_append__(buffer, buffer_size, " |");
+        for (size_t i = row; i < row + 16 && i < size; ++i) {
+            __bdd_append__(buffer, buffer_size, "%c", data[i] >= 0x20 && data[i] < 0x7f ? (char)data[i] : '.');
+        }
+        __bdd_append__(buffer, buffer_size, "|");
+    }
+}
+
+bool __bdd_check_snapshot__(
+    __bdd_config_type__ *config,
+    const char *spec_file,
+    const char *location,
+    const void *data,
+    size_t size,
+    const char *name
+) {
+    char *directory = __bdd_snapshot_directory__(spec_file);
+    char *path = __bdd_snapshot_file__(config, directory, name);
+    size_t expected_size;
+    const unsigned char *expected = __bdd_snapshot_load__(path, &expected_size);
+    const unsigned char *actual = data;
+
+    bool matches = expected && expected_size == size && memcmp(expected, actual, size) == 0;
+    if (!matches && config->update_snapshots) {
+        if (expected) {
+            __bdd_snapshot_unload__(expected, expected_size);
+        }
+        if (!__bdd_snapshot_save__(directory, path, data, size)) {
+            __bdd_check_failed__(config, location, __bdd_format__(
+                "cannot update snapshot %s: %s", path, strerror(errno)
+            ));
+        }
+        free(path);
+        free(directory);
+        return config->error == NULL;
+    }
+
+    if (!expected) {
+        __bdd_check_failed__(config, location, __bdd_format__(
+            "snapshot %s does not exist, run with BDD_UPDATE_SNAPSHOTS=1 to create it", path
+        ));
+    } else if (!matches) {
+        size_t common_size = size < expected_size ? size : expected_size;
+        size_t offset = __bdd_mismatch_offset__(expected, actual, common_size);
+        size_t message_size = strlen(path) + 1024;
+        char *message = __bdd_malloc__(message_size);
+        if (!message) {
+            perror("malloc(message)");
+            abort();
+        }
+        snprintf(
+            message, message_size, "snapshot %s differs at byte %zu (expected %zu bytes, got %zu)\nexpected:",
+            path, offset, expected_size, size
+        );
+        __bdd_hexdump__(message, message_size, expected, expected_size, offset);
+        __bdd_append__(message, message_size, "\nactual:");
+        __bdd_hexdump__(message, message_size, actual, size, offset);
+        __bdd_check_failed__(config, location, message);
+    }
+    if (expected) {
+        __bdd_snapshot_unload__(expected, expected_size);
+    }
+    free(path);
+    free(directory);
+    return matches;
+}
+
+// The kernels of the bulk checks find the next mismatching element. They
+// only ever need to be fast when everything matches, so after a vector
+// mismatch the exact index is found by the scalar loop.
+#if !defined(BDD_NO_SIMD) && defined(__AVX2__)
+  #include <immintrin.h>
+  #define __BDD_AVX2__ 1
+#elif !defined(BDD_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+  #include <emmintrin.h>
+  #define __BDD_SSE2__ 1
+#endif
+
+size_t __bdd_find_not_equal_int__(const int *values, size_t count, int value, size_t i) {
+#if defined(__BDD_AVX2__)
+    __m256i expected = _mm256_set1_epi32(value);
+    for (; i + 8 <= count; i += 8) {
+        __m256i actual = _mm256_loadu_si256((const __m256i *)(values + i));
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(actual, expected)) != -1) {
+            break;
+        }
+    }
+#elif defined(__BDD_SSE2__)
+    __m128i expected = _mm_set1_epi32(value);
+    for (; i + 4 <= count; i += 4) {
+        __m128i actual = _mm_loadu_si128((const __m128i *)(values + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(actual, expected)) != 0xffff) {
+            break;
+        }
+    }
+#endif
+    while (i < count && values[i] == value) {
+        ++i;
+    }
+    return i;
+}
+
+// Finds the next `i` for which `values[i] > values[i + 1]`, or `count - 1`
+size_t __bdd_find_unsorted_int__(const int *values, size_t count, size_t i) {
+#if defined(__BDD_AVX2__)
+    for (; i + 8 < count; i += 8) {
+        __m256i current = _mm256_loadu_si256((const __m256i *)(values + i));
+        __m256i next = _mm256_loadu_si256((const __m256i *)(values + i + 1));
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi32(current, next)) != 0) {
+            break;
+        }
+    }
+#elif defined(__BDD_SSE2__)
+    for (; i + 4 < count; i += 4) {
+        __m128i current = _mm_loadu_si128((const __m128i *)(values + i));
+        __m128i next = _mm_loadu_si128((const __m128i *)(values + i + 1));
+        if (_mm_movemask_epi8(_mm_cmpgt_epi32(current, next)) != 0) {
+            break;
+        }
+    }
+#endif
+    while (i + 1 < count && values[i] <= values[i + 1]) {
+        ++i;
+    }
+    return i;
+}
+
+// Equal values are always close, so that infinities match themselves.
+// NaN is never close to anything.
+size_t __bdd_find_not_close_float__(const float *a, const float *b, size_t count, float tolerance, size_t i) {
+#if defined(__BDD_AVX2__)
+    __m256 sign = _mm256_set1_ps(-0.0f);
+    __m256 limit = _mm256_set1_ps(tolerance);
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_loadu_ps(a + i);
+        __m256 y = _mm256_loadu_ps(b + i);
+        __m256 distance = _mm256_andnot_ps(sign, _mm256_sub_ps(x, y));
+        __m256 close = _mm256_or_ps(_mm256_cmp_ps(distance, limit, _CMP_LE_OQ), _mm256_cmp_ps(x, y, _CMP_EQ_OQ));
+        if (_mm256_movemask_ps(close) != 0xff) {
+            break;
+        }
+    }
+#elif defined(__BDD_SSE2__)
+    __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 limit = _mm_set1_ps(tolerance);
+    for (; i + 4 <= count; i += 4) {
+        __m128 x = _mm_loadu_ps(a + i);
+        __m128 y = _mm_loadu_ps(b + i);
+        __m128 distance = _mm_andnot_ps(sign, _mm_sub_ps(x, y));
+        __m128 close = _mm_or_ps(_mm_cmple_ps(distance, limit), _mm_cmpeq_ps(x, y));
+        if (_mm_movemask_ps(close) != 0xf) {
+            break;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        float distance = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        if (!(a[i] == b[i] || distance <= tolerance)) {
+            break;
+        }
+    }
+    return i;
+}
+
+size_t __bdd_find_not_close_double__(const double *a, const double *b, size_t count, double tolerance, size_t i) {
+#if defined(__BDD_AVX2__)
+    __m256d sign = _mm256_set1_pd(-0.0);
+    __m256d limit = _mm256_set1_pd(tolerance);
+    for (; i + 4 <= count; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        __m256d y = _mm256_loadu_pd(b + i);
+        __m256d distance = _mm256_andnot_pd(sign, _mm256_sub_pd(x, y));
+        __m256d close = _mm256_or_pd(_mm256_cmp_pd(distance, limit, _CMP_LE_OQ), _mm256_cmp_pd(x, y, _CMP_EQ_OQ));
+        if (_mm256_movemask_pd(close) != 0xf) {
+            break;
+        }
+    }
+#elif defined(__BDD_SSE2__)
+    __m128d sign = _mm_set1_pd(-0.0);
+    __m128d limit = _mm_set1_pd(tolerance);
+    for (; i + 2 <= count; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        __m128d y = _mm_loadu_pd(b + i);
+        __m128d distance = _mm_andnot_pd(sign, _mm_sub_pd(x, y));
+        __m128d close = _mm_or_pd(_mm_cmple_pd(distance, limit), _mm_cmpeq_pd(x, y));
+        if (_mm_movemask_pd(close) != 0x3) {
+            break;
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        double distance = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        if (!(a[i] == b[i] || distance <= tolerance)) {
+            break;
+        }
+    }
+    return i;
+}
+
+typedef struct __bdd_mismatches__ {
+    size_t count;
+    size_t length;
+    char text[512];
+} __bdd_mismatches__;
+
+// Counts a mismatch and describes it if it is among the first few
+void __bdd_mismatch_add__(__bdd_mismatches__ *mismatches, const char *format, ...) {
+    if (mismatches->count++ >= BDD_REPORTED_MISMATCHES) {
+        return;
+    }
+    size_t available = sizeof(mismatches->text) - mismatches->length;
+    int written = snprintf(mismatches->text + mismatches->length, available, "%s", mismatches->count > 1 ? ", " : "");
+    if (written > 0 && (size_t)written < available) {
+        mismatches->length += (size_t)written;
+        available -= (size_t)written;
+    }
+    va_list va;
+    va_start(va, format);
+    written = vsnprintf(mismatches->text + mismatches->length, available, format, va);
+    va_end(va);
+    if (written > 0) {
+        mismatches->length += (size_t)written < available ? (size_t)written : available - 1;
+    }
+}
+
+void __bdd_mismatches_fail__(
+    __bdd_config_type__ *config,
+    const char *location,
+    __bdd_mismatches__ *mismatches,
+    size_t total,
+    const char *description
+) {
+    __bdd_check_failed__(config, location, __bdd_format__(
+        "%zu of %zu %s: %s%s",
+        mismatches->count, total, description, mismatches->text,
+        mismatches->count > BDD_REPORTED_MISMATCHES ? ", ..." : ""
+    ));
+}
+
+bool __bdd_check_mem_eq__(
+    __bdd_config_type__ *config,
+    const char *location,
+    const void *actual,
+    const void *expected,
+    size_t size,
+    const char *actual_text,
+    const char *expected_text
+) {
+    const unsigned char *a = actual;
+    const unsigned char *b = expected;
+    if (size == 0 || memcmp(a, b, size) == 0) {
+        return true;
+    }
+    __bdd_mismatches__ mismatches = { 0 };
+    for (size_t i = __bdd_mismatch_offset__(a, b, size); i < size;) {
+        __bdd_mismatch_add__(&mismatches, "[%zu] 0x%02x != 0x%02x", i, a[i], b[i]);
+        ++i;
+        i += __bdd_mismatch_offset__(a + i, b + i, size - i);
+    }
+    char *description = __bdd_format__("bytes of %s and %s differ", actual_text, expected_text);
+    __bdd_mismatches_fail__(config, location, &mismatches, size, description);
+    free(description);
+    return false;
+}
+
+bool __bdd_check_all_eq__(
+    __bdd_config_type__ *config, const char *location, const int *values, size_t count, int value, const char *text
+) {
+    size_t i = __bdd_find_not_equal_int__(values, count, value, 0);
+    if (i == count) {
+        return true;
+    }
+    __bdd_mismatches__ mismatches = { 0 };
+    for (; i < count; i = __bdd_find_not_equal_int__(values, count, value, i + 1)) {
+        __bdd_mismatch_add__(&mismatches, "[%zu] %d", i, values[i]);
+    }
+    char *description = __bdd_format__("elements of %s are not %d", text, value);
+    __bdd_mismatches_fail__(config, location, &mismatches, count, description);
+    free(description);
+    return false;
+}
+
+bool __bdd_check_floats_close__(
+    __bdd_config_type__ *config,
+    const char *location,
+    const float *actual,
+    const float *expected,
+    size_t count,
+    float tolerance,
+    const char *actual_text,
+    const char *expected_text
+) {
+    size_t i = __bdd_find_not_close_float__(actual, expected, count, tolerance, 0);
+    if (i == count) {
+        return true;
+    }
+    __bdd_mismatches__ mismatches = { 0 };
+    for (; i < count; i = __bdd_find_not_close_float__(actual, expected, count, tolerance, i + 1)) {
+        __bdd_mismatch_add__(&mismatches, "[%zu] %.9g vs %.9g", i, actual[i], expected[i]);
+    }
+    char *description = __bdd_format__(
+        "elements of %s and %s differ by more than %g", actual_text, expected_text, tolerance
+    );
+    __bdd_mismatches_fail__(config, location, &mismatches, count, description);
+    free(description);
+    return false;
+}
+
+bool __bdd_check_doubles_close__(
+    __bdd_config_type__ *config,
+    const char *location,
+    const double *actual,
+    const double *expected,
+    size_t count,
+    double tolerance,
+    const char *actual_text,
+    const char *expected_text
+) {
+    size_t i = __bdd_find_not_close_double__(actual, expected, count, tolerance, 0);
+    if (i == count) {
+        return true;
+    }
+    __bdd_mismatches__ mismatches = { 0 };
+    for (; i < count; i = __bdd_find_not_close_double__(actual, expected, count, tolerance, i + 1)) {
+        __bdd_mismatch_add__(&mismatches, "[%zu] %.17g vs %.17g", i, actual[i], expected[i]);
+    }
+    char *description = __bdd_format__(
+        "elements of %s and %s differ by more than %g", actual_text, expected_text, tolerance
+    );
+    __bdd_mismatches_fail__(config, location, &mismatches, count, description);
+    free(description);
+    return false;
+}
+
+bool __bdd_check_sorted__(
+    __bdd_config_type__ *config, const char *location, const int *values, size_t count, const char *text
+) {
+    if (count < 2) {
+        return true;
+    }
+    size_t i = __bdd_find_unsorted_int__(values, count, 0);
+    if (i == count - 1) {
+        return true;
+    }
+    __bdd_mismatches__ mismatches = { 0 };
+    for (; i < count - 1; i = __bdd_find_unsorted_int__(values, count, i + 1)) {
+        __bdd_mismatch_add__(&mismatches, "[%zu] %d > %d", i, values[i], values[i + 1]);
+    }
+    char *description = __bdd_format__("neighbours in %s are out of order", text);
+    __bdd_mismatches_fail__(config, location, &mismatches, count - 1, description);
+    free(description);
+    return false;
+}
+
+// Resident set size of the process right now. Systems without
+// `/proc/self/statm` only provide the peak size through `getrusage`.
+unsigned long long __bdd_current_rss__() {
+#ifdef _WIN32
+    return 0;
+#else
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp) {
+        unsigned long long size, resident;
+        int count = fscanf(fp, "%llu %llu", &size, &resident);
+        fclose(fp);
+        if (count == 2) {
+            return resident * (unsigned long long)sysconf(_SC_PAGESIZE);
+        }
+    }
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return (unsigned long long)usage.ru_maxrss;
+#else
+    return (unsigned long long)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// Linux can reset the peak resident set size, which makes the peak
+// of every test visible instead of only the peak of the whole process.
+bool __bdd_reset_peak_rss__() {
+#ifdef __linux__
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (!fp) {
+        return false;
+    }
+    bool reset = fputs("5", fp) >= 0;
+    return fclose(fp) == 0 && reset;
+#else
+    return false;
+#endif
+}
+
+void __bdd_rusage_sample__(__bdd_rusage__ *sample) {
+    memset(sample, 0, sizeof(__bdd_rusage__));
+#ifndef _WIN32
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    sample->peak_rss = (unsigned long long)usage.ru_maxrss;
+#else
+    sample->peak_rss = (unsigned long long)usage.ru_maxrss * 1024;
+#endif
+    sample->minor_faults = (unsigned long long)usage.ru_minflt;
+    sample->major_faults = (unsigned long long)usage.ru_majflt;
+    sample->voluntary_switches = (unsigned long long)usage.ru_nvcsw;
+    sample->involuntary_switches = (unsigned long long)usage.ru_nivcsw;
+    sample->blocks_in = (unsigned long long)usage.ru_inblock;
+    sample->blocks_out = (unsigned long long)usage.ru_oublock;
+#ifdef __linux__
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp) {
+        char line[256];
+        unsigned long long kilobytes;
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "VmHWM: %llu kB", &kilobytes) == 1) {
+                sample->peak_rss = kilobytes * 1024;
+            }
+        }
+        fclose(fp);
+    }
+#endif
+#endif
+    sample->rss = __bdd_current_rss__();
+}
+
+void __bdd_rusage_start__(__bdd_config_type__ *config) {
+    __bdd_reset_peak_rss__();
+    __bdd_rusage_sample__(&config->rusage_before);
+}
+
+char *__bdd_format_bytes__(char *buffer, size_t size, double bytes) {
+    if (bytes < 1024) {
+        snprintf(buffer, size, "%.0f B", bytes);
+    } else if (bytes < 1024 * 1024) {
+        snprintf(buffer, size, "%.1f KiB", bytes / 1024);
+    } else if (bytes < 1024 * 1024 * 1024) {
+        snprintf(buffer, size, "%.1f MiB", bytes / (1024 * 1024));
+    } else {
+        snprintf(buffer, size, "%.2f GiB", bytes / (1024 * 1024 * 1024));
+    }
+    return buffer;
+}
+
+void __bdd_rusage_report__(__bdd_config_type__ *config, __bdd_test_step__ *step, __bdd_rusage__ *after) {
+    __bdd_rusage__ *before = &config->rusage_before;
+    char peak[32], growth[32];
+    long long rss_growth = (long long)(after->peak_rss - before->rss);
+    __bdd_print_diagnostic__(
+        config, step->level,
+        "peak rss %s (%s%s), faults %llu minor / %llu major, "
+        "switches %llu voluntary / %llu involuntary, blocks %llu in / %llu out",
+        __bdd_format_bytes__(peak, sizeof(peak), (double)after->peak_rss),
+        rss_growth < 0 ? "-" : "+",
+        __bdd_format_bytes__(growth, sizeof(growth), (double)(rss_growth < 0 ? -rss_growth : rss_growth)),
+        after->minor_faults - before->minor_faults,
+        after->major_faults - before->major_faults,
+        after->voluntary_switches - before->voluntary_switches,
+        after->involuntary_switches - before->involuntary_switches,
+        after->blocks_in - before->blocks_in,
+        after->blocks_out - before->blocks_out
+    );
+}
+
+bool __bdd_check_rss_below__(__bdd_config_type__ *config, const char *location, unsigned long long bytes) {
+#ifdef _WIN32
+    (void)bytes;
+    __bdd_check_failed__(config, location, __bdd_format__("check_rss_below is not supported on Windows"));
+    return false;
+#else
+    unsigned long long rss = __bdd_current_rss__();
+    if (rss < bytes) {
+        return true;
+    }
+    char actual[32], limit[32];
+    __bdd_check_failed__(config, location, __bdd_format__(
+        "resident set size is %s, expected less than %s",
+        __bdd_format_bytes__(actual, sizeof(actual), (double)rss),
+        __bdd_format_bytes__(limit, sizeof(limit), (double)bytes)
+    ));
+    return false;
+#endif
+}
+
+// Log-linear buckets like in HDR histograms: values below 128 ns have
+// a bucket each, and every following power of two is split into 64
+// buckets, which keeps the error under 1.6% with constant memory.
+#define __BDD_HISTOGRAM_BITS__ 7
+#define __BDD_HISTOGRAM_SIZE__ ((1 << __BDD_HISTOGRAM_BITS__) + (64 - __BDD_HISTOGRAM_BITS__) * (1 << (__BDD_HISTOGRAM_BITS__ - 1)))
+
+struct __bdd_histogram__ {
+    unsigned long long counts[__BDD_HISTOGRAM_SIZE__];
+    unsigned long long total;
+    unsigned long long min;
+    unsigned long long max;
+};
+
+size_t __bdd_histogram_index__(unsigned long long value) {
+    if (value < (1ull << __BDD_HISTOGRAM_BITS__)) {
+        return (size_t)value;
+    }
+#if defined(__GNUC__)
+    size_t exponent = 63 - (size_t)__builtin_clzll(value);
+#else
+    size_t exponent = 0;
+    while (value >> (exponent + 1)) {
+        ++exponent;
+    }
+#endif
+    size_t shift = exponent - __BDD_HISTOGRAM_BITS__ + 1;
+    size_t half = 1 << (__BDD_HISTOGRAM_BITS__ - 1);
+    return (1 << __BDD_HISTOGRAM_BITS__) + (exponent - __BDD_HISTOGRAM_BITS__) * half + (size_t)(value >> shift) - half;
+}
+
+// The highest value that ends up in the bucket
+unsigned long long __bdd_histogram_value__(size_t index) {
+    if (index < (1 << __BDD_HISTOGRAM_BITS__)) {
+        return index;
+    }
+    size_t half = 1 << (__BDD_HISTOGRAM_BITS__ - 1);
+    size_t bucket = index - (1 << __BDD_HISTOGRAM_BITS__);
+    size_t shift = bucket / half + 1;
+    unsigned long long sub = half + bucket % half;
+    return ((sub + 1) << shift) - 1;
+}
+
+void __bdd_histogram_record__(__bdd_histogram__ *histogram, unsigned long long value) {
+    ++histogram->counts[__bdd_histogram_index__(value)];
+    if (histogram->total == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    ++histogram->total;
+}
+
+unsigned long long __bdd_histogram_percentile__(const __bdd_histogram__ *histogram, double percentile) {
+    double rank = percentile / 100 * (double)histogram->total;
+    unsigned long long target = (unsigned long long)rank + ((double)(unsigned long long)rank < rank);
+    target = target < 1 ? 1 : target > histogram->total ? histogram->total : target;
+    unsigned long long seen = 0;
+    for (size_t i = 0; i < __BDD_HISTOGRAM_SIZE__; ++i) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            unsigned long long value = __bdd_histogram_value__(i);
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+// Starts a `measure_latency` loop. The samples of all of the loops
+// of a test end up in the same histogram.
+void __bdd_latency_start__(__bdd_config_type__ *config, unsigned long long iterations) {
+    if (!config->latency) {
+        config->latency = __bdd_calloc__(1, sizeof(__bdd_histogram__));
+        if (!config->latency) {
+            perror("calloc(latency)");
+            abort();
+        }
+    }
+    config->latency_remaining = iterations;
+    config->latency_started_at = 0;
+}
+
+// Records the time since the previous call, which includes reading
+// the clock once, and starts the clock for the next run of the body.
+bool __bdd_latency_next__(__bdd_config_type__ *config) {
+    if (config->latency_started_at) {
+        __bdd_histogram_record__(config->latency, __bdd_now_ns__() - config->latency_started_at);
+    }
+    if (config->latency_remaining == 0) {
+        config->latency_started_at = 0;
+        return false;
+    }
+    --config->latency_remaining;
+    config->latency_started_at = __bdd_now_ns__();
+    return true;
+}
+
+void __bdd_latency_report__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    __bdd_histogram__ *histogram = config->latency;
+    if (!histogram->total) {
+        return;
+    }
+    char p50[32], p90[32], p99[32], p999[32], max[32];
+    __bdd_print_diagnostic__(
+        config, step->level, "%llu samples: p50 %s, p90 %s, p99 %s, p99.9 %s, max %s",
+        histogram->total,
+        __bdd_format_duration__(p50, sizeof(p50), (double)__bdd_histogram_percentile__(histogram, 50)),
+        __bdd_format_duration__(p90, sizeof(p90), (double)__bdd_histogram_percentile__(histogram, 90)),
+        __bdd_format_duration__(p99, sizeof(p99), (double)__bdd_histogram_percentile__(histogram, 99)),
+        __bdd_format_duration__(p999, sizeof(p999), (double)__bdd_histogram_percentile__(histogram, 99.9)),
+        __bdd_format_duration__(max, sizeof(max), (double)histogram->max)
+    );
+}
+
+void __bdd_latency_free__(__bdd_config_type__ *config) {
+    free(config->latency);
+    config->latency = NULL;
+}
+
+bool __bdd_check_percentile__(
+    __bdd_config_type__ *config, const char *location, double percentile, unsigned long long limit_ns
+) {
+    if (!config->latency || !config->latency->total) {
+        __bdd_check_failed__(config, location, __bdd_format__(
+            "no latency samples, measure_latency has to run before the check"
+        ));
+        return false;
+    }
+    unsigned long long value = __bdd_histogram_percentile__(config->latency, percentile);
+    if (value <= limit_ns) {
+        return true;
+    }
+    char actual[32], limit[32];
+    __bdd_check_failed__(config, location, __bdd_format__(
+        "p%g latency is %s, expected at most %s", percentile,
+        __bdd_format_duration__(actual, sizeof(actual), (double)value),
+        __bdd_format_duration__(limit, sizeof(limit), (double)limit_ns)
+    ));
+    return false;
+}
+
+// Reads the first line of a small system file, without the newline
+bool __bdd_read_first_line__(const char *path, char *buffer, size_t size) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return false;
+    }
+    bool ok = fgets(buffer, (int)size, fp) != NULL;
+    fclose(fp);
+    if (ok) {
+        buffer[strcspn(buffer, "\n")] = '\0';
+    }
+    return ok;
+}
+
+// The cpus that fit into the set of `sched_setaffinity`
+#if defined(__linux__) && defined(CPU_SETSIZE)
+#define __BDD_MAX_CPUS__ CPU_SETSIZE
+#else
+#define __BDD_MAX_CPUS__ 1024
+#endif
+
+// Pins the whole process, including the threads that it starts
+// later, to a single CPU so that the timings do not depend on
+// the scheduler moving it between cores.
+bool __bdd_pin_cpu__(int cpu) {
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        perror("sched_setaffinity");
+        return false;
+    }
+    return true;
+#elif defined(__linux__)
+    fprintf(stderr, "BDD_PIN_CPU=%d needs the runtime to be compiled with _GNU_SOURCE\n", cpu);
+    return false;
+#else
+    fprintf(stderr, "BDD_PIN_CPU=%d is not supported on this platform\n", cpu);
+    return false;
+#endif
+}
+
+void __bdd_environment_line__(__bdd_config_type__ *config, bool warning, const char *format, ...) {
+    va_list va;
+    va_start(va, format);
+    fprintf(config->output, "%s", config->use_tap ? "# " : "");
+    if (warning) {
+        fprintf(config->output, "%swarning:%s ", config->use_color ? __BDD_COLOR_YELLOW__ : "", config->use_color ? __BDD_COLOR_RESET__ : "");
+    }
+    vfprintf(config->output, format, va);
+    fprintf(config->output, "\n");
+    va_end(va);
+}
+
+// Records the state of the machine that the timings depend on, and
+// warns about the states that are known to make them unreliable.
+void __bdd_environment_print__(__bdd_config_type__ *config, int pinned_cpu) {
+#ifdef _WIN32
+    (void)pinned_cpu;
+    __bdd_environment_line__(config, false, "environment: not available on Windows");
+#else
+    char model[256] = "unknown";
+    FILE *fp = fopen("/proc/cpuinfo", "r");
+    if (fp) {
+        char line[512];
+        while (fgets(line, sizeof(line), fp)) {
+            char *colon = strchr(line, ':');
+            if (colon && strncmp(line, "model name", strlen("model name")) == 0) {
+                colon += 1 + (colon[1] == ' ');
+                snprintf(model, sizeof(model), "%s", colon);
+                model[strcspn(model, "\n")] = '\0';
+                break;
+            }
+        }
+        fclose(fp);
+    }
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (pinned_cpu >= 0) {
+        __bdd_environment_line__(config, false, "cpu: %s, %ld online, pinned to cpu %d", model, online, pinned_cpu);
+    } else {
+        __bdd_environment_line__(config, false, "cpu: %s, %ld online, not pinned", model, online);
+    }
+
+    char path[128], governor[64];
+    snprintf(
+        path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/scaling_governor", pinned_cpu >= 0 ? pinned_cpu : 0
+    );
+    if (__bdd_read_first_line__(path, governor, sizeof(governor))) {
+        __bdd_environment_line__(config, false, "governor: %s", governor);
+        if (strcmp(governor, "performance") != 0) {
+            __bdd_environment_line__(
+                config, true, "the frequency governor is not `performance`, so the clock speed can change during the run"
+            );
+        }
+    } else {
+        __bdd_environment_line__(config, false, "governor: unknown");
+    }
+
+    char load[128];
+    double load1 = 0, load5 = 0, load15 = 0;
+    if (__bdd_read_first_line__("/proc/loadavg", load, sizeof(load))
+        && sscanf(load, "%lf %lf %lf", &load1, &load5, &load15) == 3) {
+        __bdd_environment_line__(config, false, "load average: %.2f %.2f %.2f", load1, load5, load15);
+        // Every core is busy, so the tests compete with other processes
+        if (online > 0 && load1 >= (double)online) {
+            __bdd_environment_line__(
+                config, true, "the load average of %.2f is high for %ld cpus, timings will be noisy", load1, online
+            );
+        }
+    }
+#endif
+    if (!config->use_tap) {
+        fprintf(config->output, "\n");
+    }
+}
+
+// Releases the resources that a step could have acquired, even if
+// it returned early because of a failed `check`.
+void __bdd_after_step__(__bdd_config_type__ *config) {
+    __bdd_corpus_unmap__(config);
+}
+
+// Samples of a `bench_variant`, in nanoseconds per run of its body
+typedef struct __bdd_bench__ {
+    size_t round;
+    unsigned long long iterations;
+    double samples[BDD_BENCH_SAMPLES];
+    size_t sample_count;
+    double median;
+    double cv; // standard deviation of the samples relative to their mean
+    char *error;
+    char *location;
+} __bdd_bench__;
+
+void __bdd_bench_free__(void *payload) {
+    __bdd_bench__ *bench = payload;
+    free(bench->error);
+    free(bench);
+}
+
+// Runs the body of the variant once per call until the batch is done,
+// only reading the clock at the start and at the end of the batch.
+bool __bdd_bench_next__(__bdd_config_type__ *config) {
+    if (config->bench_count == config->bench_iterations) {
+        config->bench_elapsed_ns = __bdd_now_ns__() - config->bench_started_at;
+        return false;
+    }
+    if (config->bench_count == 0) {
+        config->bench_started_at = __bdd_now_ns__();
+    }
+    ++config->bench_count;
+    return true;
+}
+
+// Navigates to the node like to the step of any other test
+void __bdd_call_node__(__bdd_config_type__ *config, __bdd_test_step__ *step, __bdd_node__ *node) {
+    __bdd_test_step__ node_step = *step;
+    node_step.id = node->id;
+    node_step.name = node->name;
+    node_step.type = node->type;
+    node_step.flags = node->flags;
+    node_step.ends_test = false;
+    config->current_test = &node_step;
+    config->node_stack->size = 1;
+    config->id = 0;
+    __bdd_call_test_main__(config);
+    __bdd_after_step__(config);
+    config->current_test = step;
+}
+
+// Runs the `before_each` hooks of the groups of the node from the
+// outermost one, or their `after_each` hooks from the innermost one,
+// like the plan runs them around the step of a test
+void __bdd_call_each_hooks__(__bdd_config_type__ *config, __bdd_node__ *node, bool before) {
+    __bdd_test_step__ *step = config->current_test;
+    __bdd_array__ *groups = __bdd_array_create__();
+    for (__bdd_node__ *group = node->parent; group; group = group->parent) {
+        __bdd_array_push__(groups, group);
+    }
+    for (size_t g = 0; g < groups->size; ++g) {
+        __bdd_node__ *group = groups->values[before ? groups->size - g - 1 : g];
+        __bdd_array__ *hooks = before ? group->list_before_each : group->list_after_each;
+        for (size_t i = 0; i < hooks->size && !(before && config->error); ++i) {
+            __bdd_call_node__(config, step, hooks->values[i]);
+        }
+    }
+    __bdd_array_free__(groups);
+}
+
+// Runs a batch of the variant between its own hooks, so that every
+// batch starts from the same state as the step of a test would
+bool __bdd_bench_batch__(__bdd_config_type__ *config, __bdd_node__ *variant, unsigned long long iterations) {
+    __bdd_bench__ *bench = variant->payload;
+    config->bench_iterations = iterations;
+    config->bench_count = 0;
+    config->bench_elapsed_ns = 0;
+    __bdd_arena_mark__ arena_mark = __bdd_arena_save__(config->arena);
+    __bdd_call_each_hooks__(config, variant, true);
+    if (!config->error) {
+        __bdd_call_node__(config, config->current_test, variant);
+    }
+    // The cleanup runs after a failure too, but the first error is reported
+    char *error = config->error;
+    char *location = config->location;
+    config->error = NULL;
+    __bdd_call_each_hooks__(config, variant, false);
+    if (error) {
+        free(config->error);
+        config->error = error;
+        config->location = location;
+    }
+    __bdd_arena_rewind__(config->arena, arena_mark);
+    if (config->error) {
+        bench->error = config->error;
+        bench->location = config->location;
+        config->error = NULL;
+        return false;
+    }
+    return true;
+}
+
+int __bdd_compare_doubles__(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Newton's method, to not depend on the math library for a single function
+double __bdd_sqrt__(double value) {
+    if (value <= 0) {
+        return 0;
+    }
+    double root = value > 1 ? value : 1;
+    for (int i = 0; i < 100; ++i) {
+        root = (root + value / root) / 2;
+    }
+    return root;
+}
+
+double __bdd_median__(const double *values, size_t count) {
+    double sorted[BDD_BENCH_SAMPLES];
+    memcpy(sorted, values, count * sizeof(double));
+    qsort(sorted, count, sizeof(double), __bdd_compare_doubles__);
+    return count % 2 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+// Calibrates every variant of the group to a batch of about
+// `BDD_BENCH_BATCH_US` and then takes their samples in turns,
+// starting with a different variant every time, so that a drift
+// of the machine, like a change of the CPU frequency, affects
+// all of the variants the same way.
+void __bdd_bench_session__(__bdd_config_type__ *config, __bdd_node__ *node) {
+    __bdd_array__ *variants = __bdd_array_create__();
+    __bdd_array__ *siblings = node->parent->list_children;
+    for (size_t i = 0; i < siblings->size; ++i) {
+        __bdd_node__ *sibling = siblings->values[i];
+        if ((sibling->flags & __bdd_node_flags_bench__) && !sibling->excluded) {
+            if (sibling->free_payload) {
+                sibling->free_payload(sibling->payload);
+            }
+            sibling->payload = __bdd_calloc__(1, sizeof(__bdd_bench__));
+            if (!sibling->payload) {
+                perror("calloc(bench)");
+                abort();
+            }
+            sibling->free_payload = __bdd_bench_free__;
+            ((__bdd_bench__ *)sibling->payload)->round = config->round;
+            __bdd_array_push__(variants, sibling);
+        }
+    }
+
+    bool ok = true;
+    unsigned long long batch_ns = BDD_BENCH_BATCH_US * 1000ull;
+    for (size_t i = 0; ok && i < variants->size; ++i) {
+        __bdd_node__ *variant = variants->values[i];
+        __bdd_bench__ *bench = variant->payload;
+        unsigned long long iterations = 1;
+        while ((ok = __bdd_bench_batch__(config, variant, iterations))) {
+            if (config->bench_elapsed_ns >= batch_ns || iterations >= (1ull << 40)) {
+                break;
+            }
+            // Aim slightly above the target so that the calibration converges fast
+            double scale = config->bench_elapsed_ns ? 1.2 * batch_ns / config->bench_elapsed_ns : 100;
+            iterations = (unsigned long long)(iterations * (scale < 100 ? scale : 100)) + 1;
+        }
+        bench->iterations = iterations;
+    }
+    for (size_t sample = 0; ok && sample < BDD_BENCH_SAMPLES; ++sample) {
+        for (size_t i = 0; ok && i < variants->size; ++i) {
+            __bdd_node__ *variant = variants->values[(sample + i) % variants->size];
+            __bdd_bench__ *bench = variant->payload;
+            ok = __bdd_bench_batch__(config, variant, bench->iterations);
+            if (ok) {
+                bench->samples[bench->sample_count++] = (double)config->bench_elapsed_ns / bench->iterations;
+            }
+        }
+    }
+    for (size_t i = 0; i < variants->size; ++i) {
+        __bdd_node__ *variant = variants->values[i];
+        __bdd_bench__ *bench = variant->payload;
+        if (!ok && !bench->error) {
+            bench->error = __bdd_format__("stopped because another variant failed");
+            bench->location = "";
+        }
+        if (bench->sample_count) {
+            bench->median = __bdd_median__(bench->samples, bench->sample_count);
+            double mean = 0, variance = 0;
+            for (size_t s = 0; s < bench->sample_count; ++s) {
+                mean += bench->samples[s] / (double)bench->sample_count;
+            }
+            for (size_t s = 0; s < bench->sample_count; ++s) {
+                variance += (bench->samples[s] - mean) * (bench->samples[s] - mean) / (double)bench->sample_count;
+            }
+            bench->cv = mean > 0 ? __bdd_sqrt__(variance) / mean : 0;
+        }
+    }
+    __bdd_array_free__(variants);
+}
+
+// All of the variants of a group run in the step of the first one
+void __bdd_bench_step__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    __bdd_node__ *node = config->nodes->values[step->id];
+    __bdd_bench__ *bench = node->payload;
+    if (!bench || bench->round != config->round) {
+        __bdd_bench_session__(config, node);
+        bench = node->payload;
+    }
+    if (bench->error) {
+        config->error = __bdd_strdup__(bench->error);
+        config->location = bench->location;
+    }
+}
+
+// The speedup of `faster` over `slower` is the ratio of their medians.
+// Its 95% confidence interval comes from bootstrap resampling with
+// a fixed seed, so the same samples always give the same report.
+void __bdd_bench_compare__(__bdd_bench__ *faster, __bdd_bench__ *slower, double *low, double *high) {
+    enum { resamples = 1000 };
+    static double ratios[resamples];
+    unsigned long long state = 0x9E3779B97F4A7C15ull;
+    double a[BDD_BENCH_SAMPLES], b[BDD_BENCH_SAMPLES];
+    for (size_t r = 0; r < resamples; ++r) {
+        for (size_t i = 0; i < faster->sample_count; ++i) {
+            state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+            a[i] = faster->samples[state % faster->sample_count];
+        }
+        for (size_t i = 0; i < slower->sample_count; ++i) {
+            state ^= state << 13, state ^= state >> 7, state ^= state << 17;
+            b[i] = slower->samples[state % slower->sample_count];
+        }
+        ratios[r] = __bdd_median__(b, slower->sample_count) / __bdd_median__(a, faster->sample_count);
+    }
+    qsort(ratios, resamples, sizeof(double), __bdd_compare_doubles__);
+    *low = ratios[resamples * 25 / 1000];
+    *high = ratios[resamples * 975 / 1000 - 1];
+}
+
+// Probability that a sample of `a` is faster than a sample of `b`,
+// which is the Mann-Whitney U statistic divided by the number of pairs
+double __bdd_bench_superiority__(__bdd_bench__ *a, __bdd_bench__ *b) {
+    double u = 0;
+    for (size_t i = 0; i < a->sample_count; ++i) {
+        for (size_t j = 0; j < b->sample_count; ++j) {
+            u += a->samples[i] < b->samples[j] ? 1 : a->samples[i] == b->samples[j] ? 0.5 : 0;
+        }
+    }
+    return u / (double)(a->sample_count * b->sample_count);
+}
+
+void __bdd_bench_report__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    __bdd_node__ *node = config->nodes->values[step->id];
+    __bdd_bench__ *bench = node->payload;
+    if (!bench->sample_count) {
+        return;
+    }
+    char median[32];
+    __bdd_print_diagnostic__(
+        config, step->level, "%s per run, median of %zu samples of %llu runs%s",
+        __bdd_format_duration__(median, sizeof(median), bench->median), bench->sample_count, bench->iterations,
+        bench->cv > BDD_NOISY_CV ? ", noisy" : ""
+    );
+    if (bench->cv > BDD_NOISY_CV) {
+        __bdd_print_diagnostic__(
+            config, step->level, "the samples vary by %.1f%% of their mean, above the %.1f%% allowed by BDD_NOISY_CV",
+            100 * bench->cv, 100 * (double)BDD_NOISY_CV
+        );
+    }
+    // Every other variant is compared with the first one of the group
+    __bdd_array__ *siblings = node->parent->list_children;
+    for (size_t i = 0; i < siblings->size; ++i) {
+        __bdd_node__ *baseline = siblings->values[i];
+        if (!(baseline->flags & __bdd_node_flags_bench__) || baseline->excluded) {
+            continue;
+        }
+        __bdd_bench__ *base = baseline->payload;
+        if (baseline != node && base && base->sample_count && (bench->cv > BDD_NOISY_CV || base->cv > BDD_NOISY_CV)) {
+            __bdd_print_diagnostic__(config, step->level, "not compared with %s, the samples are too noisy", baseline->name);
+        } else if (baseline != node && base && base->sample_count) {
+            double low, high;
+            bool is_faster = bench->median < base->median;
+            __bdd_bench_compare__(is_faster ? bench : base, is_faster ? base : bench, &low, &high);
+            __bdd_print_diagnostic__(
+                config, step->level, "%.2fx %s than %s (95%% CI %.2fx - %.2fx), faster in %.0f%% of pairs",
+                is_faster ? base->median / bench->median : bench->median / base->median,
+                is_faster ? "faster" : "slower", baseline->name, low, high,
+                100 * __bdd_bench_superiority__(bench, base)
+            );
+        }
+        break;
+    }
+}
+
+__bdd_bench__ *__bdd_bench_find__(__bdd_node__ *group, const char *name) {
+    for (size_t i = 0; i < group->list_children->size; ++i) {
+        __bdd_node__ *child = group->list_children->values[i];
+        if ((child->flags & __bdd_node_flags_bench__) && strcmp(child->name, name) == 0) {
+            return child->payload;
+        }
+    }
+    return NULL;
+}
+
+// Passes if `faster` is at least `ratio` times faster than `slower` with
+// 95% confidence, so the whole confidence interval has to be above it.
+bool __bdd_check_faster__(
+    __bdd_config_type__ *config, const char *location, const char *faster, const char *slower, double ratio
+) {
+    __bdd_node__ *test = __bdd_array_last__(config->node_stack);
+    __bdd_bench__ *a = __bdd_bench_find__(test->parent, faster);
+    __bdd_bench__ *b = __bdd_bench_find__(test->parent, slower);
+    const char *missing = !a || !a->sample_count ? faster : !b || !b->sample_count ? slower : NULL;
+    if (missing) {
+        __bdd_check_failed__(config, location, __bdd_format__(
+            "no samples of bench_variant(\"%s\"), it has to run before the check", missing
+        ));
+        return false;
+    }
+    double low, high;
+    __bdd_bench_compare__(a, b, &low, &high);
+    if (low >= ratio) {
+        return true;
+    }
+    __bdd_check_failed__(config, location, __bdd_format__(
+        "%s is %.2fx faster than %s (95%% CI %.2fx - %.2fx), expected at least %.2fx",
+        faster, b->median / a->median, slower, low, high, ratio
+    ));
+    return false;
+}
+
+// Runs every input of a `fuzz_it` test as if it was a test of its own: the
+// plan runs the hooks around the first one, and the `after_each` and the
+// `before_each` hooks run again between every two of them
+void __bdd_fuzz_step__(__bdd_config_type__ *config, __bdd_test_step__ *step) {
+    __bdd_node__ *node = config->nodes->values[step->id];
+    __bdd_call_test_main__(config);
+    while (config->fuzz && !config->error) {
+        if (config->fuzz->fuzzing) {
+            __bdd_fuzz_learn__(config->fuzz);
+        }
+        if (!__bdd_fuzz_advance__(config)) {
+            break;
+        }
+        __bdd_call_each_hooks__(config, node, false);
+        // The memory of `bdd_alloc` is only kept for a single input
+        __bdd_arena_rewind__(config->arena, config->fuzz->arena_mark);
+        __bdd_call_each_hooks__(config, node, true);
+        if (!config->error) {
+            __bdd_call_node__(config, step, node);
+        }
+    }
+}
+
+void __bdd_run__(__bdd_config_type__ *config) {
+    __bdd_test_step__ *step = config->current_test;
+
+    bool skipped = step->type == __BDD_NODE_TEST__ && __bdd_step_is_skipped__(config, step);
+    bool is_async = step->type == __BDD_NODE_TEST__ && (step->flags & __bdd_node_flags_async__) && !skipped;
+
+    // Adjacent async tests are in flight together; any other step
+    // has to wait for them to complete to keep the hooks order intact.
+    if (!is_async) {
+        __bdd_async_drain__(config);
+    }
+
+    if (step->type == __BDD_NODE_GROUP__ && !config->use_tap) {
+        if (config->has_focus_nodes && !(step->flags & __bdd_node_flags_focus__)) {
+            return;
+        }
+        if (config->quiet) {
+            return;
+        }
+        __bdd_indent__(config->output, step->level);
+        fprintf(
+            config->output, "%s%s%s\n",
+            config->use_color ? __BDD_COLOR_BOLD__ : "",
+            step->name,
+            config->use_color ? __BDD_COLOR_RESET__ : ""
+        );
+        return;
+    }
+
+    if (step->type == __BDD_NODE_TEST__) {
+        ++config->test_tap_index;
+
+        if (is_async) {
+            __bdd_async_start__(config, step);
+            return;
+        }
+
+        // Print the step name before running the test so it is visible
+        // even if the test itself crashes.
+        if (!skipped || !config->has_focus_nodes) {
+            __bdd_print_test_name__(config, step);
+        }
+
+        __bdd_concurrent__ *concurrent = NULL;
+        __bdd_interleaving__ *interleaving = NULL;
+        __bdd_rusage__ rusage_after;
+        if (!skipped) {
+            if (config->interactive) {
+                // Piped output stays buffered, the crash handler flushes it
+                fflush(config->output);
+            }
+            if (config->use_rusage) {
+                __bdd_rusage_start__(config);
+            }
+            unsigned long long started_at = config->trace || config->repeating ? __bdd_now_ns__() : 0;
+            __bdd_running_step_name__ = step->name;
+            if (step->flags & __bdd_node_flags_bench__) {
+                __bdd_bench_step__(config, step);
+            } else if (step->flags & __bdd_node_flags_concurrent__) {
+                concurrent = __bdd_concurrent_run__(config, step);
+                if (concurrent && __bdd_stats__.enabled) {
+                    // The threads run the spec in parallel, so only the wall time counts
+                    __bdd_stats__.body_ns += concurrent->elapsed_ns;
+                }
+            } else if (step->flags & __bdd_node_flags_interleaved__) {
+                interleaving = __bdd_interleaving_run__(config, step);
+                if (interleaving && __bdd_stats__.enabled) {
+                    __bdd_stats__.body_ns += interleaving->elapsed_ns;
+                }
+            } else if (step->flags & __bdd_node_flags_fuzz__) {
+                __bdd_fuzz_step__(config, step);
+            } else {
+                __bdd_call_test_main__(config);
+            }
+            __bdd_running_step_name__ = NULL;
+            __bdd_after_step__(config);
+            if (config->fuzz) {
+                __bdd_fuzz_finish__(config);
+            }
+            if (config->use_rusage) {
+                __bdd_rusage_sample__(&rusage_after);
+            }
+            unsigned long long finished_at = config->trace || config->repeating ? __bdd_now_ns__() : 0;
+            if (config->trace) {
+                __bdd_trace_step__(config, step, started_at, finished_at);
+                if (concurrent) {
+                    __bdd_concurrent_trace__(config, step, concurrent);
+                }
+            }
+            if (config->repeating) {
+                __bdd_repeat_record__(config, step, config->error != NULL, finished_at - started_at);
+            }
+        }
+
+        __bdd_print_test_result__(config, step, config->test_tap_index, skipped, config->error, config->location);
+        free(config->error);
+        config->error = NULL;
+
+        if (config->use_rusage && !skipped) {
+            __bdd_rusage_report__(config, step, &rusage_after);
+        }
+        if ((step->flags & __bdd_node_flags_bench__) && !skipped) {
+            __bdd_bench_report__(config, step);
+        }
+        if (config->latency) {
+            __bdd_latency_report__(config, step);
+            __bdd_latency_free__(config);
+        }
+        if (config->fuzz) {
+            __bdd_fuzz_report__(config, step);
+            __bdd_fuzz_free__(config);
+        }
+
+        if (concurrent) {
+            __bdd_concurrent_report__(config, step, concurrent);
+            __bdd_concurrent_free__(concurrent);
+        }
+        if (interleaving) {
+            __bdd_interleaving_report__(config, step, interleaving);
+            __bdd_interleaving_free__(interleaving);
+        }
+    } else if (!skipped) {
+      unsigned long long started_at = config->trace ? __bdd_now_ns__() : 0;
+      __bdd_running_step_name__ = step->name;
+      __bdd_call_test_main__(config);
+      __bdd_running_step_name__ = NULL;
+      __bdd_after_step__(config);
+      __bdd_latency_free__(config);
+      if (config->trace) {
+          __bdd_trace_step__(config, step, started_at, __bdd_now_ns__());
+      }
+    }
+
+    // Also when a `check` returned early, since nothing else frees it
+    if (step->ends_test) {
+        __bdd_arena_reset__(config->arena);
+    }
+}
+
+char *__bdd_vformat__(const char *format, va_list va) {
+    // First we over-allocate
+    const size_t size = 2048;
+    char *result = __bdd_calloc__(size, sizeof(char));
+    if (!result) {
+        perror("calloc(result)");
+        abort();
+    }
+    vsnprintf(result, size - 1, format, va);
+    __BDD_STATS_ADD__(format_calls, 1);
+    __BDD_STATS_ADD__(formatted_bytes, strlen(result));
+
+    // Then clip to an actual size
+    void* r = __bdd_realloc__(result, strlen(result) + 1);
+    if (!r) {
+        perror("realloc(result)");
+        abort();
+    }
+    result = r;
+    return result;
+}
+
+char *__bdd_format__(const char *format, ...) {
+    va_list va;
+    va_start(va, format);
+    char *result = __bdd_vformat__(format, va);
+    va_end(va);
+    return result;
+}
+
+bool __bdd_is_supported_term__() {
+    bool result;
+    const char *term = getenv("TERM");
+    result = term && strcmp(term, "") != 0;
+#ifndef _WIN32
+    return result;
+#else
+    if (result) {
+        return 1;
+    }
+
+    // Attempt to enable virtual terminal processing on Windows.
+    // See: https://msdn.microsoft.com/en-us/library/windows/desktop/mt638032(v=vs.85).aspx
+    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
+    if (hOut == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
+
+    DWORD dwMode = 0;
+    if (!GetConsoleMode(hOut, &dwMode)) {
+        return 0;
+    }
+
+    dwMode |= 0x4; // ENABLE_VIRTUAL_TERMINAL_PROCESSING
+    if (!SetConsoleMode(hOut, dwMode)) {
+        return 0;
+    }
+
+    return 1;
+#endif
+}
+
+typedef struct __bdd_timing__ {
+    char *path;
+    unsigned long long duration_ns;
+} __bdd_timing__;
+
+// Loads `<duration in ns>\t<group path>` lines. When a path is listed more
+// than once the last entry wins, so history files can be merged with `cat`.
+__bdd_array__ *__bdd_timings_load__(const char *file_name) {
+    __bdd_array__ *timings = __bdd_array_create__();
+    FILE *fp = file_name ? fopen(file_name, "r") : NULL;
+    if (!fp) {
+        return timings;
+    }
+    char line[4096];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        char *separator = strchr(line, '\t');
+        if (!separator) {
+            continue;
+        }
+        __bdd_timing__ *timing = __bdd_malloc__(sizeof(__bdd_timing__));
+        if (!timing) {
+            perror("malloc(timing)");
+            abort();
+        }
+        timing->duration_ns = strtoull(line, NULL, 10);
+        timing->path = __bdd_strdup__(separator + 1);
+        __bdd_array_push__(timings, timing);
+    }
+    fclose(fp);
+    return timings;
+}
+
+__bdd_timing__ *__bdd_timings_find__(__bdd_array__ *timings, const char *path) {
+    for (size_t i = timings->size; i > 0; --i) {
+        __bdd_timing__ *timing = timings->values[i - 1];
+        if (strcmp(timing->path, path) == 0) {
+            return timing;
+        }
+    }
+    return NULL;
+}
+
+void __bdd_timings_free__(__bdd_array__ *timings) {
+    for (size_t i = 0; i < timings->size; ++i) {
+        __bdd_timing__ *timing = timings->values[i];
+        free(timing->path);
+        free(timing);
+    }
+    __bdd_array_free__(timings);
+}
+
+
+size_t __bdd_unit_test_count__(__bdd_node__ *group) {
+    size_t count = 0;
+    for (size_t i = 0; i < group->list_children->size; ++i) {
+        count += __bdd_node_is_leaf__(group->list_children->values[i]);
+    }
+    return count;
+}
+
+// The units of scheduling are the groups that directly contain tests,
+// a group only containing other groups is scheduled through them.
+void __bdd_collect_units__(__bdd_node__ *node, __bdd_array__ *units) {
+    if (__bdd_unit_test_count__(node) > 0) {
+        __bdd_array_push__(units, node);
+    }
+    for (size_t i = 0; i < node->list_children->size; ++i) {
+        __bdd_node__ *child = node->list_children->values[i];
+        if (!__bdd_node_is_leaf__(child)) {
+            __bdd_collect_units__(child, units);
+        }
+    }
+}
+
+typedef struct __bdd_weighted_unit__ {
+    double weight;
+    size_t index;
+} __bdd_weighted_unit__;
+
+int __bdd_compare_weighted_units__(const void *a, const void *b) {
+    const __bdd_weighted_unit__ *left = a, *right = b;
+    if (left->weight != right->weight) {
+        return left->weight < right->weight ? 1 : -1;
+    }
+    // Every shard has to come up with exactly the same assignment
+    return left->index < right->index ? -1 : (left->index > right->index);
+}
+
+// Assigns units to shards with the longest-processing-time-first rule and
+// excludes the tests of the units that did not end up in `shard_index`.
+// Units without history are weighted by the average time per test, or
+// simply by their test count when there is no history at all.
+void __bdd_shard_plan__(
+    __bdd_node__ *root,
+    __bdd_array__ *units,
+    __bdd_array__ *history,
+    size_t shard_index,
+    size_t shard_count
+) {
+    size_t count = units->size;
+    __bdd_weighted_unit__ *weighted = __bdd_calloc__(count ? count : 1, sizeof(__bdd_weighted_unit__));
+    double *loads = __bdd_calloc__(shard_count, sizeof(double));
+    if (!weighted || !loads) {
+        perror("calloc(shards)");
+        abort();
+    }
+
+    double known_ns = 0;
+    size_t known_tests = 0;
+    for (size_t i = 0; i < count; ++i) {
+        char *path = __bdd_timing_path__(units->values[i]);
+        __bdd_timing__ *timing = __bdd_timings_find__(history, path);
+        free(path);
+        weighted[i].index = i;
+        weighted[i].weight = -1;
+        if (timing) {
+            weighted[i].weight = (double)timing->duration_ns;
+            known_ns += (double)timing->duration_ns;
+            known_tests += __bdd_unit_test_count__(units->values[i]);
+        }
+    }
+    double per_test = known_tests ? known_ns / (double)known_tests : 1;
+    for (size_t i = 0; i < count; ++i) {
+        if (weighted[i].weight < 0) {
+            weighted[i].weight = per_test * (double)__bdd_unit_test_count__(units->values[i]);
+        }
+    }
+
+    qsort(weighted, count, sizeof(__bdd_weighted_unit__), __bdd_compare_weighted_units__);
+    for (size_t i = 0; i < count; ++i) {
+        size_t shard = 0;
+        for (size_t s = 1; s < shard_count; ++s) {
+            if (loads[s] < loads[shard]) {
+                shard = s;
+            }
+        }
+        loads[shard] += weighted[i].weight;
+        if (shard == shard_index) {
+            continue;
+        }
+        __bdd_node__ *unit = units->values[weighted[i].index];
+        for (size_t c = 0; c < unit->list_children->size; ++c) {
+            __bdd_node__ *child = unit->list_children->values[c];
+            if (__bdd_node_is_leaf__(child)) {
+                child->excluded = true;
+            }
+        }
+    }
+    __bdd_node_prune__(root);
+
+    free(weighted);
+    free(loads);
+}
+
+void __bdd_timings_save__(const char *file_name, __bdd_array__ *history, __bdd_array__ *units) {
+    size_t length = strlen(file_name) + sizeof(".tmp");
+    char *temp_name = __bdd_calloc__(length, sizeof(char));
+    if (!temp_name) {
+        perror("calloc(temp_name)");
+        abort();
+    }
+    snprintf(temp_name, length, "%s.tmp", file_name);
+
+    FILE *fp = fopen(temp_name, "w");
+    if (!fp) {
+        perror(temp_name);
+        free(temp_name);
+        return;
+    }
+    __bdd_array__ *measured = __bdd_array_create__();
+    for (size_t i = 0; i < units->size; ++i) {
+        __bdd_node__ *unit = units->values[i];
+        if (unit->timed) {
+            __bdd_array_push__(measured, __bdd_timing_path__(unit));
+            fprintf(fp, "%llu\t%s\n", unit->duration_ns, (char *)__bdd_array_last__(measured));
+        }
+    }
+    // Keep the history of the groups that did not run this time
+    for (size_t i = 0; history && i < history->size; ++i) {
+        __bdd_timing__ *timing = history->values[i];
+        bool was_measured = false;
+        for (size_t m = 0; m < measured->size && !was_measured; ++m) {
+            was_measured = strcmp(measured->values[m], timing->path) == 0;
+        }
+        if (!was_measured && __bdd_timings_find__(history, timing->path) == timing) {
+            fprintf(fp, "%llu\t%s\n", timing->duration_ns, timing->path);
+        }
+    }
+    for (size_t i = 0; i < measured->size; ++i) {
+        free(measured->values[i]);
+    }
+    __bdd_array_free__(measured);
+
+    if (fclose(fp) != 0 || rename(temp_name, file_name) != 0) {
+        perror(file_name);
+    }
+    free(temp_name);
+}
+
+// Per-test coverage of `BDD_COVERAGE_MAP`, read back from the gcov data of
+// a `--coverage` build after every step. The gcov functions are referenced
+// weakly, so that the runtime still links without them.
+#if defined(__GNUC__) && !defined(_WIN32)
+extern void __gcov_reset(void) __attribute__((weak));
+extern void __gcov_dump(void) __attribute__((weak));
+#endif
+
+#define __BDD_GCNO_MAGIC__ 0x67636e6fu
+#define __BDD_GCDA_MAGIC__ 0x67636461u
+#define __BDD_GCOV_TAG_FUNCTION__ 0x01000000u
+#define __BDD_GCOV_TAG_ARCS__ 0x01a10000u
+#define __BDD_GCOV_TAG_OBJECT_SUMMARY__ 0xa1000000u
+
+typedef struct __bdd_line_range__ {
+    char *file;
+    unsigned first;
+    unsigned last;
+} __bdd_line_range__;
+
+// The lines covered by a test, by the hooks of a group or by the spec
+typedef struct __bdd_coverage_entry__ {
+    char *path;
+    __bdd_array__ *ranges;
+} __bdd_coverage_entry__;
+
+typedef struct __bdd_gcov_function__ {
+    uint32_t ident;
+    __bdd_line_range__ range;
+    uint64_t count; // the sum of its counters in the data read last
+} __bdd_gcov_function__;
+
+// The functions of an object file, read from its `.gcno` notes once
+typedef struct __bdd_gcov_object__ {
+    char *name; // the path of the data without the extension
+    __bdd_gcov_function__ *functions;
+    size_t function_count;
+} __bdd_gcov_object__;
+
+typedef struct __bdd_coverage_recorder__ {
+    char *directory; // where the data is dumped to, as the `GCOV_PREFIX`
+    __bdd_node__ *root;
+    __bdd_array__ *objects;
+    __bdd_array__ *entries;
+    __bdd_coverage_entry__ *pending; // the hooks that run before a test
+    __bdd_coverage_entry__ *test;
+} __bdd_coverage_recorder__;
+
+__bdd_coverage_entry__ *__bdd_coverage_entry_create__(char *path) {
+    __bdd_coverage_entry__ *entry = __bdd_malloc__(sizeof(__bdd_coverage_entry__));
+    if (!entry) {
+        perror("malloc(coverage entry)");
+        abort();
+    }
+    entry->path = path; // entry takes ownership of path
+    entry->ranges = __bdd_array_create__();
+    return entry;
+}
+
+// Adjacent and repeated ranges of a file are merged
+void __bdd_line_ranges_add__(__bdd_array__ *ranges, const char *file, unsigned first, unsigned last) {
+    for (size_t i = 0; i < ranges->size; ++i) {
+        __bdd_line_range__ *range = ranges->values[i];
+        if (strcmp(range->file, file) == 0 && first <= range->last + 1 && range->first <= last + 1) {
+            range->first = first < range->first ? first : range->first;
+            range->last = last > range->last ? last : range->last;
+            return;
+        }
+    }
+    __bdd_line_range__ *range = __bdd_malloc__(sizeof(__bdd_line_range__));
+    if (!range) {
+        perror("malloc(line range)");
+        abort();
+    }
+    range->file = __bdd_strdup__(file);
+    range->first = first;
+    range->last = last;
+    __bdd_array_push__(ranges, range);
+}
+
+void __bdd_line_ranges_free__(__bdd_array__ *ranges) {
+    for (size_t i = 0; i < ranges->size; ++i) {
+        __bdd_line_range__ *range = ranges->values[i];
+        free(range->file);
+        free(range);
+    }
+    __bdd_array_free__(ranges);
+}
+
+void __bdd_coverage_entries_free__(__bdd_array__ *entries) {
+    for (size_t i = 0; i < entries->size; ++i) {
+        __bdd_coverage_entry__ *entry = entries->values[i];
+        free(entry->path);
+        __bdd_line_ranges_free__(entry->ranges);
+        free(entry);
+    }
+    __bdd_array_free__(entries);
+}
+
+__bdd_coverage_entry__ *__bdd_coverage_find__(__bdd_array__ *entries, const char *path) {
+    for (size_t i = entries->size; i > 0; --i) {
+        __bdd_coverage_entry__ *entry = entries->values[i - 1];
+        if (strcmp(entry->path, path) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Loads `<node path>\t<file>:<first>-<last>\t...` lines. As with the
+// timing history, the last line of a path wins.
+__bdd_array__ *__bdd_coverage_load__(const char *file_name) {
+    __bdd_array__ *entries = __bdd_array_create__();
+    size_t size = 0;
+    const unsigned char *data = file_name ? __bdd_snapshot_load__(file_name, &size) : NULL;
+    const char *text = (const char *)data;
+    const char *end = text + size;
+    while (text && text < end) {
+        const char *line_end = memchr(text, '\n', (size_t)(end - text));
+        size_t length = line_end ? (size_t)(line_end - text) : (size_t)(end - text);
+        char *line = __bdd_format__("%.*s", (int)length, text);
+        text += length + 1;
+        line[strcspn(line, "\r")] = '\0';
+
+        char *field = strchr(line, '\t');
+        if (field) {
+            *field++ = '\0';
+        }
+        __bdd_coverage_entry__ *entry = __bdd_coverage_entry_create__(__bdd_strdup__(line));
+        while (field) {
+            char *next = strchr(field, '\t');
+            if (next) {
+                *next++ = '\0';
+            }
+            char *numbers = strrchr(field, ':');
+            if (numbers) {
+                *numbers++ = '\0';
+                char *rest = NULL;
+                unsigned first = (unsigned)strtoul(numbers, &rest, 10);
+                unsigned last = *rest == '-' ? (unsigned)strtoul(rest + 1, NULL, 10) : first;
+                __bdd_line_ranges_add__(entry->ranges, field, first, last);
+            }
+            field = next;
+        }
+        __bdd_array_push__(entries, entry);
+        free(line);
+    }
+    if (data) {
+        __bdd_snapshot_unload__(data, size);
+    }
+    return entries;
+}
+
+void __bdd_coverage_save__(const char *file_name, __bdd_array__ *map, __bdd_array__ *recorded) {
+    char *temp_name = __bdd_format__("%s.tmp", file_name);
+    FILE *fp = fopen(temp_name, "w");
+    if (!fp) {
+        perror(temp_name);
+        free(temp_name);
+        return;
+    }
+    for (size_t i = 0; i < recorded->size + map->size; ++i) {
+        bool is_recorded = i < recorded->size;
+        __bdd_coverage_entry__ *entry = is_recorded ? recorded->values[i] : map->values[i - recorded->size];
+        // Keep the coverage of the tests that did not run this time
+        if (!is_recorded && (
+            __bdd_coverage_find__(recorded, entry->path) ||
+            __bdd_coverage_find__(map, entry->path) != entry
+        )) {
+            continue;
+        }
+        fputs(entry->path, fp);
+        for (size_t r = 0; r < entry->ranges->size; ++r) {
+            __bdd_line_range__ *range = entry->ranges->values[r];
+            fprintf(fp, "\t%s:%u-%u", range->file, range->first, range->last);
+        }
+        fputc('\n', fp);
+    }
+    if (fclose(fp) != 0 || rename(temp_name, file_name) != 0) {
+        perror(file_name);
+    }
+    free(temp_name);
+}
+
+// Name of a file in a diff, without the `a/` or `b/` prefix of git
+char *__bdd_change_file__(const char *name) {
+    size_t length = strcspn(name, "\t");
+    if (length == strlen("/dev/null") && strncmp(name, "/dev/null", length) == 0) {
+        return NULL;
+    }
+    if ((name[0] == 'a' || name[0] == 'b') && name[1] == '/') {
+        name += 2;
+        length -= 2;
+    }
+    return __bdd_format__("%.*s", (int)length, name);
+}
+
+// Reads the changed lines from a unified diff, such as the output of
+// `git diff`, or from `<file>`, `<file>:<line>` and `<file>:<first>-<last>`
+// lines. The lines are the ones before the change, like in the map.
+// Returns NULL if the file cannot be read.
+__bdd_array__ *__bdd_changes_load__(const char *file_name) {
+    size_t size = 0;
+    const unsigned char *data = __bdd_snapshot_load__(file_name, &size);
+    if (!data) {
+        return NULL;
+    }
+    __bdd_array__ *changes = __bdd_array_create__();
+    char *file = NULL;
+    bool is_diff = false;
+    unsigned old_line = 0, old_left = 0, new_left = 0;
+    const char *text = (const char *)data;
+    const char *end = text + size;
+    while (text < end) {
+        const char *line_end = memchr(text, '\n', (size_t)(end - text));
+        size_t length = line_end ? (size_t)(line_end - text) : (size_t)(end - text);
+        char *line = __bdd_format__("%.*s", (int)length, text);
+        text += length + 1;
+        line[strcspn(line, "\r")] = '\0';
+
+        if (old_left || new_left) {
+            if (line[0] == ' ' || line[0] == '\0') {
+                ++old_line;
+                old_left -= old_left > 0;
+                new_left -= new_left > 0;
+            } else if (line[0] == '-') {
+                __bdd_line_ranges_add__(changes, file, old_line, old_line);
+                ++old_line;
+                old_left -= old_left > 0;
+            } else if (line[0] == '+') {
+                // An added line touches the code on both sides of it
+                __bdd_line_ranges_add__(changes, file, old_line > 1 ? old_line - 1 : 1, old_line);
+                new_left -= new_left > 0;
+            }
+        } else if (strncmp(line, "diff ", 5) == 0) {
+            is_diff = true;
+        } else if (strncmp(line, "--- ", 4) == 0) {
+            is_diff = true;
+            free(file);
+            file = __bdd_change_file__(line + 4);
+        } else if (strncmp(line, "+++ ", 4) == 0) {
+            if (!file) {
+                file = __bdd_change_file__(line + 4);
+            }
+        } else if (strncmp(line, "@@ -", 4) == 0 && file) {
+            char *rest = NULL;
+            unsigned first = (unsigned)strtoul(line + 4, &rest, 10);
+            old_left = *rest == ',' ? (unsigned)strtoul(rest + 1, &rest, 10) : 1;
+            char *added = strstr(rest, " +");
+            new_left = 1;
+            if (added) {
+                strtoul(added + 2, &rest, 10);
+                new_left = *rest == ',' ? (unsigned)strtoul(rest + 1, NULL, 10) : 1;
+            }
+            // A hunk that only adds lines starts at the line before them
+            old_line = old_left ? first : first + 1;
+        } else if (!is_diff && line[0]) {
+            char *numbers = strrchr(line, ':');
+            unsigned first = 1, last = (unsigned)-1;
+            if (numbers && numbers[1] >= '0' && numbers[1] <= '9') {
+                *numbers++ = '\0';
+                char *rest = NULL;
+                first = (unsigned)strtoul(numbers, &rest, 10);
+                last = *rest == '-' ? (unsigned)strtoul(rest + 1, NULL, 10) : first;
+            }
+            __bdd_line_ranges_add__(changes, line, first, last);
+        }
+        free(line);
+    }
+    free(file);
+    __bdd_snapshot_unload__(data, size);
+    return changes;
+}
+
+// The recorded files are absolute, while the changes are
+// usually relative to the root of the repository
+bool __bdd_coverage_same_file__(const char *recorded, const char *changed) {
+    while (changed[0] == '.' && changed[1] == '/') {
+        changed += 2;
+    }
+    size_t recorded_length = strlen(recorded);
+    size_t changed_length = strlen(changed);
+    if (changed_length > recorded_length) {
+        return false;
+    }
+    size_t start = recorded_length - changed_length;
+    return strcmp(recorded + start, changed) == 0 && (start == 0 || recorded[start - 1] == '/');
+}
+
+bool __bdd_coverage_touches__(__bdd_coverage_entry__ *entry, __bdd_array__ *changes) {
+    for (size_t i = 0; i < entry->ranges->size; ++i) {
+        __bdd_line_range__ *range = entry->ranges->values[i];
+        for (size_t c = 0; c < changes->size; ++c) {
+            __bdd_line_range__ *change = changes->values[c];
+            if (
+                change->first <= range->last && range->first <= change->last &&
+                __bdd_coverage_same_file__(range->file, change->file)
+            ) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Excludes the tests that covered none of the changes, unless the hooks of
+// one of their groups did. Tests that are not in the map yet always run.
+void __bdd_coverage_select__(__bdd_node__ *node, __bdd_array__ *map, __bdd_array__ *changes, bool touched) {
+    char *path = __bdd_timing_path__(node);
+    __bdd_coverage_entry__ *entry = __bdd_coverage_find__(map, path);
+    free(path);
+    touched = touched || (entry && __bdd_coverage_touches__(entry, changes));
+    if (__bdd_node_is_leaf__(node)) {
+        if (entry && !touched) {
+            node->excluded = true;
+        }
+        return;
+    }
+    for (size_t i = 0; i < node->list_children->size; ++i) {
+        __bdd_coverage_select__(node->list_children->values[i], map, changes, touched);
+    }
+}
+
+#if defined(__GNUC__) && !defined(_WIN32)
+typedef struct __bdd_gcov_reader__ {
+    const unsigned char *data;
+    size_t size;
+    size_t offset;
+} __bdd_gcov_reader__;
+
+uint32_t __bdd_gcov_word__(__bdd_gcov_reader__ *reader) {
+    uint32_t word = 0;
+    if (reader->size - reader->offset < sizeof(word)) {
+        reader->offset = reader->size;
+        return 0;
+    }
+    memcpy(&word, reader->data + reader->offset, sizeof(word));
+    reader->offset += sizeof(word);
+    return word;
+}
+
+// Strings are prefixed with their length, including the terminating zero
+const char *__bdd_gcov_string__(__bdd_gcov_reader__ *reader) {
+    uint32_t length = __bdd_gcov_word__(reader);
+    if (length == 0 || reader->size - reader->offset < length) {
+        reader->offset = reader->size;
+        return "";
+    }
+    const char *string = (const char *)reader->data + reader->offset;
+    reader->offset += length;
+    return string[length - 1] == '\0' ? string : "";
+}
+
+// Only the format of GCC 12 and newer is read, where the lengths are in bytes
+bool __bdd_gcov_header__(__bdd_gcov_reader__ *reader, uint32_t magic) {
+    if (__bdd_gcov_word__(reader) != magic) {
+        return false;
+    }
+    uint32_t version = __bdd_gcov_word__(reader);
+    int major = ((int)(version >> 24) - 'A') * 10 + (int)((version >> 16) & 0xff) - '0';
+    __bdd_gcov_word__(reader); // stamp
+    __bdd_gcov_word__(reader); // checksum
+    return major >= 12;
+}
+
+int __bdd_compare_gcov_functions__(const void *a, const void *b) {
+    const __bdd_gcov_function__ *left = a, *right = b;
+    return left->ident < right->ident ? -1 : left->ident > right->ident;
+}
+
+__bdd_gcov_object__ *__bdd_gcov_object_load__(const char *name) {
+    __bdd_gcov_object__ *object = __bdd_calloc__(1, sizeof(__bdd_gcov_object__));
+    if (!object) {
+        perror("calloc(gcov object)");
+        abort();
+    }
+    object->name = __bdd_strdup__(name);
+
+    char *path = __bdd_format__("%s.gcno", name);
+    __bdd_gcov_reader__ reader = { NULL, 0, 0 };
+    reader.data = __bdd_snapshot_load__(path, &reader.size);
+    if (!reader.data || !__bdd_gcov_header__(&reader, __BDD_GCNO_MAGIC__)) {
+        fprintf(stderr, "%s is missing or was not written by GCC 12 or newer\n", path);
+    } else {
+        const char *directory = __bdd_gcov_string__(&reader);
+        __bdd_gcov_word__(&reader); // whether there are unexecuted blocks
+        size_t capacity = 0;
+        while (reader.offset < reader.size) {
+            uint32_t tag = __bdd_gcov_word__(&reader);
+            uint32_t length = __bdd_gcov_word__(&reader);
+            size_t end = reader.size - reader.offset < length ? reader.size : reader.offset + length;
+            if (tag == __BDD_GCOV_TAG_FUNCTION__) {
+                if (object->function_count == capacity) {
+                    capacity = capacity ? capacity * 2 : 64;
+                    object->functions = __bdd_realloc__(object->functions, capacity * sizeof(__bdd_gcov_function__));
+                    if (!object->functions) {
+                        perror("realloc(gcov functions)");
+                        abort();
+                    }
+                }
+                __bdd_gcov_function__ *function = &object->functions[object->function_count++];
+                function->ident = __bdd_gcov_word__(&reader);
+                function->count = 0;
+                __bdd_gcov_word__(&reader); // lineno_checksum
+                __bdd_gcov_word__(&reader); // cfg_checksum
+                __bdd_gcov_string__(&reader); // name
+                __bdd_gcov_word__(&reader); // artificial
+                const char *source = __bdd_gcov_string__(&reader);
+                function->range.first = __bdd_gcov_word__(&reader);
+                __bdd_gcov_word__(&reader); // start_column
+                function->range.last = __bdd_gcov_word__(&reader);
+                function->range.file = source[0] == '/' || !directory[0] ?
+                    __bdd_strdup__(source) :
+                    __bdd_format__("%s/%s", directory, source);
+            }
+            reader.offset = end;
+        }
+        qsort(object->functions, object->function_count, sizeof(__bdd_gcov_function__), __bdd_compare_gcov_functions__);
+    }
+    if (reader.data) {
+        __bdd_snapshot_unload__(reader.data, reader.size);
+    }
+    free(path);
+    return object;
+}
+
+// Adds the functions whose counters grew since the data was read last time
+void __bdd_gcov_read__(__bdd_coverage_recorder__ *recorder, const char *path, __bdd_coverage_entry__ *entry) {
+    size_t length = strlen(path) - strlen(recorder->directory) - strlen(".gcda");
+    char *name = __bdd_format__("%.*s", (int)length, path + strlen(recorder->directory));
+    __bdd_gcov_object__ *object = NULL;
+    for (size_t i = 0; i < recorder->objects->size && !object; ++i) {
+        __bdd_gcov_object__ *candidate = recorder->objects->values[i];
+        object = strcmp(candidate->name, name) == 0 ? candidate : NULL;
+    }
+    if (!object) {
+        object = __bdd_gcov_object_load__(name);
+        __bdd_array_push__(recorder->objects, object);
+    }
+    free(name);
+
+    __bdd_gcov_reader__ reader = { NULL, 0, 0 };
+    reader.data = __bdd_snapshot_load__(path, &reader.size);
+    if (!reader.data || !__bdd_gcov_header__(&reader, __BDD_GCDA_MAGIC__)) {
+        if (reader.data) {
+            __bdd_snapshot_unload__(reader.data, reader.size);
+        }
+        return;
+    }
+    __bdd_gcov_function__ *function = NULL;
+    while (reader.offset < reader.size) {
+        uint32_t tag = __bdd_gcov_word__(&reader);
+        // Counters that are all zero have a negative length and no values
+        int32_t length = (int32_t)__bdd_gcov_word__(&reader);
+        size_t size = length < 0 ? 0 : (size_t)length;
+        size_t end = reader.size - reader.offset < size ? reader.size : reader.offset + size;
+        if (tag == __BDD_GCOV_TAG_FUNCTION__) {
+            __bdd_gcov_function__ key;
+            key.ident = __bdd_gcov_word__(&reader);
+            function = length > 0 ? bsearch(
+                &key, object->functions, object->function_count,
+                sizeof(__bdd_gcov_function__), __bdd_compare_gcov_functions__
+            ) : NULL;
+        } else if (tag == __BDD_GCOV_TAG_ARCS__ && function) {
+            uint64_t count = 0;
+            while (reader.offset + 8 <= end) {
+                uint32_t low = __bdd_gcov_word__(&reader);
+                count += low | (uint64_t)__bdd_gcov_word__(&reader) << 32;
+            }
+            if (count > function->count) {
+                function->count = count;
+                __bdd_line_ranges_add__(entry->ranges, function->range.file, function->range.first, function->range.last);
+            }
+        }
+        reader.offset = end;
+    }
+    __bdd_snapshot_unload__(reader.data, reader.size);
+}
+
+// The counters of a function in the data that the steps are added to
+typedef struct __bdd_gcov_counters__ {
+    uint32_t ident;
+    size_t offset;
+    size_t size;
+} __bdd_gcov_counters__;
+
+int __bdd_compare_gcov_counters__(const void *a, const void *b) {
+    const __bdd_gcov_counters__ *left = a, *right = b;
+    return left->ident < right->ident ? -1 : left->ident > right->ident;
+}
+
+// Adds the counters of the steps to the data where gcov would have dumped
+// them at exit, locked the way gcov locks it, so that the run still counts
+// in the usual coverage reports. The data of a different build is replaced.
+void __bdd_gcov_merge__(const char *from, const char *into) {
+    __bdd_gcov_reader__ source = { NULL, 0, 0 };
+    source.data = __bdd_snapshot_load__(from, &source.size);
+    if (!source.data) {
+        return;
+    }
+    int fd = open(into, O_RDWR | O_CREAT, 0666);
+    if (fd < 0 && errno == ENOENT) {
+        // gcov creates the directories of `GCOV_PREFIX` too
+        char *directory = __bdd_strdup__(into);
+        for (char *slash = strchr(directory + 1, '/'); slash; slash = strchr(slash + 1, '/')) {
+            *slash = '\0';
+            mkdir(directory, 0777);
+            *slash = '/';
+        }
+        free(directory);
+        fd = open(into, O_RDWR | O_CREAT, 0666);
+    }
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    struct stat info;
+    if (fd < 0 || fcntl(fd, F_SETLKW, &lock) != 0 || fstat(fd, &info) != 0) {
+        perror(into);
+        if (fd >= 0) {
+            close(fd);
+        }
+        __bdd_snapshot_unload__(source.data, source.size);
+        return;
+    }
+    // Read through the locked descriptor, closing another one would unlock it
+    __bdd_gcov_reader__ target = { NULL, 0, 0 };
+    unsigned char *target_data = __bdd_malloc__((size_t)info.st_size + 1);
+    if (!target_data) {
+        perror("malloc(gcov data)");
+        abort();
+    }
+    while (target.size < (size_t)info.st_size) {
+        ssize_t count = read(fd, target_data + target.size, (size_t)info.st_size - target.size);
+        if (count <= 0) {
+            break;
+        }
+        target.size += (size_t)count;
+    }
+    target.data = target_data;
+
+    // The magic, the version, the stamp and the checksum have to match
+    bool is_same_build = target.size >= 16 && source.size >= 16 && memcmp(target.data, source.data, 16) == 0;
+    uint32_t runs = 0, sum_max = 0;
+    __bdd_gcov_counters__ *counters = NULL;
+    size_t counter_count = 0, capacity = 0;
+    target.offset = 16;
+    uint32_t ident = 0;
+    while (is_same_build && target.offset < target.size) {
+        uint32_t tag = __bdd_gcov_word__(&target);
+        int32_t length = (int32_t)__bdd_gcov_word__(&target);
+        size_t size = length < 0 ? 0 : (size_t)length;
+        size_t start = target.offset;
+        if (tag == __BDD_GCOV_TAG_OBJECT_SUMMARY__) {
+            runs = __bdd_gcov_word__(&target);
+            sum_max = __bdd_gcov_word__(&target);
+        } else if (tag == __BDD_GCOV_TAG_FUNCTION__) {
+            ident = __bdd_gcov_word__(&target);
+        } else if (tag == __BDD_GCOV_TAG_ARCS__ && size && start + size <= target.size) {
+            if (counter_count == capacity) {
+                capacity = capacity ? capacity * 2 : 64;
+                counters = __bdd_realloc__(counters, capacity * sizeof(__bdd_gcov_counters__));
+                if (!counters) {
+                    perror("realloc(gcov counters)");
+                    abort();
+                }
+            }
+            counters[counter_count++] = (__bdd_gcov_counters__){ ident, start, size };
+        }
+        target.offset = start + size;
+    }
+    if (counter_count) {
+        qsort(counters, counter_count, sizeof(__bdd_gcov_counters__), __bdd_compare_gcov_counters__);
+    }
+
+    // Counters that are all zero have no values, but the merged ones can
+    size_t merged_capacity = source.size;
+    for (source.offset = 16; source.offset + 8 <= source.size;) {
+        __bdd_gcov_word__(&source);
+        int32_t length = (int32_t)__bdd_gcov_word__(&source);
+        merged_capacity += length < 0 ? (size_t)-(int64_t)length : 0;
+        source.offset += length < 0 ? 0 : (size_t)length;
+    }
+    unsigned char *merged = __bdd_malloc__(merged_capacity);
+    if (!merged) {
+        perror("malloc(gcov data)");
+        abort();
+    }
+    size_t merged_size = source.size < 16 ? source.size : 16;
+    memcpy(merged, source.data, merged_size);
+    // The records are copied with their counters added
+    for (source.offset = merged_size; source.offset + 8 <= source.size;) {
+        uint32_t tag = __bdd_gcov_word__(&source);
+        int32_t length = (int32_t)__bdd_gcov_word__(&source);
+        size_t size = length < 0 ? (size_t)-(int64_t)length : (size_t)length;
+        size_t start = source.offset;
+        if (length >= 0 && start + size > source.size) {
+            break;
+        }
+        uint32_t words[2] = { tag, (uint32_t)size };
+        memcpy(merged + merged_size, words, sizeof(words));
+        merged_size += sizeof(words);
+        unsigned char *values = merged + merged_size;
+        if (length < 0) {
+            memset(values, 0, size);
+        } else {
+            memcpy(values, source.data + start, size);
+            source.offset = start + size;
+        }
+        merged_size += size;
+        if (tag == __BDD_GCOV_TAG_OBJECT_SUMMARY__ && size >= 8) {
+            uint32_t summary[2];
+            memcpy(summary, values, sizeof(summary));
+            summary[0] += runs;
+            summary[1] = summary[1] > sum_max ? summary[1] : sum_max;
+            memcpy(values, summary, sizeof(summary));
+        } else if (tag == __BDD_GCOV_TAG_FUNCTION__ && size >= 4) {
+            memcpy(&ident, values, sizeof(ident));
+        } else if (tag == __BDD_GCOV_TAG_ARCS__) {
+            __bdd_gcov_counters__ key = { ident, 0, 0 };
+            __bdd_gcov_counters__ *found = counter_count ? bsearch(
+                &key, counters, counter_count, sizeof(__bdd_gcov_counters__), __bdd_compare_gcov_counters__
+            ) : NULL;
+            for (size_t i = 0; found && found->size == size && i + 8 <= size; i += 8) {
+                uint32_t mine[2], theirs[2];
+                memcpy(mine, values + i, sizeof(mine));
+                memcpy(theirs, target.data + found->offset + i, sizeof(theirs));
+                uint64_t sum = (mine[0] | (uint64_t)mine[1] << 32) + (theirs[0] | (uint64_t)theirs[1] << 32);
+                mine[0] = (uint32_t)sum;
+                mine[1] = (uint32_t)(sum >> 32);
+                memcpy(values + i, mine, sizeof(mine));
+            }
+        }
+    }
+    // The word that terminates the data
+    memcpy(merged + merged_size, source.data + source.offset, source.size - source.offset);
+    merged_size += source.size - source.offset;
+
+    if (ftruncate(fd, 0) != 0 || pwrite(fd, merged, merged_size, 0) != (ssize_t)merged_size) {
+        perror(into);
+    }
+    close(fd);
+    free(merged);
+    free(counters);
+    free(target_data);
+    __bdd_snapshot_unload__(source.data, source.size);
+}
+
+// Where gcov dumps the data of an object at exit, with the directories of
+// `GCOV_PREFIX_STRIP` taken off the path and `GCOV_PREFIX` put in front of it
+char *__bdd_gcov_data_path__(const char *name) {
+    const char *prefix = getenv("GCOV_PREFIX");
+    const char *strip_env = getenv("GCOV_PREFIX_STRIP");
+    int strip = strip_env ? atoi(strip_env) : 0;
+    if (strip > 0 && !(prefix && *prefix)) {
+        prefix = ".";
+    }
+    for (const char *probe = name; *probe && strip > 0; ++probe) {
+        if (*probe == '/') {
+            name = probe;
+            --strip;
+        }
+    }
+    return __bdd_format__("%s%s", prefix ? prefix : "", name);
+}
+
+// Reads the data of the steps dumped so far, which gcov adds up in the
+// files. Without an entry the data is added to the files where gcov dumps
+// it at exit instead, and removed with the directories.
+void __bdd_gcov_collect__(__bdd_coverage_recorder__ *recorder, const char *directory, __bdd_coverage_entry__ *entry) {
+    DIR *dir = opendir(directory);
+    if (!dir) {
+        return;
+    }
+    struct dirent *item;
+    while ((item = readdir(dir)) != NULL) {
+        if (strcmp(item->d_name, ".") == 0 || strcmp(item->d_name, "..") == 0) {
+            continue;
+        }
+        char *path = __bdd_format__("%s/%s", directory, item->d_name);
+        struct stat info;
+        size_t length = strlen(path);
+        if (lstat(path, &info) == 0 && S_ISDIR(info.st_mode)) {
+            __bdd_gcov_collect__(recorder, path, entry);
+            if (!entry) {
+                rmdir(path);
+            }
+        } else {
+            bool is_data = length > strlen(".gcda") && strcmp(path + length - strlen(".gcda"), ".gcda") == 0;
+            if (entry && is_data) {
+                __bdd_gcov_read__(recorder, path, entry);
+            } else if (is_data) {
+                char *data_path = __bdd_gcov_data_path__(path + strlen(recorder->directory));
+                __bdd_gcov_merge__(path, data_path);
+                free(data_path);
+            }
+            if (!entry) {
+                remove(path);
+            }
+        }
+        free(path);
+    }
+    closedir(dir);
+}
+#endif
+
+// Returns NULL without the gcov runtime, that is linked in with
+// `--coverage -Wl,-u,__gcov_dump,-u,__gcov_reset`
+__bdd_coverage_recorder__ *__bdd_coverage_recorder_create__(__bdd_node__ *root, const char *temp_directory) {
+#if defined(__GNUC__) && !defined(_WIN32)
+    if (!__gcov_reset || !__gcov_dump) {
+        return NULL;
+    }
+    char *directory = __bdd_format__("%s/bdd-coverage-XXXXXX", temp_directory ? temp_directory : "/tmp");
+    if (!mkdtemp(directory)) {
+        perror(directory);
+        free(directory);
+        return NULL;
+    }
+    __bdd_coverage_recorder__ *recorder = __bdd_calloc__(1, sizeof(__bdd_coverage_recorder__));
+    if (!recorder) {
+        perror("calloc(coverage)");
+        abort();
+    }
+    recorder->directory = directory;
+    recorder->root = root;
+    recorder->objects = __bdd_array_create__();
+    recorder->entries = __bdd_array_create__();
+    recorder->pending = __bdd_coverage_entry_create__(__bdd_strdup__(""));
+    return recorder;
+#else
+    (void)root;
+    (void)temp_directory;
+    return NULL;
+#endif
+}
+
+void __bdd_coverage_step_started__(__bdd_coverage_recorder__ *recorder) {
+    (void)recorder;
+#if defined(__GNUC__) && !defined(_WIN32)
+    __gcov_reset();
+#endif
+}
+
+__bdd_coverage_entry__ *__bdd_coverage_recorded__(__bdd_coverage_recorder__ *recorder, __bdd_node__ *node) {
+    char *path = __bdd_timing_path__(node);
+    __bdd_coverage_entry__ *entry = __bdd_coverage_find__(recorder->entries, path);
+    if (entry) {
+        free(path);
+        return entry;
+    }
+    entry = __bdd_coverage_entry_create__(path);
+    __bdd_array_push__(recorder->entries, entry);
+    return entry;
+}
+
+// The steps of a test, with its `before_each` and `after_each` hooks, are
+// attributed to the test. Groups and their `before` and `after` hooks are
+// attributed to the group, so that a change to them runs all of its tests.
+void __bdd_coverage_step_finished__(
+    __bdd_coverage_recorder__ *recorder,
+    __bdd_config_type__ *config,
+    __bdd_test_step__ *step
+) {
+#if defined(__GNUC__) && !defined(_WIN32)
+    __bdd_node__ *node = step->id < 0 ? recorder->root : config->nodes->values[step->id];
+    __bdd_coverage_entry__ *entry = NULL;
+    if (step->type == __BDD_NODE_GROUP__) {
+        entry = __bdd_coverage_recorded__(recorder, node);
+    } else if (step->type == __BDD_NODE_TEST__ && (step->flags & __bdd_node_flags_skip__)) {
+        // A skipped test is left out of the map, to run once it is enabled
+        entry = recorder->test = recorder->pending;
+    } else if (step->type == __BDD_NODE_TEST__) {
+        entry = recorder->test = __bdd_coverage_recorded__(recorder, node);
+        __bdd_array__ *pending = recorder->pending->ranges;
+        for (size_t i = 0; i < pending->size; ++i) {
+            __bdd_line_range__ *range = pending->values[i];
+            __bdd_line_ranges_add__(entry->ranges, range->file, range->first, range->last);
+        }
+    } else if (__bdd_node_is_group_hook__(node)) {
+        entry = __bdd_coverage_recorded__(recorder, node->parent);
     } else {
-        config->id = node->next_node_id;
+        entry = recorder->test ? recorder->test : recorder->pending;
     }
-#if defined(BDD_PRINT_TRACE)
-    const char *color = config->use_color ? __BDD_COLOR_MAGENTA__ : "";
-    fprintf(stderr, "%s% 3d ", color, step->id);
-    __bdd_indent__(stderr, config->node_stack->size - 1 - (int)should_enter);
-    const char *reset = config->use_color ? __BDD_COLOR_RESET__ : "";
-    fprintf(stderr,
-        "%s [%d, %d) %s%s\n",
-        should_enter ? ">" : "|",
-        node->id,
-        node->next_node_id,
-        node->name,
-        reset);
+
+    // The paths are not stripped, to find the notes next to the data
+    const char *prefix = getenv("GCOV_PREFIX");
+    const char *strip = getenv("GCOV_PREFIX_STRIP");
+    char *previous_prefix = prefix ? __bdd_strdup__(prefix) : NULL;
+    char *previous_strip = strip ? __bdd_strdup__(strip) : NULL;
+    setenv("GCOV_PREFIX", recorder->directory, 1);
+    unsetenv("GCOV_PREFIX_STRIP");
+    __gcov_dump();
+    if (previous_prefix) {
+        setenv("GCOV_PREFIX", previous_prefix, 1);
+    } else {
+        unsetenv("GCOV_PREFIX");
+    }
+    if (previous_strip) {
+        setenv("GCOV_PREFIX_STRIP", previous_strip, 1);
+    }
+    free(previous_prefix);
+    free(previous_strip);
+    __bdd_gcov_collect__(recorder, recorder->directory, entry);
+
+    if (step->ends_test) {
+        recorder->test = NULL;
+        __bdd_line_ranges_free__(recorder->pending->ranges);
+        recorder->pending->ranges = __bdd_array_create__();
+    }
+#else
+    (void)recorder;
+    (void)config;
+    (void)step;
 #endif
-    return should_enter;
 }
 
-void __bdd_exit_node__(__bdd_config_type__ *config) {
-    __bdd_node__ *top = __bdd_array_pop__(config->node_stack);
-    if (config->run == __BDD_INIT_RUN__) {
-        top->next_node_id = config->id;
+void __bdd_coverage_recorder_free__(__bdd_coverage_recorder__ *recorder) {
+#if defined(__GNUC__) && !defined(_WIN32)
+    __bdd_gcov_collect__(recorder, recorder->directory, NULL);
+    rmdir(recorder->directory);
+#endif
+    for (size_t i = 0; i < recorder->objects->size; ++i) {
+        __bdd_gcov_object__ *object = recorder->objects->values[i];
+        for (size_t f = 0; f < object->function_count; ++f) {
+            free(object->functions[f].range.file);
+        }
+        free(object->functions);
+        free(object->name);
+        free(object);
+    }
+    __bdd_array_free__(recorder->objects);
+    __bdd_coverage_entries_free__(recorder->entries);
+    free(recorder->pending->path);
+    __bdd_line_ranges_free__(recorder->pending->ranges);
+    free(recorder->pending);
+    free(recorder->directory);
+    free(recorder);
+}
+
+// Charges the time of a step to the unit of scheduling it belongs to. The
+// `before_each` hooks wait in `pending_ns` until their test runs. Groups that
+// only contain other groups are shared by the units in them, so their own
+// steps are not charged to any of them.
+void __bdd_timing_charge__(
+    __bdd_config_type__ *config,
+    __bdd_node__ *root,
+    __bdd_test_step__ *step,
+    unsigned long long elapsed_ns,
+    __bdd_node__ **test,
+    unsigned long long *pending_ns
+) {
+    __bdd_node__ *node = step->id < 0 ? root : config->nodes->values[step->id];
+    __bdd_node__ *unit = NULL;
+    if (step->type == __BDD_NODE_TEST__) {
+        *test = node;
+        unit = node->parent;
+        unit->timed |= !(step->flags & __bdd_node_flags_skip__);
+        elapsed_ns += *pending_ns;
+        *pending_ns = 0;
+    } else if (step->type == __BDD_NODE_GROUP__) {
+        unit = node;
+    } else if (__bdd_node_is_group_hook__(node)) {
+        unit = node->parent;
+    } else if (*test) {
+        unit = (*test)->parent;
+    } else {
+        *pending_ns += elapsed_ns;
+    }
+    if (unit && __bdd_unit_test_count__(unit) > 0) {
+        unit->duration_ns += elapsed_ns;
+    }
+    if (step->ends_test) {
+        *test = NULL;
+    }
+}
+
+int __bdd_compare_durations__(const void *a, const void *b) {
+    unsigned long long x = *(const unsigned long long *)a;
+    unsigned long long y = *(const unsigned long long *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Tests that both passed and failed are flaky rather than broken
+void __bdd_repeat_report__(__bdd_config_type__ *config, size_t rounds) {
+    const char *prefix = config->use_tap ? "# " : "";
+    fprintf(config->output, "\n%sRepeated %zu time%s:\n", prefix, rounds, rounds == 1 ? "" : "s");
+    for (size_t i = 0; i < config->nodes->size; ++i) {
+        __bdd_node__ *node = config->nodes->values[i];
+        __bdd_repeat_stats__ *stats = node->repeat;
+        if (!stats) {
+            continue;
+        }
+        size_t count = stats->passed + stats->failed;
+        qsort(stats->durations, count, sizeof(unsigned long long), __bdd_compare_durations__);
+        char min[32], median[32], max[32];
+        char *path = __bdd_node_path__(node, " / ");
+        fprintf(
+            config->output, "%s  %s: %zu passed, %zu failed%s, min %s, median %s, max %s\n",
+            prefix, path, stats->passed, stats->failed,
+            stats->passed && stats->failed ? " (flaky)" : "",
+            __bdd_format_duration__(min, sizeof(min), (double)stats->durations[0]),
+            __bdd_format_duration__(median, sizeof(median), (double)stats->durations[count / 2]),
+            __bdd_format_duration__(max, sizeof(max), (double)stats->durations[count - 1])
+        );
+        free(path);
+    }
+}
+
+void __bdd_stats_print__(__bdd_config_type__ *config) {
+    const char *prefix = config->use_tap ? "# " : "";
+    char discovery[32], flatten[32], execution[32], body[32], framework[32];
+    __bdd_stats_type__ *stats = &__bdd_stats__;
+    unsigned long long body_ns = stats->body_ns < stats->execution_ns ? stats->body_ns : stats->execution_ns;
+    fprintf(config->output, "\n%sFramework statistics:\n", prefix);
+    fprintf(
+        config->output, "%s  enter_node: %llu during discovery, %llu during tests (%llu entered, %llu skipped)\n",
+        prefix, stats->discovery_enters, stats->test_enters, stats->entered, stats->skipped
+    );
+    fprintf(config->output, "%s  spec runs: 1 discovery, %llu re-entries\n", prefix, stats->test_main_calls - 1);
+    fprintf(
+        config->output, "%s  formatting: %llu strings, %llu bytes\n", prefix, stats->format_calls, stats->formatted_bytes
+    );
+    fprintf(config->output, "%s  allocations: %llu\n", prefix, stats->allocations);
+    char high_water[32];
+    fprintf(
+        config->output, "%s  scratch memory: %llu allocations, high water %s\n",
+        prefix, config->arena->allocations, __bdd_format_bytes__(
+            high_water, sizeof(high_water),
+            (double)(config->arena->allocated > config->arena->high_water ? config->arena->allocated : config->arena->high_water)
+        )
+    );
+    fprintf(
+        config->output, "%s  time: discovery %s, planning %s, execution %s (user code %s, framework %s)\n",
+        prefix,
+        __bdd_format_duration__(discovery, sizeof(discovery), (double)stats->discovery_ns),
+        __bdd_format_duration__(flatten, sizeof(flatten), (double)stats->flatten_ns),
+        __bdd_format_duration__(execution, sizeof(execution), (double)stats->execution_ns),
+        __bdd_format_duration__(body, sizeof(body), (double)body_ns),
+        __bdd_format_duration__(framework, sizeof(framework), (double)(stats->execution_ns - body_ns))
+    );
+}
+
+__bdd_array__ *__bdd_watch_load__(const char *file_name) {
+    FILE *fp = fopen(file_name, "r");
+    if (!fp) {
+        return NULL;
+    }
+    __bdd_array__ *entries = __bdd_array_create__();
+    char line[4096];
+    while (fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        if ((line[0] != 'F' && line[0] != 'P') || line[1] != '\t') {
+            continue;
+        }
+        __bdd_watch_entry__ *entry = __bdd_calloc__(1, sizeof(__bdd_watch_entry__));
+        if (!entry) {
+            perror("calloc(watch)");
+            abort();
+        }
+        entry->path = __bdd_strdup__(line + 2);
+        entry->failed = line[0] == 'F';
+        __bdd_array_push__(entries, entry);
+    }
+    fclose(fp);
+    qsort(entries->values, entries->size, sizeof(void *), __bdd_compare_watch_entries__);
+    return entries;
+}
+
+void __bdd_watch_save__(const char *file_name, __bdd_array__ *entries) {
+    FILE *fp = fopen(file_name, "w");
+    if (!fp) {
+        perror(file_name);
+        return;
+    }
+    for (size_t i = 0; i < entries->size; ++i) {
+        __bdd_watch_entry__ *entry = entries->values[i];
+        fprintf(fp, "%c\t%s\n", entry->failed ? 'F' : 'P', entry->path);
+    }
+    if (fclose(fp) != 0) {
+        perror(file_name);
+    }
+}
+
+void __bdd_watch_free__(__bdd_array__ *entries) {
+    for (size_t i = 0; entries && i < entries->size; ++i) {
+        __bdd_watch_entry__ *entry = entries->values[i];
+        free(entry->path);
+        free(entry);
+    }
+    if (entries) {
+        __bdd_array_free__(entries);
+    }
+}
+
+// Creates the file that passes the statuses on to the rebuilt executable.
+// It is unlinked right away and reached through its descriptor, which stays
+// open across `exec`, so it is private and nothing is left behind on exit.
+char *__bdd_watch_state_create__(const char *temp_directory) {
+#ifdef __linux__
+    char *path = __bdd_format__("%s/bdd-watch-XXXXXX", temp_directory && *temp_directory ? temp_directory : "/tmp");
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror(path);
+        free(path);
+        return NULL;
+    }
+    unlink(path);
+    free(path);
+    char *state = __bdd_format__("/proc/self/fd/%d", fd);
+    setenv("BDD_WATCH_STATE", state, 1);
+    return state;
+#else
+    // The executable is not restarted anywhere else, so there is nothing to pass on
+    (void)temp_directory;
+    return NULL;
+#endif
+}
+
+// Plans the tests that failed before the rebuild first and then the rest,
+// each part with the hooks of its groups, by excluding the other part.
+void __bdd_watch_plan__(__bdd_config_type__ *config, __bdd_node__ *root, __bdd_array__ *steps) {
+    size_t count = config->nodes->size;
+    bool *excluded = __bdd_calloc__(count ? count : 1, sizeof(bool));
+    bool *failed = __bdd_calloc__(count ? count : 1, sizeof(bool));
+    if (!excluded || !failed) {
+        perror("calloc(watch)");
+        abort();
+    }
+    for (size_t i = 0; i < count; ++i) {
+        __bdd_node__ *node = config->nodes->values[i];
+        excluded[i] = node->excluded;
+        if (node->type == __BDD_NODE_TEST__) {
+            char *path = __bdd_timing_path__(node);
+            __bdd_watch_entry__ *entry = __bdd_watch_find__(config->watch_previous, path);
+            failed[i] = entry && entry->failed;
+            free(path);
+        }
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t i = 0; i < count; ++i) {
+            __bdd_node__ *node = config->nodes->values[i];
+            if (__bdd_node_is_leaf__(node)) {
+                node->excluded = excluded[i] || failed[i] != (pass == 0);
+            }
+        }
+        __bdd_node_prune__(root);
+        __bdd_node_flatten__(config, root, steps);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        __bdd_node__ *node = config->nodes->values[i];
+        if (__bdd_node_is_leaf__(node)) {
+            node->excluded = excluded[i];
+        }
+    }
+    __bdd_node_prune__(root);
+    free(excluded);
+    free(failed);
+}
+
+// Waits for the executable to be rebuilt and replaces the process with
+// the new one. Only returns if watching or executing is not possible.
+void __bdd_watch_wait__() {
+#ifdef __linux__
+    char exe[4096];
+    ssize_t length = readlink("/proc/self/exe", exe, sizeof(exe) - 1);
+    if (length <= 0) {
+        perror("readlink(/proc/self/exe)");
+        return;
+    }
+    exe[length] = '\0';
+    const char *deleted = " (deleted)";
+    if ((size_t)length > strlen(deleted) && strcmp(exe + length - strlen(deleted), deleted) == 0) {
+        exe[length - strlen(deleted)] = '\0';
+    }
+    char directory[4096];
+    char *slash = strrchr(exe, '/');
+    snprintf(directory, sizeof(directory), "%.*s", slash == exe ? 1 : (int)(slash - exe), exe);
+    const char *name = slash + 1;
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        perror("inotify");
+        return;
+    }
+    long buffer[1024]; // aligned for `struct inotify_event`
+    bool changed = false;
+    while (!changed) {
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+        if (size <= 0) {
+            if (size < 0 && errno == EINTR) {
+                continue;
+            }
+            perror("read(inotify)");
+            close(fd);
+            return;
+        }
+        for (char *p = (char *)buffer; p < (char *)buffer + size;) {
+            struct inotify_event *event = (struct inotify_event *)p;
+            changed |= event->len && strcmp(event->name, name) == 0;
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    // Let the build settle, e.g. a link followed by a strip
+    struct pollfd settle = { fd, POLLIN, 0 };
+    while (poll(&settle, 1, 200) > 0) {
+        if (read(fd, buffer, sizeof(buffer)) <= 0) {
+            break;
+        }
+    }
+    close(fd);
+
+    for (int attempt = 0; attempt < 20; ++attempt) {
+        execl(exe, exe, (char *)NULL);
+        // The new executable can still be busy or incomplete for a moment
+        poll(NULL, 0, 100);
+    }
+    perror(exe);
+#else
+    fprintf(stderr, "BDD_WATCH is only supported on Linux\n");
+#endif
+}
+
+// Includes the tests that are selected themselves or through one of their
+// groups and excludes the rest. Selectors are node ids or node paths.
+void __bdd_server_select__(__bdd_node__ *node, bool selected, char **selectors, size_t selector_count) {
+    char *path = __bdd_timing_path__(node);
+    for (size_t i = 0; i < selector_count && !selected; ++i) {
+        char *end = NULL;
+        long id = strtol(selectors[i], &end, 10);
+        selected = (end != selectors[i] && *end == '\0' && id == node->id) || strcmp(selectors[i], path) == 0;
+    }
+    free(path);
+    if (__bdd_node_is_leaf__(node)) {
+        node->excluded = !selected;
+    }
+    for (size_t i = 0; i < node->list_children->size; ++i) {
+        __bdd_server_select__(node->list_children->values[i], selected, selectors, selector_count);
+    }
+}
+
+#ifndef _WIN32
+// Handles a single request in a child of the server and exits with it.
+// The request is a command followed by one selector per line, and ends
+// with an empty line or when the client shuts down its side.
+void __bdd_server_handle__(__bdd_config_type__ *config, __bdd_node__ *root, int client) {
+    char request[65536];
+    size_t size = 0;
+    while (size < sizeof(request) - 1) {
+        ssize_t received = read(client, request + size, sizeof(request) - 1 - size);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            break;
+        }
+        size += (size_t)received;
+        request[size] = '\0';
+        if (strcmp(request, "\n") == 0 || strstr(request, "\n\n")) {
+            break;
+        }
+    }
+    request[size] = '\0';
+
+    dup2(client, STDOUT_FILENO);
+    dup2(client, STDERR_FILENO);
+    close(client);
+    config->output = stdout;
+    config->use_color = 0;
+    config->interactive = 0;
+
+    char *request_lines[1024];
+    size_t request_line_count = 0;
+    for (char *line = strtok(request, "\r\n"); line && request_line_count < 1024; line = strtok(NULL, "\r\n")) {
+        request_lines[request_line_count++] = line;
+    }
+
+    int status = 0;
+    if (request_line_count > 0 && strcmp(request_lines[0], "list") == 0) {
+        for (size_t i = 0; i < config->nodes->size; ++i) {
+            __bdd_node__ *node = config->nodes->values[i];
+            if (node->type != __BDD_NODE_GROUP__ && node->type != __BDD_NODE_TEST__) {
+                continue;
+            }
+            char *path = __bdd_timing_path__(node);
+            printf("%d\t%s\t%s\n", node->id, node->type == __BDD_NODE_TEST__ ? "test" : "group", path);
+            free(path);
+        }
+    } else if (request_line_count > 0 && strcmp(request_lines[0], "run") == 0) {
+        if (request_line_count > 1) {
+            __bdd_server_select__(root, false, request_lines + 1, request_line_count - 1);
+            root->excluded = false;
+            __bdd_node_prune__(root);
+        }
+        __bdd_array__ *steps = __bdd_array_create__();
+        __bdd_node_flatten__(config, root, steps);
+        size_t test_count = 0;
+        for (size_t i = 0; i < steps->size; ++i) {
+            test_count += ((__bdd_test_step__ *)steps->values[i])->type == __BDD_NODE_TEST__;
+        }
+        if (config->use_tap) {
+            printf("TAP version 13\n1..%zu\n", test_count);
+        }
+
+        config->run = __BDD_TEST_RUN__;
+        for (size_t i = 0; i < steps->size; ++i) {
+            config->node_stack->size = 1;
+            config->id = 0;
+            config->current_test = steps->values[i];
+            __bdd_run__(config);
+            // Results are streamed to the client as the tests finish
+            fflush(stdout);
+        }
+        __bdd_async_drain__(config);
+        if (!config->use_tap) {
+            printf(
+                "\n%zu test%s run, %zu failed.\n",
+                test_count, test_count == 1 ? "" : "s", config->failed_test_count
+            );
+        }
+        status = config->failed_test_count > 0;
+    } else {
+        printf("Unknown request, expected `list` or `run` followed by node ids or paths\n");
+        status = 2;
+    }
+    fflush(stdout);
+    fflush(stderr);
+    _exit(status);
+}
+#endif
+
+// Serves requests to list and run the discovered nodes on a Unix domain
+// socket, each in a forked child so that every request starts from the
+// state right after the discovery. Only returns if the socket fails.
+#ifndef _WIN32
+// Children report their results to the clients, not to the server, which
+// only reaps them. Ignoring SIGCHLD instead would be inherited by the tests
+// and `wait` for their own children would fail with ECHILD.
+void __bdd_server_reap__(int signal_number) {
+    (void)signal_number;
+    int saved_errno = errno;
+    while (waitpid(-1, NULL, WNOHANG) > 0) {
+    }
+    errno = saved_errno;
+}
+#endif
+
+int __bdd_serve__(__bdd_config_type__ *config, __bdd_node__ *root, const char *socket_path) {
+#ifdef _WIN32
+    (void)config;
+    (void)root;
+    fprintf(stderr, "BDD_SERVER is not supported on Windows (%s)\n", socket_path);
+    return 1;
+#else
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "BDD_SERVER path is too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int server = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server < 0) {
+        perror("socket");
+        return 1;
+    }
+    unlink(socket_path);
+    if (bind(server, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(server, 64) < 0) {
+        perror(socket_path);
+        close(server);
+        return 1;
+    }
+    struct sigaction reaper;
+    memset(&reaper, 0, sizeof(reaper));
+    reaper.sa_handler = __bdd_server_reap__;
+    reaper.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    sigemptyset(&reaper.sa_mask);
+    sigaction(SIGCHLD, &reaper, NULL);
+    fprintf(config->output, "Serving %s on %s\n", __bdd_spec_name__, socket_path);
+    fflush(config->output);
+
+    for (;;) {
+        int client = accept(server, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            close(server);
+            return 1;
+        }
+        fflush(config->output);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == 0) {
+            close(server);
+            signal(SIGCHLD, SIG_DFL);
+            __bdd_server_handle__(config, root, client);
+        }
+        if (pid < 0) {
+            perror("fork");
+        }
+        close(client);
+    }
+#endif
+}
+
+#if defined(__GNUC__) && defined(__ELF__) && !defined(BDD_NO_META)
+// The linker defines these around the `bdd_meta` section when
+// at least one record was emitted, otherwise they stay null
+extern const __bdd_meta__ __start_bdd_meta[] __attribute__((weak));
+extern const __bdd_meta__ __stop_bdd_meta[] __attribute__((weak));
+#endif
+
+size_t __bdd_meta_records__(const __bdd_meta__ **records) {
+#if defined(__GNUC__) && defined(__ELF__) && !defined(BDD_NO_META)
+    if (__start_bdd_meta && __stop_bdd_meta) {
+        *records = __start_bdd_meta;
+        return (size_t)(__stop_bdd_meta - __start_bdd_meta);
+    }
+#endif
+    *records = NULL;
+    return 0;
+}
+
+const char *__bdd_node_kind__(__bdd_node_type__ type) {
+    return type == __BDD_NODE_GROUP__ ? "group" : type == __BDD_NODE_TEST__ ? "test" : "hook";
+}
+
+// Lists the statements of the spec from the records emitted by the macros,
+// without running the spec. Names with a format are listed as written.
+bool __bdd_meta_list__(FILE *output, const char *filter) {
+    const __bdd_meta__ *records = NULL;
+    size_t count = __bdd_meta_records__(&records);
+    const __bdd_meta__ **sorted = __bdd_calloc__(count ? count : 1, sizeof(__bdd_meta__ *));
+    if (!sorted) {
+        perror("calloc(records)");
+        abort();
+    }
+    size_t listed = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (records[i].magic != __BDD_META_MAGIC__) {
+            continue; // padding between the records of different files
+        }
+        if (filter && (!records[i].name || !strstr(records[i].name, filter))) {
+            continue;
+        }
+        // The compiler is free to emit the records of a file in any order
+        size_t j = listed++;
+        for (; j > 0 && strcmp(sorted[j - 1]->file, records[i].file) == 0 && sorted[j - 1]->line > records[i].line; --j) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = &records[i];
+    }
+    for (size_t i = 0; i < listed; ++i) {
+        fprintf(
+            output, "%s:%d\t%s\t%s\n",
+            sorted[i]->file, sorted[i]->line, __bdd_node_kind__((__bdd_node_type__)sorted[i]->type),
+            sorted[i]->name ? sorted[i]->name : "(not a literal)"
+        );
+    }
+    free(sorted);
+    return count > 0;
+}
+
+// Reads the environment variable only when the options allow it
+const char *__bdd_getenv__(const bdd_options *options, const char *name) {
+    return options->use_environment ? getenv(name) : NULL;
+}
+
+// Excludes the tests that do not have the filter in their path
+void __bdd_filter__(__bdd_node__ *node, const char *filter) {
+    if (__bdd_node_is_leaf__(node)) {
+        char *path = __bdd_timing_path__(node);
+        node->excluded = strstr(path, filter) == NULL;
+        free(path);
+    }
+    for (size_t i = 0; i < node->list_children->size; ++i) {
+        __bdd_filter__(node->list_children->values[i], filter);
     }
 }
 
-void __bdd_run__(__bdd_config_type__ *config) {
-    __bdd_test_step__ *step = config->current_test;
+void bdd_options_from_environment(bdd_options *options) {
+    memset(options, 0, sizeof(*options));
+    options->output = stdout;
+    options->use_environment = true;
 
-    if (step->type == __BDD_NODE_GROUP__ && !config->use_tap) {
-        if (config->has_focus_nodes && !(step->flags & __bdd_node_flags_focus__)) {
-            return;
-        }
-        __bdd_indent__(stdout, step->level);
-        printf(
-            "%s%s%s\n",
-            config->use_color ? __BDD_COLOR_BOLD__ : "",
-            step->name,
-            config->use_color ? __BDD_COLOR_RESET__ : ""
-        );
-        return;
+    const char *tap_env = getenv("BDD_USE_TAP");
+    if (BDD_USE_TAP || (tap_env && strcmp(tap_env, "") != 0 && strcmp(tap_env, "0") != 0)) {
+        options->use_tap = true;
+    }
+    if (!options->use_tap && BDD_USE_COLOR && __BDD_IS_ATTY__(stdout) && __bdd_is_supported_term__()) {
+        options->use_color = true;
     }
 
-    bool skipped = false;
-    if (step->type == __BDD_NODE_TEST__) {
-        if (config->has_focus_nodes && !(step->flags & __bdd_node_flags_focus__)) {
-          skipped = true;
-        } else if (step->flags & __bdd_node_flags_skip__) {
-          skipped = true;
+    const char *filter_env = getenv("BDD_FILTER");
+    if (filter_env && *filter_env) {
+        options->filter = filter_env;
+    }
+}
+
+// Discovers the spec and runs its plan as the options and the environment
+// tell. Every early return leaves the cleanup of the config to `bdd_run`.
+int __bdd_run_spec__(const bdd_options *options, __bdd_config_type__ *config, __bdd_node__ *root, bdd_result *result) {
+    FILE *output = config->output;
+
+    // Pinned before the discovery, so every part of the run stays on the CPU
+    const char *pin_env = __bdd_getenv__(options, "BDD_PIN_CPU");
+    int pinned_cpu = -1;
+    if (pin_env && *pin_env) {
+        char *end;
+        long cpu = strtol(pin_env, &end, 10);
+        if (*end || cpu < 0 || cpu >= __BDD_MAX_CPUS__) {
+            fprintf(stderr, "BDD_PIN_CPU must be a cpu from 0 to %d: %s\n", __BDD_MAX_CPUS__ - 1, pin_env);
+            return 1;
         }
-        ++config->test_tap_index;
-        // Print the step name before running the test so it is visible
-        // even if the test itself crashes.
-        if ((!skipped || !config->has_focus_nodes) && config->run == __BDD_TEST_RUN__ && !config->use_tap) {
-          __bdd_indent__(stdout, step->level);
-          printf("%s ", step->name);
+        if (__bdd_pin_cpu__((int)cpu)) {
+            pinned_cpu = (int)cpu;
         }
+    }
 
-        if (!skipped) {
-          __bdd_test_main__(config);
-        }
-
-        if (skipped) {
-            if (config->run == __BDD_TEST_RUN__) {
-                if (!config->has_focus_nodes) {
-                  if (config->use_tap) {
-                      // We only to report tests and not setup / teardown success
-                      if (config->test_tap_index) {
-                          printf("skipped %zu - %s\n", config->test_tap_index, step->name);
-                      }
-                  } else {
-                      printf(
-                          "%s(SKIP)%s\n",
-                          config->use_color ? __BDD_COLOR_YELLOW__ : "",
-                          config->use_color ? __BDD_COLOR_RESET__ : ""
-                      );
-                  }
-                }
-            }
-        } else if (config->error == NULL) {
-            if (config->run == __BDD_TEST_RUN__) {
-                if (config->use_tap) {
-                    // We only to report tests and not setup / teardown success
-                    if (config->test_tap_index) {
-                        printf("ok %zu - %s\n", config->test_tap_index, step->name);
-                    }
-                } else {
-                    printf(
-                        "%s(OK)%s\n",
-                        config->use_color ? __BDD_COLOR_GREEN__ : "",
-                        config->use_color ? __BDD_COLOR_RESET__ : ""
-                    );
-                }
-            }
-        } else {
-            ++config->failed_test_count;
-            if (config->use_tap) {
-                // We only to report tests and not setup / teardown errors
-                if (config->test_tap_index) {
-                    printf("not ok %zu - %s\n", config->test_tap_index, step->name);
-                }
-            } else {
-                printf(
-                    "%s(FAIL)%s\n",
-                    config->use_color ? __BDD_COLOR_RED__ : "",
-                    config->use_color ? __BDD_COLOR_RESET__ : ""
-                );
-                __bdd_indent__(stdout, step->level + 1);
-                printf("%s\n", config->error);
-                __bdd_indent__(stdout, step->level + 2);
-                printf("%s\n", config->location);
-            }
-            free(config->error);
-            config->error = NULL;
+    const char *shard_index_env = __bdd_getenv__(options, "BDD_SHARD_INDEX");
+    const char *shard_count_env = __bdd_getenv__(options, "BDD_SHARD_COUNT");
+    size_t shard_index = shard_index_env ? strtoul(shard_index_env, NULL, 10) : 0;
+    size_t shard_count = shard_count_env && *shard_count_env ? strtoul(shard_count_env, NULL, 10) : 1;
+    if (shard_count == 0 || shard_index >= shard_count) {
+        fprintf(stderr, "BDD_SHARD_INDEX must be less than BDD_SHARD_COUNT\n");
+        return 1;
+    }
+
+    // Only `BDD_REPEAT_UNTIL_FAIL` without `BDD_REPEAT` repeats without a limit
+    const char *repeat_env = __bdd_getenv__(options, "BDD_REPEAT");
+    const char *until_fail_env = __bdd_getenv__(options, "BDD_REPEAT_UNTIL_FAIL");
+    bool until_fail = until_fail_env && strcmp(until_fail_env, "") != 0 && strcmp(until_fail_env, "0") != 0;
+    size_t max_rounds = until_fail ? 0 : 1;
+    if (repeat_env && *repeat_env) {
+        // `strtoul` accepts a sign and wraps negative numbers around
+        char *end;
+        max_rounds = strtoul(repeat_env, &end, 10);
+        if (*repeat_env < '0' || *repeat_env > '9' || *end || max_rounds == 0) {
+            fprintf(stderr, "BDD_REPEAT must be a positive number of rounds: %s\n", repeat_env);
+            return 1;
         }
-    } else if (!skipped) {
-      __bdd_test_main__(config);
     }
-}
 
-char *__bdd_vformat__(const char *format, va_list va) {
-    // First we over-allocate
-    const size_t size = 2048;
-    char *result = calloc(size, sizeof(char));
-    if (!result) {
-        perror("calloc(result)");
-        abort();
+    const char *stats_env = __bdd_getenv__(options, "BDD_STATS");
+    if (stats_env && strcmp(stats_env, "") != 0 && strcmp(stats_env, "0") != 0) {
+        __bdd_stats__.enabled = true;
     }
-    vsnprintf(result, size - 1, format, va);
 
-    // Then clip to an actual size
-    void* r = realloc(result, strlen(result) + 1);
-    if (!r) {
-        perror("realloc(result)");
-        abort();
+    const char *rusage_env = __bdd_getenv__(options, "BDD_RUSAGE");
+    if (rusage_env && strcmp(rusage_env, "") != 0 && strcmp(rusage_env, "0") != 0) {
+        config->use_rusage = 1;
     }
-    result = r;
-    return result;
-}
 
-char *__bdd_format__(const char *format, ...) {
-    va_list va;
-    va_start(va, format);
-    char *result = __bdd_vformat__(format, va);
-    va_end(va);
-    return result;
-}
+    const char *update_snapshots_env = __bdd_getenv__(options, "BDD_UPDATE_SNAPSHOTS");
+    if (update_snapshots_env && strcmp(update_snapshots_env, "") != 0 && strcmp(update_snapshots_env, "0") != 0) {
+        config->update_snapshots = 1;
+    }
 
-bool __bdd_is_supported_term__() {
-    bool result;
-    const char *term = getenv("TERM");
-    result = term && strcmp(term, "") != 0;
-#ifndef _WIN32
-    return result;
-#else
-    if (result) {
-        return 1;
+    const char *async_timeout_env = __bdd_getenv__(options, "BDD_ASYNC_TIMEOUT_MS");
+    if (async_timeout_env && strcmp(async_timeout_env, "") != 0) {
+        config->async_timeout_ms = strtoull(async_timeout_env, NULL, 10);
     }
 
-    // Attempt to enable virtual terminal processing on Windows.
-    // See: https://msdn.microsoft.com/en-us/library/windows/desktop/mt638032(v=vs.85).aspx
-    HANDLE hOut = GetStdHandle(STD_OUTPUT_HANDLE);
-    if (hOut == INVALID_HANDLE_VALUE) {
+    const char *list_env = __bdd_getenv__(options, "BDD_LIST");
+    bool list = list_env && strcmp(list_env, "") != 0 && strcmp(list_env, "0") != 0;
+    if (list && __bdd_meta_list__(output, options->filter)) {
         return 0;
     }
 
-    DWORD dwMode = 0;
-    if (!GetConsoleMode(hOut, &dwMode)) {
-        return 0;
+    // Every statement creates at least one node
+    const __bdd_meta__ *records = NULL;
+    size_t record_count = __bdd_meta_records__(&records);
+    if (record_count > config->nodes->capacity) {
+        config->nodes->values = __bdd_realloc__(config->nodes->values, record_count * sizeof(void *));
+        if (!config->nodes->values) {
+            perror("realloc(nodes)");
+            abort();
+        }
+        config->nodes->capacity = record_count;
     }
 
-    dwMode |= 0x4; // ENABLE_VIRTUAL_TERMINAL_PROCESSING
-    if (!SetConsoleMode(hOut, dwMode)) {
+    // During the first run we just gather the
+    // count of the tests and their descriptions
+    unsigned long long discovery_started_at = __bdd_now_ns__();
+    __bdd_call_test_main__(config);
+    unsigned long long flatten_started_at = __bdd_now_ns__();
+    __bdd_stats__.discovery_ns = flatten_started_at - discovery_started_at;
+
+    if (list) {
+        // Without the records the spec has to be discovered to list it
+        for (size_t i = 0; i < config->nodes->size; ++i) {
+            __bdd_node__ *node = config->nodes->values[i];
+            char *path = __bdd_timing_path__(node);
+            if (!options->filter || strstr(path, options->filter)) {
+                fprintf(output, "-\t%s\t%s\n", __bdd_node_kind__(node->type), path);
+            }
+            free(path);
+        }
         return 0;
     }
 
-    return 1;
-#endif
-}
+    const char *server_env = __bdd_getenv__(options, "BDD_SERVER");
+    if (server_env && *server_env) {
+        return __bdd_serve__(config, root, server_env);
+    }
 
-int main(void) {
-    struct __bdd_config_type__ config = {
-        .run = __BDD_INIT_RUN__,
-        .id = 0,
-        .test_index = 0,
-        .test_tap_index = 0,
-        .failed_test_count = 0,
-        .node_stack = __bdd_array_create__(),
-        .nodes = __bdd_array_create__(),
-        .error = NULL,
-        .use_color = 0,
-        .use_tap = 0
-    };
+    if (options->filter) {
+        __bdd_filter__(root, options->filter);
+        root->excluded = false;
+        __bdd_node_prune__(root);
+    }
 
-    const char *tap_env = getenv("BDD_USE_TAP");
-    if (BDD_USE_TAP || (tap_env && strcmp(tap_env, "") != 0 && strcmp(tap_env, "0") != 0)) {
-        config.use_tap = 1;
+    // `BDD_FUZZ` only runs the test to fuzz, with its hooks
+    const char *fuzz_env = __bdd_getenv__(options, "BDD_FUZZ");
+    if (fuzz_env && *fuzz_env) {
+        config->fuzz_target = fuzz_env;
+        __bdd_server_select__(root, false, (char **)&config->fuzz_target, 1);
+        if (!__bdd_node_prune__(root)) {
+            fprintf(stderr, "BDD_FUZZ must be the path or the id of a test: %s\n", config->fuzz_target);
+            return 1;
+        }
+        root->excluded = false;
+        config->fuzz_runs = __bdd_getenv__(options, "BDD_FUZZ_RUNS");
+        config->fuzz_seconds = __bdd_getenv__(options, "BDD_FUZZ_SECONDS");
+        config->fuzz_seed = __bdd_getenv__(options, "BDD_FUZZ_SEED");
+        config->fuzz_dictionary = __bdd_getenv__(options, "BDD_FUZZ_DICT");
     }
 
-    if (!config.use_tap && BDD_USE_COLOR && __BDD_IS_ATTY__() && __bdd_is_supported_term__()) {
-        config.use_color = 1;
+    // `BDD_CHANGES` only runs the tests that covered the changed lines
+    // when the map was recorded, and the tests that are not in it yet
+    const char *coverage_file = __bdd_getenv__(options, "BDD_COVERAGE_MAP");
+    if (coverage_file && !*coverage_file) {
+        coverage_file = NULL;
+    }
+    const char *changes_env = __bdd_getenv__(options, "BDD_CHANGES");
+    __bdd_array__ *changes = NULL;
+    if (changes_env && *changes_env) {
+        if (!coverage_file) {
+            fprintf(stderr, "BDD_CHANGES needs a BDD_COVERAGE_MAP to select the tests with\n");
+            return 1;
+        }
+        changes = __bdd_changes_load__(changes_env);
+        if (!changes) {
+            fprintf(stderr, "cannot read the changes from %s: %s\n", changes_env, strerror(errno));
+            return 1;
+        }
+    }
+    __bdd_array__ *coverage_map = __bdd_coverage_load__(coverage_file);
+    if (changes) {
+        __bdd_coverage_select__(root, coverage_map, changes, false);
+        root->excluded = false;
+        __bdd_node_prune__(root);
+        __bdd_line_ranges_free__(changes);
+    }
+    __bdd_coverage_recorder__ *coverage = NULL;
+    if (coverage_file) {
+        coverage = __bdd_coverage_recorder_create__(root, __bdd_getenv__(options, "TMPDIR"));
+        if (!coverage && !(changes_env && *changes_env)) {
+            fprintf(
+                stderr, "BDD_COVERAGE_MAP is only recorded when built with --coverage "
+                "and linked with -Wl,-u,__gcov_dump,-u,__gcov_reset\n"
+            );
+        }
     }
 
-    __bdd_node__ *root = __bdd_node_create__(-1, __bdd_spec_name__, __BDD_NODE_GROUP__, __bdd_node_flags_none__);
-    __bdd_array_push__(config.node_stack, root);
+    const char *timing_file = __bdd_getenv__(options, "BDD_TIMING_FILE");
+    if (timing_file && !*timing_file) {
+        timing_file = NULL;
+    }
+    __bdd_array__ *history = __bdd_timings_load__(timing_file);
+    __bdd_array__ *units = __bdd_array_create__();
+    __bdd_collect_units__(root, units);
+    if (shard_count > 1) {
+        __bdd_shard_plan__(root, units, history, shard_index, shard_count);
+    }
 
-    // During the first run we just gather the
-    // count of the tests and their descriptions
-    __bdd_test_main__(&config);
+    // `BDD_WATCH` keeps the statuses of the tests in a file that
+    // is passed on to the rebuilt executable in the environment
+    const char *watch_env = __bdd_getenv__(options, "BDD_WATCH");
+    char *watch_state = NULL;
+    if (watch_env && strcmp(watch_env, "") != 0 && strcmp(watch_env, "0") != 0) {
+        const char *state_env = __bdd_getenv__(options, "BDD_WATCH_STATE");
+        if (state_env && *state_env) {
+            watch_state = __bdd_strdup__(state_env);
+            config->watch_previous = __bdd_watch_load__(watch_state);
+        } else {
+            watch_state = __bdd_watch_state_create__(__bdd_getenv__(options, "TMPDIR"));
+        }
+        config->watch_results = __bdd_array_create__();
+    }
 
     __bdd_array__ *steps = __bdd_array_create__();
-    __bdd_node_flatten__(&config, root, steps);
+    if (config->watch_previous) {
+        __bdd_watch_plan__(config, root, steps);
+    } else {
+        __bdd_node_flatten__(config, root, steps);
+    }
 
     size_t test_count = 0;
     for (size_t i = 0; i < steps->size; ++i) {
@@ -564,37 +6859,156 @@ int main(void) {
     }
 
     // Outputting the name of the suite
-    if (config.use_tap) {
-        printf("TAP version 13\n1..%zu\n", test_count);
+    if (config->use_tap) {
+        fprintf(output, "TAP version 13\n1..%zu\n", test_count);
     }
 
-    config.run = __BDD_TEST_RUN__;
-
+    // Timings are only comparable between runs in the same environment
+    const char *environment_env = __bdd_getenv__(options, "BDD_ENVIRONMENT");
+    bool has_timings = pinned_cpu >= 0;
     for (size_t i = 0; i < steps->size; ++i) {
         __bdd_test_step__ *step = steps->values[i];
-        config.node_stack->size = 1;
-        config.id = 0;
-        config.current_test = step;
-        __bdd_run__(&config);
+        has_timings |= (step->flags & (__bdd_node_flags_bench__ | __bdd_node_flags_timed__)) != 0;
+    }
+    if (environment_env && *environment_env) {
+        has_timings = strcmp(environment_env, "0") != 0;
+    }
+    if (has_timings) {
+        __bdd_environment_print__(config, pinned_cpu);
     }
 
-    for (size_t i = 0; i < config.nodes->size; ++i) {
-        __bdd_node_free__(config.nodes->values[i]);
+    config->run = __BDD_TEST_RUN__;
+    unsigned long long execution_started_at = __bdd_now_ns__();
+    __bdd_stats__.flatten_ns = execution_started_at - flatten_started_at;
+
+    const char *trace_file = __bdd_getenv__(options, "BDD_TRACE_FILE");
+    if (trace_file && *trace_file) {
+        __bdd_trace_open__(config, trace_file);
     }
-    root->name = NULL; // name is statically allocated
-    __bdd_node_free__(root);
+
+    // The plan is run again without the discovery for every round of
+    // `BDD_REPEAT`, or until a round fails with `BDD_REPEAT_UNTIL_FAIL`
+    config->repeating = max_rounds != 1;
+
+    __bdd_node__ *timed_test = NULL;
+    unsigned long long before_each_ns = 0;
+    size_t rounds = 0;
+    while (max_rounds == 0 || rounds < max_rounds) {
+        config->round = rounds;
+        config->quiet = rounds > 0 || config->watch_previous;
+        config->test_tap_index = 0;
+        size_t failed_before = config->failed_test_count;
+        for (size_t i = 0; i < steps->size; ++i) {
+            __bdd_test_step__ *step = steps->values[i];
+            config->node_stack->size = 1;
+            config->id = 0;
+            config->current_test = step;
+            unsigned long long started_at = timing_file ? __bdd_now_ns__() : 0;
+            if (coverage) {
+                __bdd_coverage_step_started__(coverage);
+            }
+            __bdd_run__(config);
+            if (coverage) {
+                __bdd_coverage_step_finished__(coverage, config, step);
+            }
+            if (timing_file) {
+                __bdd_timing_charge__(
+                    config, root, step, __bdd_now_ns__() - started_at, &timed_test, &before_each_ns
+                );
+            }
+        }
+        // Waiting for the async tests still in flight is shared by their groups
+        __bdd_array__ *in_flight = __bdd_array_create__();
+        for (size_t i = 0; timing_file && i < config->async_pending->size; ++i) {
+            bdd_async *async = config->async_pending->values[i];
+            __bdd_array_push__(in_flight, ((__bdd_node__ *)config->nodes->values[async->step->id])->parent);
+        }
+        unsigned long long drain_started_at = timing_file ? __bdd_now_ns__() : 0;
+        __bdd_async_drain__(config);
+        unsigned long long drain_ns = timing_file ? __bdd_now_ns__() - drain_started_at : 0;
+        for (size_t i = 0; i < in_flight->size; ++i) {
+            ((__bdd_node__ *)in_flight->values[i])->duration_ns += drain_ns / in_flight->size;
+        }
+        __bdd_array_free__(in_flight);
+        ++rounds;
+        if (until_fail && config->failed_test_count > failed_before) {
+            break;
+        }
+    }
+    __bdd_stats__.execution_ns = __bdd_now_ns__() - execution_started_at;
+    if (timing_file) {
+        // The history keeps the duration of a single round
+        for (size_t i = 0; i < units->size; ++i) {
+            ((__bdd_node__ *)units->values[i])->duration_ns /= rounds;
+        }
+
+        const char *timing_output = __bdd_getenv__(options, "BDD_TIMING_OUTPUT");
+        if (timing_output && *timing_output) {
+            __bdd_timings_save__(timing_output, shard_count > 1 ? NULL : history, units);
+        } else if (shard_count > 1) {
+            // Shards only record their own groups, to be merged with `cat`
+            char *shard_file = __bdd_format__("%s.%zu", timing_file, shard_index);
+            __bdd_timings_save__(shard_file, NULL, units);
+            free(shard_file);
+        } else {
+            __bdd_timings_save__(timing_file, history, units);
+        }
+    }
+    __bdd_timings_free__(history);
+    __bdd_array_free__(units);
+    if (coverage) {
+        __bdd_coverage_save__(coverage_file, coverage_map, coverage->entries);
+        __bdd_coverage_recorder_free__(coverage);
+    }
+    __bdd_coverage_entries_free__(coverage_map);
+
+    if (config->trace) {
+        __bdd_trace_close__(config, root);
+    }
+    if (config->repeating) {
+        __bdd_repeat_report__(config, rounds);
+    }
+    if (__bdd_stats__.enabled) {
+        __bdd_stats_print__(config);
+    }
+
     for (size_t i = 0; i < steps->size; ++i) {
         free(steps->values[i]);
     }
-    __bdd_array_free__(config.nodes);
-    __bdd_array_free__(config.node_stack);
     __bdd_array_free__(steps);
 
-    if (config.failed_test_count > 0) {
-        if (!config.use_tap) {
-            printf(
-                "\n%zu test%s run, %zu failed.\n",
-                test_count, test_count == 1 ? "" : "s", config.failed_test_count
+    if (config->watch_results) {
+        if (watch_state) {
+            __bdd_watch_save__(watch_state, config->watch_results);
+        }
+        fprintf(
+            output, "\n%zu test%s, %zu failing. Waiting for the executable to be rebuilt...\n",
+            test_count, test_count == 1 ? "" : "s", config->failed_test_count
+        );
+        fflush(output);
+        __bdd_watch_free__(config->watch_previous);
+        __bdd_watch_free__(config->watch_results);
+        __bdd_watch_wait__();
+        free(watch_state);
+    }
+
+    if (result) {
+        result->test_count = test_count;
+        result->failed_test_count = config->failed_test_count;
+        result->rounds = rounds;
+        result->duration_ns = __bdd_stats__.execution_ns;
+    }
+
+    if (config->failed_test_count > 0) {
+        if (!config->use_tap && rounds > 1) {
+            fprintf(
+                output, "\n%zu test%s run %zu times, %zu failed.\n",
+                test_count, test_count == 1 ? "" : "s", rounds, config->failed_test_count
+            );
+        } else if (!config->use_tap) {
+            fprintf(
+                output, "\n%zu test%s run, %zu failed.\n",
+                test_count, test_count == 1 ? "" : "s", config->failed_test_count
             );
         }
         return 1;
@@ -602,72 +7016,111 @@ int main(void) {
     return 0;
 }
 
-#define spec(name) \
-char *__bdd_spec_name__ = (name);\
-void __bdd_test_main__ (__bdd_config_type__ *__bdd_config__)\
-
-#define __BDD_NODE__(flags, node_list, type, ...)\
-for(\
-    bool __bdd_has_run__ = 0;\
-    (\
-      !__bdd_has_run__ && \
-      __bdd_enter_node__(flags, __bdd_config__, (type), offsetof(struct __bdd_node__, node_list), __VA_ARGS__) \
-    );\
-    __bdd_exit_node__(__bdd_config__), \
-    __bdd_has_run__ = 1 \
-)
-
-#define describe(...) __BDD_NODE__(__bdd_node_flags_none__, list_children, __BDD_NODE_GROUP__, __VA_ARGS__)
-#define it(...)       __BDD_NODE__(__bdd_node_flags_none__, list_children, __BDD_NODE_TEST__, __VA_ARGS__)
-#define it_only(...)  __BDD_NODE__(__bdd_node_flags_focus__, list_children, __BDD_NODE_TEST__, __VA_ARGS__)
-#define fit(...)      it_only(__VA_ARGS__)
-#define it_skip(...)  __BDD_NODE__(__bdd_node_flags_skip__, list_children, __BDD_NODE_TEST__, __VA_ARGS__)
-#define xit(...)      it_skip(__VA_ARGS__)
-#define before_each() __BDD_NODE__(__bdd_node_flags_none__, list_before_each, __BDD_NODE_INTERIM__, "before_each")
-#define after_each()  __BDD_NODE__(__bdd_node_flags_none__, list_after_each, __BDD_NODE_INTERIM__, "after_each")
-#define before()      __BDD_NODE__(__bdd_node_flags_none__, list_before, __BDD_NODE_INTERIM__, "before")
-#define after()       __BDD_NODE__(__bdd_node_flags_none__, list_after, __BDD_NODE_INTERIM__, "after")
-
-#ifndef BDD_NO_CONTEXT_KEYWORD
-#define context(name) describe(name)
-#endif
-
-#define __BDD_MACRO__(M, ...) __BDD_OVERLOAD__(M, __BDD_COUNT_ARGS__(__VA_ARGS__)) (__VA_ARGS__)
-#define __BDD_OVERLOAD__(macro_name, suffix) __BDD_EXPAND_OVERLOAD__(macro_name, suffix)
-#define __BDD_EXPAND_OVERLOAD__(macro_name, suffix) macro_name##suffix
+int bdd_run(const bdd_options *options, bdd_result *result) {
+    if (result) {
+        memset(result, 0, sizeof(bdd_result));
+    }
+    FILE *output = options->output ? options->output : stdout;
+    struct __bdd_config_type__ config = {
+        .run = __BDD_INIT_RUN__,
+        .id = 0,
+        .test_index = 0,
+        .test_tap_index = 0,
+        .failed_test_count = 0,
+        .node_stack = __bdd_array_create__(),
+        .nodes = __bdd_array_create__(),
+        .error = NULL,
+        .use_color = options->use_color,
+        .use_tap = options->use_tap,
+        .interactive = __BDD_IS_ATTY__(output),
+        .output = output,
+        .async_timeout_ms = BDD_ASYNC_TIMEOUT_MS,
+        .async_current = NULL,
+        .async_pending = __bdd_array_create__(),
+        .async_watches = __bdd_array_create__(),
+        .async_timers = __bdd_array_create__(),
+        .async_poll_fd = -1,
+        .node_params = { 0, 0 },
+        .concurrent_thread = NULL,
+        .interleaving_thread = NULL,
+        .corpus_data = NULL,
+        .corpus_size = 0,
+        .fuzz_target = NULL,
+        .fuzz_runs = NULL,
+        .fuzz_seconds = NULL,
+        .fuzz_seed = NULL,
+        .fuzz_dictionary = NULL,
+        .fuzz = NULL,
+        .fuzz_data = NULL,
+        .fuzz_size = 0,
+        .update_snapshots = 0,
+        .use_rusage = 0,
+        .bench_iterations = 0,
+        .bench_count = 0,
+        .latency = NULL,
+        .latency_remaining = 0,
+        .latency_started_at = 0,
+        .arena = __bdd_arena_create__(),
+        .repeating = 0,
+        .watch_previous = NULL,
+        .watch_results = NULL,
+        .quiet = 0,
+        .round = 0,
+        .trace = NULL,
+        .trace_events = 0,
+        .trace_threads = 0
+    };
 
-#define __BDD_COUNT_ARGS__(...) __BDD_PATTERN_MATCH__(__VA_ARGS__,_,_,_,_,_,_,_,_,_,ONE__)
-#define __BDD_PATTERN_MATCH__(_1,_2,_3,_4,_5,_6,_7,_8,_9,_10,N, ...) N
+    // Nothing is carried over from a previous run in the same process
+    memset(&__bdd_stats__, 0, sizeof(__bdd_stats__));
+    __bdd_running_step_name__ = NULL;
+    __bdd_running_output__ = output;
+    __bdd_crash_handlers__ host_handlers;
+    __bdd_install_crash_handlers__(&host_handlers);
 
-#define __BDD_STRING_HELPER__(x) #x
-#define __BDD_STRING__(x) __BDD_STRING_HELPER__(x)
-#define __STRING__LINE__ __BDD_STRING__(__LINE__)
+    __bdd_node__ *root = __bdd_node_create__(-1, __bdd_spec_name__, __BDD_NODE_GROUP__, __bdd_node_flags_none__);
+    __bdd_array_push__(config.node_stack, root);
 
-#define __BDD_FMT_COLOR__ __BDD_COLOR_RED__ "Check failed:" __BDD_COLOR_RESET__ " %s"
-#define __BDD_FMT_PLAIN__ "Check failed: %s"
+    int status = __bdd_run_spec__(options, &config, root, result);
 
-#define __BDD_CHECK__(condition, ...) if (!(condition))\
-{\
-    char *message = __bdd_format__(__VA_ARGS__);\
-    const char *fmt = __bdd_config__->use_color ? __BDD_FMT_COLOR__ : __BDD_FMT_PLAIN__;\
-    __bdd_config__->location = "at " __FILE__ ":" __STRING__LINE__;\
-    size_t bufflen = strlen(fmt) + strlen(message) + 1;\
-    __bdd_config__->error = calloc(bufflen, sizeof(char));\
-    if (__bdd_config__->use_color) {\
-      snprintf(__bdd_config__->error, bufflen, __BDD_FMT_COLOR__, message);\
-    } else {\
-      snprintf(__bdd_config__->error, bufflen, __BDD_FMT_PLAIN__, message);\
-    }\
-    free(message);\
-    return;\
+    for (size_t i = 0; i < config.nodes->size; ++i) {
+        __bdd_node_free__(config.nodes->values[i]);
+    }
+    root->name = NULL; // name is statically allocated
+    __bdd_node_free__(root);
+    __bdd_array_free__(config.nodes);
+    __bdd_array_free__(config.node_stack);
+    __bdd_array_free__(config.async_pending);
+    __bdd_array_free__(config.async_watches);
+    __bdd_array_free__(config.async_timers);
+    __bdd_arena_free__(config.arena);
+#ifndef _WIN32
+    if (config.async_poll_fd >= 0) {
+        close(config.async_poll_fd);
+    }
+#endif
+    __bdd_running_step_name__ = NULL;
+    __bdd_running_output__ = NULL;
+    __bdd_restore_crash_handlers__(&host_handlers);
+    return status;
 }
 
-#define __BDD_CHECK_ONE__(condition) __BDD_CHECK__(condition, #condition)
-
-#define check(...) __BDD_MACRO__(__BDD_CHECK_, __VA_ARGS__)
+#ifndef BDD_NO_MAIN
+int main(void) {
+    bdd_options options;
+    bdd_options_from_environment(&options);
+    if (!__BDD_IS_ATTY__(stdout) && BDD_OUTPUT_BUFFER_SIZE > 0) {
+        // Write piped output in large batches instead of a few small
+        // writes per test. Sharing the stdout buffer keeps the output of
+        // the specs themselves in order with the output of the runner.
+        setvbuf(stdout, NULL, _IOFBF, BDD_OUTPUT_BUFFER_SIZE);
+    }
+    return bdd_run(&options, NULL);
+}
+#endif
 
 #ifdef _MSC_VER
 #pragma warning(pop)
 #endif
 
-#endif //BDD_FOR_C_H
+#endif //BDD_IMPLEMENTATION
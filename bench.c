@@ -0,0 +1,74 @@
+#include "bdd-for-c.h"
+
+#define COUNT 256
+
+static volatile unsigned sink;
+
+static unsigned sum_forward(const unsigned *values, size_t count) {
+    unsigned sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+        sum += values[i];
+    }
+    return sum;
+}
+
+// Several passes over the same data, so it is clearly slower
+static unsigned sum_repeatedly(const unsigned *values, size_t count) {
+    unsigned sum = 0;
+    for (int pass = 0; pass < 8; ++pass) {
+        sum += sum_forward(values, count);
+        sink = sum;
+    }
+    return sum;
+}
+
+spec("benchmarks") {
+    static unsigned values[COUNT];
+    static size_t setups;
+    static size_t cleanups;
+    static size_t batches;
+    static const char *measured;
+
+    before() {
+        for (unsigned i = 0; i < COUNT; ++i) {
+            values[i] = i * 2654435761u;
+        }
+    }
+
+    describe("summing an array") {
+        before_each() {
+            ++setups;
+            measured = NULL;
+        }
+
+        after_each() {
+            ++cleanups;
+        }
+
+        // Every batch of every variant runs between its own hooks
+        bench_variant("once") {
+            check(!measured || strcmp(measured, "once") == 0, "no setup after %s", measured);
+            batches += !measured;
+            measured = "once";
+            sink = sum_forward(values, COUNT);
+        }
+
+        bench_variant("eight times") {
+            check(!measured || strcmp(measured, "eight times") == 0, "no setup after %s", measured);
+            batches += !measured;
+            measured = "eight times";
+            sink = sum_repeatedly(values, COUNT);
+        }
+
+        it("should run the hooks around every batch of the variants") {
+            // And around this test, but not once more around the variants
+            check(setups == batches + 1, "%zu setups, %zu batches", setups, batches);
+            check(cleanups == batches, "%zu cleanups, %zu batches", cleanups, batches);
+            check(setups > 2 * BDD_BENCH_SAMPLES, "got %zu", setups);
+        }
+
+        it("should tell that one pass is faster") {
+            check_faster("once", "eight times", 2.0);
+        }
+    }
+}
@@ -0,0 +1,18 @@
+#include "spec-driver.h"
+
+int main(void) {
+    EXPECT(run_spec(SPEC_EXECUTABLE, NULL) == 1);
+    EXPECT(strstr(spec_output, "\n5 tests run, 5 failed."));
+
+    EXPECT(strstr(spec_output, "4 of 1000 elements of sevens are not 7: [3] 1, [17] 2, [998] 3, [999] 4\n"));
+    EXPECT(strstr(spec_output, "2 of 64 bytes of bytes and zeros differ: [0] 0xab != 0x00, [63] 0xcd != 0x00\n"));
+    EXPECT(strstr(
+        spec_output,
+        "9 of 9 neighbours in descending are out of order: [0] 9 > 8, [1] 8 > 7, [2] 7 > 6, [3] 6 > 5, [4] 5 > 4, ...\n"
+    ));
+    EXPECT(strstr(spec_output, "2 of 4 elements of actual and expected differ by more than 0.5: [1] nan vs nan, [3] nan vs 4\n"));
+    EXPECT(strstr(spec_output, "1 of 5 elements of actual and expected differ by more than 0.25: [4] 1 vs 2\n"));
+
+    printf("bulk check failures (OK)\n");
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include <math.h>
+#include "bdd-for-c.h"
+
+#define COUNT 1000
+
+static int sevens[COUNT];
+static unsigned char zeros[64];
+static unsigned char bytes[64];
+
+spec("bulk check failures") {
+    before() {
+        for (int i = 0; i < COUNT; ++i) {
+            sevens[i] = 7;
+        }
+        sevens[3] = 1;
+        sevens[17] = 2;
+        sevens[COUNT - 2] = 3;
+        sevens[COUNT - 1] = 4;
+        bytes[0] = 0xab;
+        bytes[63] = 0xcd;
+    }
+
+    it("should list every mismatching element of check_all_eq") {
+        check_all_eq(sevens, COUNT, 7);
+    }
+
+    it("should list the first differing bytes of check_mem_eq") {
+        check_mem_eq(bytes, zeros, sizeof(zeros));
+    }
+
+    it("should only list the first few neighbours of check_sorted") {
+        int descending[10] = { 9, 8, 7, 6, 5, 4, 3, 2, 1, 0 };
+        check_sorted(descending, 10);
+    }
+
+    it("should never find NaN close in check_floats_close") {
+        float actual[4] = { 1.0f, NAN, 3.0f, NAN };
+        float expected[4] = { 1.0f, NAN, 3.0f, 4.0f };
+        check_floats_close(actual, expected, 4, 0.5f);
+    }
+
+    it("should find a mismatch after the last full vector of check_doubles_close") {
+        double actual[5] = { 1.0, 1.0, 1.0, 1.0, 1.0 };
+        double expected[5] = { 1.0, 1.0, 1.0, 1.0, 2.0 };
+        check_doubles_close(actual, expected, 5, 0.25);
+    }
+}
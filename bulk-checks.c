@@ -0,0 +1,76 @@
+#include "bdd-for-c.h"
+
+#define COUNT 100003
+
+static int numbers[COUNT];
+static float floats[COUNT];
+static float nearby_floats[COUNT];
+static double doubles[COUNT];
+static double nearby_doubles[COUNT];
+
+spec("bulk checks") {
+    before() {
+        for (int i = 0; i < COUNT; ++i) {
+            numbers[i] = i;
+            floats[i] = (float)i / 7.0f;
+            nearby_floats[i] = floats[i] + 0.0001f;
+            doubles[i] = (double)i / 7.0;
+            nearby_doubles[i] = doubles[i] - 1e-9;
+        }
+    }
+
+    describe("check_mem_eq") {
+        it("should accept equal buffers") {
+            static int copy[COUNT];
+            memcpy(copy, numbers, sizeof(numbers));
+            check_mem_eq(copy, numbers, sizeof(numbers));
+        }
+
+        it("should accept empty buffers") {
+            check_mem_eq("", NULL, 0);
+        }
+    }
+
+    describe("check_all_eq") {
+        it("should accept an array filled with the value") {
+            static int sevens[COUNT];
+            for (int i = 0; i < COUNT; ++i) {
+                sevens[i] = 7;
+            }
+            check_all_eq(sevens, COUNT, 7);
+        }
+    }
+
+    describe("check_floats_close") {
+        it("should accept values within the tolerance") {
+            check_floats_close(nearby_floats, floats, COUNT, 0.01f);
+        }
+
+        it("should accept equal infinities") {
+            float infinities[3] = { 1.0f / 0.0f, -1.0f / 0.0f, 0.0f };
+            check_floats_close(infinities, infinities, 3, 0.0f);
+        }
+    }
+
+    describe("check_doubles_close") {
+        it("should accept values within the tolerance") {
+            check_doubles_close(nearby_doubles, doubles, COUNT, 1e-6);
+        }
+    }
+
+    describe("check_sorted") {
+        it("should accept an ascending array") {
+            check_sorted(numbers, COUNT);
+        }
+
+        it("should accept repeated values") {
+            int repeated[9] = { 1, 1, 1, 2, 2, 3, 3, 3, 3 };
+            check_sorted(repeated, 9);
+        }
+
+        it("should accept arrays with less than two values") {
+            check_sorted(numbers, 1);
+            check_sorted(numbers, 0);
+        }
+    }
+}
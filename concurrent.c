@@ -0,0 +1,39 @@
+#include "bdd-for-c.h"
+#include <pthread.h>
+
+spec("concurrent tests") {
+    static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    static unsigned long counter;
+    static unsigned long per_thread[4];
+
+    describe("a mutex protected counter") {
+        before() {
+            counter = 0;
+        }
+
+        it_concurrently(4, 10000, "should be incremented from 4 threads") {
+            pthread_mutex_lock(&lock);
+            ++counter;
+            pthread_mutex_unlock(&lock);
+            ++per_thread[bdd_thread_index()];
+        }
+
+        it("should not lose any increments") {
+            check(counter == 40000, "got: %lu", counter);
+        }
+
+        it("should give each thread its own index") {
+            for (size_t i = 0; i < 4; ++i) {
+                check(per_thread[i] == 10000, "thread %zu got: %lu", i, per_thread[i]);
+            }
+        }
+    }
+
+    describe("a time limited run") {
+        it_concurrently_for(2, 50, "should keep running for the given number of milliseconds") {
+            pthread_mutex_lock(&lock);
+            ++counter;
+            pthread_mutex_unlock(&lock);
+        }
+    }
+}
@@ -0,0 +1,26 @@
+#include "bdd-for-c.h"
+
+static size_t count_non_printable(const unsigned char *data, size_t size) {
+    size_t count = 0;
+    for (size_t i = 0; i < size; ++i) {
+        count += data[i] < 0x20 || data[i] > 0x7e;
+    }
+    return count;
+}
+
+spec("corpus tests") {
+    static size_t files_seen;
+
+    describe("a directory of inputs") {
+        it_corpus("fixtures/corpus", data, size) {
+            ++files_seen;
+            check(data != NULL);
+            size_t non_printable = count_non_printable(data, size);
+            check(non_printable == 0, "found %zu non-printable bytes", non_printable);
+        }
+
+        it("should register a test for each visible file") {
+            check(files_seen == 3, "got: %zu", files_seen);
+        }
+    }
+}
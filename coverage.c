@@ -0,0 +1,157 @@
+#include "bdd-for-c.h"
+#include "spec-driver.h"
+
+static int open_count;
+
+static void open_fixture(void) {
+    ++open_count;
+}
+static const int open_fixture_line = __LINE__ - 3;
+
+static int add(int a, int b) {
+    return a + b;
+}
+static const int add_line = __LINE__ - 3;
+
+static int parse_digit(char c) {
+    return c >= '0' && c <= '9' ? c - '0' : -1;
+}
+static const int parse_digit_line = __LINE__ - 3;
+
+spec("coverage") {
+    it("should add") {
+        check(add(2, 3) == 5);
+    }
+
+    it("should parse a digit") {
+        check(parse_digit('7') == 7);
+    }
+
+    describe("with a fixture") {
+        before() {
+            open_fixture();
+        }
+
+        it("should have opened it") {
+            check(open_count > 0);
+        }
+
+        it("should still have it open") {
+            check(open_count > 0);
+        }
+    }
+}
+
+static const char *map_file = "coverage-test.map";
+static const char *changes_file = "coverage-test.changes";
+
+static bool file_contains(const char *path, const char *text) {
+    char buffer[8192];
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return false;
+    }
+    size_t size = fread(buffer, 1, sizeof(buffer) - 1, fp);
+    buffer[size] = '\0';
+    fclose(fp);
+    return strstr(buffer, text) != NULL;
+}
+
+static void write_file(const char *path, const char *text) {
+    FILE *fp = fopen(path, "w");
+    fputs(text, fp);
+    fclose(fp);
+}
+
+static int run_changes(const char *changes, bdd_result *result) {
+    FILE *output = tmpfile();
+    bdd_options options = { .output = output, .use_environment = true };
+    write_file(changes_file, changes);
+    int status = bdd_run(&options, result);
+    read_output(output);
+    fclose(output);
+    return status;
+}
+
+int main(void) {
+    char text[1024];
+    bdd_result result;
+    remove(map_file);
+    setenv("BDD_COVERAGE_MAP", map_file, 1);
+
+    FILE *output = tmpfile();
+    bdd_options options = { .output = output, .use_environment = true };
+    int status = bdd_run(&options, &result);
+    read_output(output);
+    EXPECT(status == 0);
+    EXPECT(result.test_count == 4);
+    fclose(output);
+
+    snprintf(text, sizeof(text), "should add\t");
+    EXPECT(file_contains(map_file, text));
+    snprintf(text, sizeof(text), "coverage.c:%d-%d", add_line, add_line + 2);
+    EXPECT(file_contains(map_file, text));
+    snprintf(text, sizeof(text), "\nwith a fixture\t");
+    EXPECT(file_contains(map_file, text));
+
+    setenv("BDD_CHANGES", changes_file, 1);
+    snprintf(text, sizeof(text), "coverage.c:%d\n", add_line + 1);
+    EXPECT(run_changes(text, &result) == 0);
+    EXPECT(result.test_count == 1);
+
+    // Changes to the hooks of a group run all of its tests
+    snprintf(
+        text, sizeof(text),
+        "diff --git a/coverage.c b/coverage.c\n"
+        "--- a/coverage.c\n"
+        "+++ b/coverage.c\n"
+        "@@ -%d,3 +%d,3 @@ static void open_fixture(void) {\n"
+        " static void open_fixture(void) {\n"
+        "-    ++open_count;\n"
+        "+    open_count += 1;\n"
+        " }\n",
+        open_fixture_line, open_fixture_line
+    );
+    EXPECT(run_changes(text, &result) == 0);
+    EXPECT(result.test_count == 2);
+
+    snprintf(
+        text, sizeof(text),
+        "--- a/coverage.c\n+++ b/coverage.c\n@@ -%d,0 +%d @@\n+\n",
+        parse_digit_line, parse_digit_line + 1
+    );
+    EXPECT(run_changes(text, &result) == 0);
+    EXPECT(result.test_count == 1);
+
+    EXPECT(run_changes("README.md\n", &result) == 0);
+    EXPECT(result.test_count == 0);
+
+    // Tests that are not in the map yet always run
+    write_file(map_file, "should add\n");
+    EXPECT(run_changes("coverage.c\n", &result) == 0);
+    EXPECT(result.test_count == 3);
+
+    // The counters still end up where gcov dumps them at exit
+    char prefix[] = "/tmp/bdd-coverage-test-XXXXXX";
+    EXPECT(mkdtemp(prefix));
+    snprintf(text, sizeof(text), "%s/coverage.c.gcda", prefix);
+    setenv("GCOV_PREFIX", prefix, 1);
+    setenv("GCOV_PREFIX_STRIP", "1000", 1);
+    unsetenv("BDD_CHANGES");
+    options.output = tmpfile();
+    status = bdd_run(&options, &result);
+    read_output(options.output);
+    EXPECT(status == 0);
+    EXPECT(result.test_count == 4);
+    fclose(options.output);
+    unsetenv("GCOV_PREFIX");
+    unsetenv("GCOV_PREFIX_STRIP");
+    EXPECT(file_contains(text, "adcg"));
+    remove(text);
+    rmdir(prefix);
+
+    remove(map_file);
+    remove(changes_file);
+    printf("coverage (OK)\n");
+    return 0;
+}
@@ -0,0 +1,13 @@
+#include <signal.h>
+#include "spec-driver.h"
+
+// The output of the crashing spec goes to a pipe, so the runner buffers it
+int main(void) {
+    EXPECT(run_spec(SPEC_EXECUTABLE, NULL) == 128 + SIGSEGV);
+    EXPECT(strstr(spec_output, "crash\n  should pass before the crash (OK)\n  should crash"));
+    EXPECT(strstr(spec_output, "\nCrashed with signal 11 while running: should crash\n"));
+    EXPECT(!strstr(spec_output, "should not be run"));
+
+    printf("crash (OK)\n");
+    return 0;
+}
@@ -0,0 +1,16 @@
+#include <signal.h>
+#include "bdd-for-c.h"
+
+spec("crash") {
+    it("should pass before the crash") {
+        check(true);
+    }
+
+    it("should crash") {
+        raise(SIGSEGV);
+    }
+
+    it("should not be run after the crash") {
+        check(true);
+    }
+}
@@ -0,0 +1,99 @@
+#include "bdd-for-c.h"
+#include "spec-driver.h"
+
+int before_count;
+int run_count;
+
+spec("embedded runner") {
+    before() {
+        ++before_count;
+    }
+
+    it("should run in the process of the driver") {
+        ++run_count;
+        check(before_count == 1, "got: %d", before_count);
+    }
+
+    describe("failures") {
+        it("should be counted in the result") {
+            ++run_count;
+            check(false);
+        }
+    }
+}
+
+#ifndef _WIN32
+static void host_handler(int signal_number) {
+    (void)signal_number;
+}
+
+// The crash handlers of the runner are only installed while it runs
+static bool has_host_handler(void) {
+    struct sigaction current;
+    return sigaction(SIGSEGV, NULL, &current) == 0 && current.sa_handler == host_handler;
+}
+#endif
+
+int main(void) {
+    bdd_result result;
+#ifndef _WIN32
+    struct sigaction host;
+    memset(&host, 0, sizeof(host));
+    host.sa_handler = host_handler;
+    sigemptyset(&host.sa_mask);
+    sigaction(SIGSEGV, &host, NULL);
+#endif
+    for (int round = 0; round < 3; ++round) {
+        FILE *output = tmpfile();
+        bdd_options options = { .output = output, .filter = "driver" };
+        before_count = 0;
+        run_count = 0;
+        EXPECT(bdd_run(&options, &result) == 0);
+        EXPECT(result.test_count == 1);
+        EXPECT(result.failed_test_count == 0);
+        EXPECT(run_count == 1);
+        read_output(output);
+        EXPECT(strstr(spec_output, "should run in the process of the driver (OK)"));
+        EXPECT(!strstr(spec_output, "failures"));
+        fclose(output);
+    }
+
+    FILE *output = tmpfile();
+    bdd_options options = { .output = output, .use_tap = true };
+    before_count = 0;
+    EXPECT(bdd_run(&options, &result) == 1);
+    EXPECT(result.test_count == 2);
+    EXPECT(result.failed_test_count == 1);
+    EXPECT(result.rounds == 1);
+    read_output(output);
+    EXPECT(strstr(spec_output, "TAP version 13\n1..2\nok 1 - should run in the process of the driver\n"));
+    EXPECT(strstr(spec_output, "not ok 2 - should be counted in the result"));
+    fclose(output);
+#ifndef _WIN32
+    EXPECT(has_host_handler());
+#endif
+
+    // Runs that stop early still fill in the result
+    const char *early_variables[] = { "BDD_SHARD_COUNT", "BDD_REPEAT", "BDD_LIST" };
+    const char *early_values[] = { "0", "never", "1" };
+    for (size_t i = 0; i < sizeof(early_variables) / sizeof(early_variables[0]); ++i) {
+        output = tmpfile();
+        bdd_options early_options = { .output = output, .use_environment = true };
+        setenv(early_variables[i], early_values[i], 1);
+        memset(&result, 0xff, sizeof(result));
+        before_count = 0;
+        EXPECT(bdd_run(&early_options, &result) == (strcmp(early_variables[i], "BDD_LIST") == 0 ? 0 : 1));
+        unsetenv(early_variables[i]);
+        EXPECT(result.test_count == 0);
+        EXPECT(result.failed_test_count == 0);
+        EXPECT(result.rounds == 0);
+        EXPECT(before_count == 0);
+#ifndef _WIN32
+        EXPECT(has_host_handler());
+#endif
+        fclose(output);
+    }
+
+    printf("embedded runner (OK)\n");
+    return 0;
+}
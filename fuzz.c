@@ -0,0 +1,64 @@
+#include "bdd-for-c.h"
+
+static size_t seeds_seen;
+static size_t seed_bytes;
+static size_t setups;
+static size_t cleanups;
+
+// Counts the records of a buffer where every record starts with its length
+static size_t count_records(const unsigned char *data, size_t size, size_t *consumed) {
+    size_t count = 0;
+    size_t offset = 0;
+    while (offset < size) {
+        size_t length = data[offset];
+        if (length > size - offset - 1) {
+            break;
+        }
+        offset += 1 + length;
+        ++count;
+    }
+    *consumed = offset;
+    return count;
+}
+
+spec("fuzz") {
+    describe("fuzz_it") {
+        before_each() {
+            ++setups;
+        }
+
+        after_each() {
+            ++cleanups;
+        }
+
+        fuzz_it("should run every seed", data, size) {
+            ++seeds_seen;
+            seed_bytes += size;
+            check(data != NULL);
+            check(size > 0);
+            check(setups == seeds_seen, "before_each ran %zu times for %zu seeds", setups, seeds_seen);
+            check(cleanups == seeds_seen - 1, "after_each ran %zu times for %zu seeds", cleanups, seeds_seen);
+        }
+
+        it("should have run the seeds one at a time") {
+            check(seeds_seen == 2, "got: %zu", seeds_seen);
+            check(seed_bytes == 8, "got: %zu", seed_bytes);
+            check(setups == 3, "got: %zu", setups);
+            check(cleanups == 2, "got: %zu", cleanups);
+        }
+
+        fuzz_it("should run once with an empty input without seeds", data, size) {
+            check(data != NULL);
+            check(size == 0, "got: %zu", size);
+        }
+    }
+
+    describe("length-prefixed records") {
+        fuzz_it("should never read past the input", data, size) {
+            size_t consumed = 0;
+            size_t count = count_records(data, size, &consumed);
+            check(consumed <= size, "consumed %zu of %zu bytes", consumed, size);
+            check(count <= size);
+        }
+    }
+}
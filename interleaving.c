@@ -0,0 +1,90 @@
+#include "bdd-for-c.h"
+
+spec("interleaved tests") {
+    static int counter;
+    static int locked;
+    static int lost_updates;
+    static int schedules;
+
+    describe("an unsynchronized increment with a preemption") {
+        before() {
+            lost_updates = 0;
+            schedules = 0;
+        }
+
+        it_interleaved(2, 1, "should be explored in every order") {
+            interleaving_setup {
+                counter = 0;
+                ++schedules;
+            }
+            int value = counter;
+            bdd_yield();
+            counter = value + 1;
+            interleaving_verify {
+                lost_updates += counter != 2;
+            }
+        }
+
+        it("should have found the lost update") {
+            check(schedules > 1, "explored: %d", schedules);
+            check(lost_updates > 0);
+        }
+    }
+
+    describe("an unsynchronized increment without preemptions") {
+        before() {
+            lost_updates = 0;
+            schedules = 0;
+        }
+
+        it_interleaved(2, 0, "should only switch threads when they finish") {
+            interleaving_setup {
+                counter = 0;
+                ++schedules;
+            }
+            int value = counter;
+            bdd_yield();
+            counter = value + 1;
+            interleaving_verify {
+                lost_updates += counter != 2;
+            }
+        }
+
+        it("should not have lost any updates") {
+            check(schedules > 0);
+            check(lost_updates == 0, "lost: %d", lost_updates);
+        }
+    }
+
+    describe("a spin lock protected increment") {
+        it_interleaved(3, 2, "should never lose an update") {
+            interleaving_setup {
+                counter = 0;
+                locked = 0;
+            }
+            while (locked) {
+                bdd_yield();
+            }
+            locked = 1;
+            int value = counter;
+            bdd_yield();
+            counter = value + 1;
+            locked = 0;
+            bdd_yield();
+            interleaving_verify {
+                check(counter == 3, "got: %d", counter);
+            }
+        }
+
+        it_interleaved(3, 1, "should give each thread its own index") {
+            interleaving_setup {
+                counter = 0;
+            }
+            counter |= 1 << bdd_thread_index();
+            bdd_yield();
+            interleaving_verify {
+                check(counter == 7, "got: %d", counter);
+            }
+        }
+    }
+}
@@ -0,0 +1,13 @@
+#include "spec-driver.h"
+
+int main(void) {
+    EXPECT(run_spec(SPEC_EXECUTABLE, NULL) == 1);
+    EXPECT(strstr(spec_output, "\n9 tests run, 1 failed.\n"));
+    EXPECT(strstr(spec_output, "  should report the percentile over the limit (FAIL)\n"));
+    EXPECT(strstr(spec_output, "Check failed: p50 latency is "));
+    EXPECT(strstr(spec_output, " ms, expected at most 1.00 us\n"));
+    EXPECT(strstr(spec_output, "\n      3 samples: p50 "));
+
+    printf("latency (OK)\n");
+    return 0;
+}
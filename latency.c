@@ -0,0 +1,93 @@
+// The runtime is built into the spec to check the histogram directly
+#define BDD_IMPLEMENTATION
+#include "bdd-for-c.h"
+#include <time.h>
+
+static volatile unsigned sink;
+
+static __bdd_histogram__ histogram;
+
+spec("latency") {
+    describe("measure_latency") {
+        it("should keep the tail of a cheap operation short") {
+            measure_latency(100000) {
+                sink += 1;
+            }
+            check_percentile(50, 1 * BDD_MS);
+            check_percentile(99.9, 100 * BDD_MS);
+        }
+
+        it("should measure every run of a slower operation") {
+            struct timespec pause = { 0, 200 * BDD_US };
+            measure_latency(20) {
+                nanosleep(&pause, NULL);
+            }
+            check_percentile(100, 1000 * BDD_MS);
+        }
+
+        it("should add up the samples of several loops") {
+            measure_latency(10) {
+                sink += 1;
+            }
+            measure_latency(10) {
+                sink += 2;
+            }
+            check_percentile(90, 100 * BDD_MS);
+        }
+
+        it("should report the percentile over the limit") {
+            struct timespec pause = { 0, 2 * BDD_MS };
+            measure_latency(3) {
+                nanosleep(&pause, NULL);
+            }
+            check_percentile(50, 1 * BDD_US);
+        }
+    }
+
+    describe("the histogram") {
+        before_each() {
+            memset(&histogram, 0, sizeof(histogram));
+        }
+
+        it("should give the values below 128 ns a bucket each") {
+            check(__bdd_histogram_index__(0) == 0);
+            check(__bdd_histogram_index__(127) == 127);
+            check(__bdd_histogram_value__(127) == 127);
+        }
+
+        it("should split every power of two above into 64 buckets") {
+            check(__bdd_histogram_index__(128) == 128);
+            check(__bdd_histogram_index__(129) == 128);
+            check(__bdd_histogram_value__(128) == 129);
+            check(__bdd_histogram_index__(255) == 191);
+            check(__bdd_histogram_value__(191) == 255);
+            check(__bdd_histogram_index__(256) == 192);
+            check(__bdd_histogram_value__(192) == 259);
+        }
+
+        it("should keep the error of a large value within a 64th of it") {
+            unsigned long long value = 1234567891ull;
+            unsigned long long bucket = __bdd_histogram_value__(__bdd_histogram_index__(value));
+            check(bucket >= value && bucket - value <= value / 64, "got %llu", bucket);
+            check(__bdd_histogram_index__(~0ull) == __BDD_HISTOGRAM_SIZE__ - 1);
+            check(__bdd_histogram_value__(__BDD_HISTOGRAM_SIZE__ - 1) == ~0ull);
+        }
+
+        it("should give the highest value of the bucket of a percentile") {
+            unsigned long long values[] = { 127, 128, 255, 256 };
+            for (size_t i = 0; i < 4; ++i) {
+                __bdd_histogram_record__(&histogram, values[i]);
+            }
+            check(__bdd_histogram_percentile__(&histogram, 0) == 127);
+            check(__bdd_histogram_percentile__(&histogram, 25) == 127);
+            check(__bdd_histogram_percentile__(&histogram, 50) == 129);
+            check(__bdd_histogram_percentile__(&histogram, 75) == 255);
+        }
+
+        it("should not give more than the largest value") {
+            __bdd_histogram_record__(&histogram, 256);
+            check(__bdd_histogram_percentile__(&histogram, 100) == 256);
+            check(__bdd_histogram_percentile__(&histogram, 50) == 256);
+        }
+    }
+}
@@ -0,0 +1,24 @@
+#include "spec-driver.h"
+
+// The line of the `it` with a computed name in meta-names.c
+static const int computed_line = 12;
+
+int main(void) {
+    const char *run[] = { "BDD_LIST", NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, run) == 0);
+    EXPECT(count_in_output(" (OK)\n") == 3);
+    EXPECT(strstr(spec_output, "  should take the first name (OK)\n"));
+    EXPECT(strstr(spec_output, "  should take the second name (OK)\n"));
+
+#if defined(__GNUC__) && defined(__ELF__) && !defined(BDD_NO_META)
+    char line[128];
+    const char *list[] = { "BDD_LIST=1", NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, list) == 0);
+    EXPECT(strstr(spec_output, "\ttest\tshould be listed by its name\n"));
+    snprintf(line, sizeof(line), "meta-names.c:%d\ttest\t(not a literal)\n", computed_line);
+    EXPECT(strstr(spec_output, line));
+#endif
+
+    printf("meta names (OK)\n");
+    return 0;
+}
@@ -0,0 +1,16 @@
+#include "bdd-for-c.h"
+
+static const char *names[] = { "should take the first name", "should take the second name" };
+
+spec("meta names") {
+    it("should be listed by its name") {
+        check(true);
+    }
+
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        const char *name = names[i];
+        it(name) {
+            check(strcmp(name, names[i]) == 0);
+        }
+    }
+}
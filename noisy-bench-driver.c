@@ -0,0 +1,45 @@
+// For `sched_getaffinity`, to pin to a cpu that the spec may use
+#define _GNU_SOURCE
+#include <sched.h>
+#include "spec-driver.h"
+
+int main(void) {
+    // Built with a BDD_NOISY_CV that every benchmark is above
+    const char *environment[] = { "BDD_ENVIRONMENT=1", "BDD_PIN_CPU", NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, environment) == 0);
+    EXPECT(strncmp(spec_output, "cpu: ", strlen("cpu: ")) == 0);
+    EXPECT(strstr(spec_output, " online, not pinned\n"));
+    EXPECT(strstr(spec_output, "\ngovernor: "));
+    EXPECT(count_in_output(" per run, median of 30 samples of ") == 2);
+    EXPECT(strstr(spec_output, " runs, noisy\n"));
+    EXPECT(strstr(spec_output, "% of their mean, above the 0.0% allowed by BDD_NOISY_CV\n"));
+    EXPECT(strstr(spec_output, "      not compared with up, the samples are too noisy\n"));
+    EXPECT(!strstr(spec_output, "than up"));
+
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t allowed;
+    EXPECT(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed)) {
+        ++cpu;
+    }
+    char pin_cpu[32], pinned[64];
+    snprintf(pin_cpu, sizeof(pin_cpu), "BDD_PIN_CPU=%d", cpu);
+    snprintf(pinned, sizeof(pinned), " online, pinned to cpu %d\n", cpu);
+    const char *pinning[] = { "BDD_ENVIRONMENT=1", pin_cpu, NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, pinning) == 0);
+    EXPECT(strstr(spec_output, pinned));
+#endif
+
+    const char *invalid[] = {
+        "BDD_PIN_CPU=-1", "BDD_PIN_CPU=first", "BDD_PIN_CPU=1x", "BDD_PIN_CPU=99999999999999999999"
+    };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        const char *environment[] = { "BDD_ENVIRONMENT=1", invalid[i], NULL };
+        EXPECT(run_spec(SPEC_EXECUTABLE, environment) == 1);
+        EXPECT(!strstr(spec_output, "cpu: "));
+    }
+
+    printf("noisy benchmarks (OK)\n");
+    return 0;
+}
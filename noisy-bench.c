@@ -0,0 +1,19 @@
+#include "bdd-for-c.h"
+
+static volatile unsigned sink;
+
+spec("noisy benchmarks") {
+    describe("counting") {
+        bench_variant("up") {
+            for (unsigned i = 0; i < 64; ++i) {
+                sink = i;
+            }
+        }
+
+        bench_variant("down") {
+            for (unsigned i = 64; i > 0; --i) {
+                sink = i;
+            }
+        }
+    }
+}
@@ -0,0 +1,35 @@
+#include "spec-driver.h"
+
+int main(void) {
+    const char *repeat[] = { "BDD_REPEAT=3", "BDD_REPEAT_UNTIL_FAIL", "REPEAT_TEST_STABLE_FAILS=1", NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, repeat) == 1);
+    EXPECT(strstr(spec_output, "round 2: should fail every other time (FAIL)\n"));
+    EXPECT(strstr(spec_output, "round 3: should fail when told to (FAIL)\n"));
+    EXPECT(!strstr(spec_output, "round 3: should fail every other time"));
+    EXPECT(strstr(spec_output, "\nRepeated 3 times:\n"));
+    EXPECT(strstr(spec_output, "\n  should pass every time: 3 passed, 0 failed, min "));
+    EXPECT(strstr(spec_output, "\n  should fail every other time: 2 passed, 1 failed (flaky), min "));
+    EXPECT(strstr(spec_output, "\n  should fail when told to: 0 passed, 3 failed, min "));
+
+    // Stops at the first round with a failure
+    const char *until_fail[] = { "BDD_REPEAT", "BDD_REPEAT_UNTIL_FAIL=1", "REPEAT_TEST_STABLE_FAILS", NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, until_fail) == 1);
+    EXPECT(strstr(spec_output, "\nRepeated 2 times:\n"));
+
+    // And after `BDD_REPEAT` rounds if none fails
+    const char *once[] = { "BDD_REPEAT=1", "BDD_REPEAT_UNTIL_FAIL=1", "REPEAT_TEST_STABLE_FAILS", NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, once) == 0);
+    EXPECT(!strstr(spec_output, "Repeated"));
+
+    const char *invalid[] = { "0", "-1", "often", "2x" };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i) {
+        char variable[64];
+        snprintf(variable, sizeof(variable), "BDD_REPEAT=%s", invalid[i]);
+        const char *environment[] = { variable, "BDD_REPEAT_UNTIL_FAIL", NULL };
+        EXPECT(run_spec(SPEC_EXECUTABLE, environment) == 1);
+        EXPECT(strstr(spec_output, "BDD_REPEAT must be a positive number of rounds: "));
+    }
+
+    printf("repeat (OK)\n");
+    return 0;
+}
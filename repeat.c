@@ -0,0 +1,17 @@
+#include "bdd-for-c.h"
+
+static int flaky_runs;
+
+spec("repeat") {
+    it("should pass every time") {
+        check(true);
+    }
+
+    it("should fail every other time") {
+        check(++flaky_runs % 2 == 1);
+    }
+
+    it("should fail when told to") {
+        check(!getenv("REPEAT_TEST_STABLE_FAILS"));
+    }
+}
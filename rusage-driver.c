@@ -0,0 +1,27 @@
+#include "spec-driver.h"
+
+int main(void) {
+    const char *environment[] = { "BDD_RUSAGE=1", NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, environment) == 1);
+    EXPECT(strstr(spec_output, "\n3 tests run, 1 failed.\n"));
+
+    // Every test is followed by its resource usage
+    const char *touched = strstr(spec_output, "should account for memory that was touched and released (OK)\n");
+    EXPECT(touched);
+    const char *usage = strstr(touched, "\n      peak rss ");
+    EXPECT(usage);
+    const char *growth = strstr(usage, " (+");
+    EXPECT(growth);
+    double mebibytes = 0;
+    EXPECT(sscanf(growth, " (+%lf MiB), faults ", &mebibytes) == 1);
+    EXPECT(mebibytes >= 30);
+    EXPECT(strstr(usage, " minor / "));
+    EXPECT(strstr(usage, " involuntary, blocks "));
+
+    EXPECT(strstr(spec_output, "should fail when the process is above the limit (FAIL)"));
+    EXPECT(strstr(spec_output, "Check failed: resident set size is "));
+    EXPECT(strstr(spec_output, ", expected less than 1.0 MiB\n"));
+
+    printf("resource usage (OK)\n");
+    return 0;
+}
@@ -0,0 +1,24 @@
+#include "bdd-for-c.h"
+
+#define MEBIBYTE (1024ull * 1024ull)
+
+spec("resource usage") {
+    describe("check_rss_below") {
+        it("should pass when the process is below the limit") {
+            check_rss_below(1024 * MEBIBYTE);
+        }
+
+        it("should account for memory that was touched and released") {
+            size_t size = 32 * MEBIBYTE;
+            char *buffer = malloc(size);
+            check(buffer != NULL);
+            memset(buffer, 1, size);
+            free(buffer);
+            check_rss_below(1024 * MEBIBYTE);
+        }
+
+        it("should fail when the process is above the limit") {
+            check_rss_below(MEBIBYTE);
+        }
+    }
+}
@@ -0,0 +1,112 @@
+#include "spec-driver.h"
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "spec-driver.h"
+
+static char socket_path[64];
+
+// Sends a request and reads the whole reply into `spec_output`,
+// which ends when the child closes it
+static bool request(const char *text) {
+    spec_output_size = 0;
+    spec_output[0] = '\0';
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, socket_path);
+    int client = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (client < 0 || connect(client, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        if (client >= 0) {
+            close(client);
+        }
+        return false;
+    }
+    bool sent = write(client, text, strlen(text)) == (ssize_t)strlen(text) && shutdown(client, SHUT_WR) == 0;
+    ssize_t received;
+    while (
+        sent && spec_output_size < sizeof(spec_output) - 1 &&
+        (received = read(client, spec_output + spec_output_size, sizeof(spec_output) - 1 - spec_output_size)) > 0
+    ) {
+        spec_output_size += (size_t)received;
+    }
+    spec_output[spec_output_size] = '\0';
+    close(client);
+    return sent;
+}
+
+static int check_requests(void) {
+    // The server only accepts connections after the discovery
+    bool connected = false;
+    for (int attempt = 0; attempt < 100 && !connected; ++attempt) {
+        connected = request("list\n\n");
+        if (!connected) {
+            poll(NULL, 0, 50);
+        }
+    }
+    EXPECT(connected);
+    EXPECT(strstr(spec_output, "\ttest\tshould start from the state after the discovery\n"));
+    EXPECT(strstr(spec_output, "\tgroup\ta group\n"));
+    EXPECT(strstr(spec_output, "\ttest\ta group / should be selected by its path\n"));
+    EXPECT(strstr(spec_output, "\ttest\ta group / should fail\n"));
+    EXPECT(!strstr(spec_output, "before"));
+
+    // Ids are the first column of the list
+    const char *line = strstr(spec_output, "\ttest\tshould start from the state after the discovery\n");
+    while (line > spec_output && line[-1] != '\n') {
+        --line;
+    }
+    char run_by_id[32];
+    snprintf(run_by_id, sizeof(run_by_id), "run\n%d\n\n", atoi(line));
+
+    // Every request starts from the state after the discovery
+    for (int i = 0; i < 2; ++i) {
+        EXPECT(request(run_by_id));
+        EXPECT(strstr(spec_output, "should start from the state after the discovery (OK)\n"));
+        EXPECT(strstr(spec_output, "\n1 test run, 0 failed.\n"));
+    }
+
+    EXPECT(request("run\nshould wait for its own children\n\n"));
+    EXPECT(strstr(spec_output, "should wait for its own children (OK)\n"));
+    EXPECT(strstr(spec_output, "\n1 test run, 0 failed.\n"));
+
+    EXPECT(request("run\na group / should be selected by its path\n"));
+    EXPECT(strstr(spec_output, "a group\n"));
+    EXPECT(strstr(spec_output, "should be selected by its path (OK)\n"));
+    EXPECT(!strstr(spec_output, "should fail"));
+    EXPECT(strstr(spec_output, "\n1 test run, 0 failed.\n"));
+
+    EXPECT(request("run\na group\n\n"));
+    EXPECT(strstr(spec_output, "Check failed: as expected"));
+    EXPECT(strstr(spec_output, "\n2 tests run, 1 failed.\n"));
+
+    EXPECT(request("stop\n\n"));
+    EXPECT(strstr(spec_output, "Unknown request"));
+    return 0;
+}
+
+int main(void) {
+    char directory[] = "/tmp/bdd-server-test-XXXXXX";
+    if (!mkdtemp(directory)) {
+        perror(directory);
+        return 1;
+    }
+    snprintf(socket_path, sizeof(socket_path), "%s/spec.sock", directory);
+    char server[80];
+    snprintf(server, sizeof(server), "BDD_SERVER=%s", socket_path);
+
+    const char *environment[] = { server, NULL };
+    spec_process process = start_spec(SPEC_EXECUTABLE, environment);
+    int status = check_requests();
+
+    // The server runs until it is stopped
+    kill(process.pid, SIGTERM);
+    finish_spec(&process);
+    unlink(socket_path);
+    rmdir(directory);
+    if (status == 0) {
+        printf("server (OK)\n");
+    }
+    return status;
+}
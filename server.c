@@ -0,0 +1,31 @@
+#include <sys/wait.h>
+#include "bdd-for-c.h"
+
+spec("server") {
+    static int runs;
+
+    it("should start from the state after the discovery") {
+        check(++runs == 1, "ran %d times", runs);
+    }
+
+    it("should wait for its own children") {
+        check(system("true") == 0);
+        pid_t child = fork();
+        if (child == 0) {
+            _exit(3);
+        }
+        int status = 0;
+        check(waitpid(child, &status, 0) == child, "%s", strerror(errno));
+        check(WIFEXITED(status) && WEXITSTATUS(status) == 3);
+    }
+
+    describe("a group") {
+        it("should be selected by its path") {
+            check(true);
+        }
+
+        it("should fail") {
+            check(false, "as expected");
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#include "spec-driver.h"
+
+int main(void) {
+    const char *environment[] = { "BDD_UPDATE_SNAPSHOTS", NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, environment) == 1);
+    EXPECT(strstr(spec_output, "\n3 tests run, 3 failed."));
+
+    EXPECT(strstr(spec_output, "record.snap differs at byte 20 (expected 40 bytes, got 40)"));
+    EXPECT(strstr(spec_output, "expected:\n      00000000  30  31  32  33 "));
+    EXPECT(strstr(spec_output, "\n      00000010  67  68  69  6a [6b] 6c "));
+    EXPECT(strstr(spec_output, "\n      00000010  67  68  69  6a [4b] 6c "));
+    EXPECT(strstr(spec_output, " |ghijKlmnopqrstuv|"));
+    EXPECT(strstr(spec_output, "record.snap differs at byte 10 (expected 40 bytes, got 10)"));
+    EXPECT(strstr(spec_output, "actual:\n      00000000  30  31  32  33  34  35  36  37  38  39                          |0123456789|\n"));
+    EXPECT(strstr(spec_output, "missing.snap does not exist, run with BDD_UPDATE_SNAPSHOTS=1 to create it"));
+
+    printf("snapshot failures (OK)\n");
+    return 0;
+}
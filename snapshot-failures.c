@@ -0,0 +1,18 @@
+#include "bdd-for-c.h"
+
+spec("snapshot failures") {
+    describe("mismatches") {
+        it("should report the first differing byte") {
+            const char *record = "0123456789abcdefghijKlmnopqrstuvwxyzABCD";
+            check_snapshot(record, strlen(record), "record");
+        }
+
+        it("should report a shorter output") {
+            check_snapshot("0123456789", 10, "record");
+        }
+
+        it("should report a missing snapshot") {
+            check_snapshot("anything", 8, "missing");
+        }
+    }
+}
@@ -0,0 +1,30 @@
+#include "bdd-for-c.h"
+#include <stdio.h>
+
+static size_t render_table(char *buffer, size_t size, int rows) {
+    size_t length = 0;
+    for (int i = 0; i < rows && length < size; ++i) {
+        length += snprintf(buffer + length, size - length, "%5d | %08x | %s\n", i, i * 2654435761u, i % 3 ? "odd" : "even");
+    }
+    return length;
+}
+
+spec("snapshot") {
+    describe("check_snapshot") {
+        it("should match a small text output") {
+            const char *greeting = "Hello, snapshot!\n";
+            check_snapshot(greeting, strlen(greeting), "greeting");
+        }
+
+        it("should match a large generated output") {
+            static char table[64 * 1024];
+            size_t length = render_table(table, sizeof(table), 2000);
+            check(length > 32 * 1024, "got %zu bytes", length);
+            check_snapshot(table, length, "table");
+        }
+
+        it("should match an empty output") {
+            check_snapshot("", 0, "empty");
+        }
+    }
+}
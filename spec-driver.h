@@ -0,0 +1,128 @@
+#ifndef BDD_SPEC_DRIVER_H
+#define BDD_SPEC_DRIVER_H
+
+// Helpers for the tests that run a spec and check what it printed, or the
+// files that it wrote, which the spec cannot check from the inside.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#ifndef _WIN32
+  #include <poll.h>
+  #include <unistd.h>
+  #include <sys/wait.h>
+#endif
+
+// Everything the spec printed, to look for with `strstr`
+static char spec_output[65536];
+static size_t spec_output_size;
+
+// Ends the test with the output of the spec if the condition does not hold
+#define EXPECT(condition) do {\
+    if (!(condition)) {\
+        fprintf(stderr, "%s:%d: expected %s\n%s", __FILE__, __LINE__, #condition, spec_output);\
+        return 1;\
+    }\
+} while (0)
+
+static int count_in_output(const char *text) {
+    int count = 0;
+    for (const char *c = strstr(spec_output, text); c; c = strstr(c + 1, text)) {
+        ++count;
+    }
+    return count;
+}
+
+// Reads what an embedded run wrote to its output into `spec_output`
+static const char *read_output(FILE *output) {
+    rewind(output);
+    spec_output_size = fread(spec_output, 1, sizeof(spec_output) - 1, output);
+    spec_output[spec_output_size] = '\0';
+    return spec_output;
+}
+
+#ifndef _WIN32
+typedef struct spec_process {
+    pid_t pid;
+    int output;
+} spec_process;
+
+// Starts the spec with its stdout and stderr on a pipe. The environment
+// is a NULL terminated list of `NAME=value` to set and `NAME` to unset.
+static spec_process start_spec(const char *executable, const char *const *environment) {
+    spec_output_size = 0;
+    spec_output[0] = '\0';
+    int fds[2];
+    if (pipe(fds) != 0) {
+        perror("pipe");
+        abort();
+    }
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        abort();
+    }
+    if (pid == 0) {
+        dup2(fds[1], 1);
+        dup2(fds[1], 2);
+        close(fds[0]);
+        close(fds[1]);
+        for (const char *const *variable = environment; variable && *variable; ++variable) {
+            const char *value = strchr(*variable, '=');
+            if (value) {
+                char name[256];
+                snprintf(name, sizeof(name), "%.*s", (int)(value - *variable), *variable);
+                setenv(name, value + 1, 1);
+            } else {
+                unsetenv(*variable);
+            }
+        }
+        execl(executable, executable, (char *)NULL);
+        perror(executable);
+        _exit(127);
+    }
+    close(fds[1]);
+    spec_process process = { pid, fds[0] };
+    return process;
+}
+
+// Adds what the spec printed within the timeout to `spec_output`.
+// Returns false once the spec closed its output.
+static bool read_spec_output(spec_process *process, int timeout_ms) {
+    struct pollfd output_poll = { process->output, POLLIN, 0 };
+    if (poll(&output_poll, 1, timeout_ms) <= 0) {
+        return true;
+    }
+    char buffer[4096];
+    ssize_t size = read(process->output, buffer, sizeof(buffer));
+    if (size <= 0) {
+        return false;
+    }
+    size_t room = sizeof(spec_output) - 1 - spec_output_size;
+    size_t kept = (size_t)size < room ? (size_t)size : room;
+    memcpy(spec_output + spec_output_size, buffer, kept);
+    spec_output_size += kept;
+    spec_output[spec_output_size] = '\0';
+    return true;
+}
+
+// Reads the rest of the output and waits for the spec to exit. Returns
+// its exit code, or 128 and the number of the signal that killed it.
+static int finish_spec(spec_process *process) {
+    while (read_spec_output(process, -1)) {
+    }
+    close(process->output);
+    int status = 0;
+    waitpid(process->pid, &status, 0);
+    return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+static int run_spec(const char *executable, const char *const *environment) {
+    spec_process process = start_spec(executable, environment);
+    return finish_spec(&process);
+}
+#endif
+
+#endif //BDD_SPEC_DRIVER_H
@@ -0,0 +1,13 @@
+#include "bdd-for-c.h"
+
+extern int before_each_count;
+
+spec_part(other_file_tests) {
+    it("should be defined in a separate translation unit") {
+        check(1 + 1 == 2);
+    }
+
+    it("should run the hooks of the including spec") {
+        check(before_each_count == 3, "got: %d", before_each_count);
+    }
+}
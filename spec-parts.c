@@ -0,0 +1,19 @@
+#include "bdd-for-c.h"
+
+int before_each_count;
+
+spec_part(other_file_tests);
+
+spec("spec parts") {
+    before_each() {
+        ++before_each_count;
+    }
+
+    it("should run tests from the main file") {
+        check(before_each_count == 1, "got: %d", before_each_count);
+    }
+
+    describe("tests from another file") {
+        include_spec_part(other_file_tests);
+    }
+}
@@ -0,0 +1,40 @@
+#include "spec-driver.h"
+
+static const char *timing_file = "timing-test.txt";
+
+// Duration of the group in the history, or -1 if it is not there
+static double duration_ms(const char *group) {
+    char line[256];
+    double duration = -1;
+    FILE *fp = fopen(timing_file, "r");
+    while (fp && fgets(line, sizeof(line), fp)) {
+        line[strcspn(line, "\n")] = '\0';
+        char *separator = strchr(line, '\t');
+        if (separator && strcmp(separator + 1, group) == 0) {
+            duration = strtod(line, NULL) / 1e6;
+        }
+    }
+    if (fp) {
+        fclose(fp);
+    }
+    return duration;
+}
+
+int main(void) {
+    FILE *fp = fopen(timing_file, "w");
+    fputs("123000000\tskipped\n", fp);
+    fclose(fp);
+
+    const char *environment[] = { "BDD_TIMING_FILE=timing-test.txt", NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, environment) == 0);
+
+    EXPECT(duration_ms("slow cleanup") >= 50);
+    EXPECT(duration_ms("fast") >= 0);
+    EXPECT(duration_ms("fast") < 30);
+    // Groups without tests that ran keep their history
+    EXPECT(duration_ms("skipped") == 123);
+
+    remove(timing_file);
+    printf("timing history (OK)\n");
+    return 0;
+}
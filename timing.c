@@ -0,0 +1,31 @@
+#include "bdd-for-c.h"
+#include <time.h>
+
+static void sleep_ms(long ms) {
+    struct timespec duration = { ms / 1000, (ms % 1000) * 1000000 };
+    nanosleep(&duration, NULL);
+}
+
+spec("timing history") {
+    describe("slow cleanup") {
+        after_each() {
+            sleep_ms(60);
+        }
+
+        it("should be charged for its after_each") {
+            check(true);
+        }
+    }
+
+    describe("fast") {
+        it("should not be charged for the cleanup before it") {
+            check(true);
+        }
+    }
+
+    describe("skipped") {
+        xit("should not be run") {
+            check(false);
+        }
+    }
+}
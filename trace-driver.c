@@ -0,0 +1,138 @@
+#include <ctype.h>
+#include "spec-driver.h"
+
+static const char *trace_file = "trace-test.json";
+
+static char text[65536];
+
+static const char *read_file(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        return NULL;
+    }
+    size_t size = fread(text, 1, sizeof(text) - 1, fp);
+    text[size] = '\0';
+    fclose(fp);
+    return text;
+}
+
+// A strict reader of JSON values that only checks their syntax
+static const char *skip_space(const char *c) {
+    while (*c == ' ' || *c == '\n' || *c == '\r' || *c == '\t') {
+        ++c;
+    }
+    return c;
+}
+
+static const char *read_value(const char *c);
+
+static const char *read_string(const char *c) {
+    if (*c++ != '"') {
+        return NULL;
+    }
+    while (*c != '"') {
+        if ((unsigned char)*c < 0x20) {
+            return NULL;
+        }
+        if (*c == '\\') {
+            ++c;
+            if (*c == 'u') {
+                for (int i = 1; i <= 4; ++i) {
+                    if (!isxdigit((unsigned char)c[i])) {
+                        return NULL;
+                    }
+                }
+                c += 4;
+            } else if (!strchr("\"\\/bfnrt", *c)) {
+                return NULL;
+            }
+        }
+        ++c;
+    }
+    return c + 1;
+}
+
+static const char *read_number(const char *c) {
+    char *end;
+    strtod(c, &end);
+    return end == c ? NULL : end;
+}
+
+static const char *read_list(const char *c, char close, bool members) {
+    c = skip_space(c + 1);
+    if (*c == close) {
+        return c + 1;
+    }
+    while (c) {
+        if (members) {
+            c = read_string(skip_space(c));
+            if (!c || *(c = skip_space(c)) != ':') {
+                return NULL;
+            }
+            ++c;
+        }
+        c = read_value(c);
+        if (!c) {
+            return NULL;
+        }
+        c = skip_space(c);
+        if (*c == close) {
+            return c + 1;
+        }
+        if (*c++ != ',') {
+            return NULL;
+        }
+    }
+    return NULL;
+}
+
+static const char *read_value(const char *c) {
+    c = skip_space(c);
+    switch (*c) {
+        case '{': return read_list(c, '}', true);
+        case '[': return read_list(c, ']', false);
+        case '"': return read_string(c);
+        case 't': return strncmp(c, "true", 4) == 0 ? c + 4 : NULL;
+        case 'f': return strncmp(c, "false", 5) == 0 ? c + 5 : NULL;
+        case 'n': return strncmp(c, "null", 4) == 0 ? c + 4 : NULL;
+        default: return read_number(c);
+    }
+}
+
+static int count_of(const char *haystack, const char *needle) {
+    int count = 0;
+    for (const char *c = strstr(haystack, needle); c; c = strstr(c + 1, needle)) {
+        ++count;
+    }
+    return count;
+}
+
+int main(void) {
+    remove(trace_file);
+    const char *environment[] = { "BDD_TRACE_FILE=trace-test.json", "BDD_STATS=1", NULL };
+    EXPECT(run_spec(SPEC_EXECUTABLE, environment) == 0);
+    EXPECT(count_in_output(" (OK)\n") == 2);
+    EXPECT(strstr(spec_output, "\nFramework statistics:\n"));
+    EXPECT(strstr(spec_output, "  enter_node: 7 during discovery, "));
+    EXPECT(strstr(spec_output, "  spec runs: 1 discovery, 8 re-entries\n"));
+    EXPECT(strstr(spec_output, "  allocations: "));
+    EXPECT(strstr(spec_output, "  time: discovery "));
+
+    const char *trace = read_file(trace_file);
+    EXPECT(trace);
+    const char *end = read_value(trace);
+    EXPECT(end && *skip_space(end) == '\0');
+
+    // One event for every step that ran: before, two before_each, two
+    // tests, two after_each and after, then the group and the spec
+    EXPECT(count_of(trace, "\"cat\":\"test\"") + count_of(trace, "\"cat\":\"hook\"") == 8);
+    EXPECT(count_of(trace, "\"cat\":\"test\"") == 2);
+    EXPECT(count_of(trace, "\"name\":\"before_each\",\"cat\":\"hook\"") == 2);
+    EXPECT(count_of(trace, "\"path\":\"a \\\"quoted\\\" group / should trace a nested test\"") == 1);
+    EXPECT(count_of(trace, "\"cat\":\"group\"") == 1);
+    EXPECT(count_of(trace, "\"cat\":\"spec\"") == 1);
+
+    remove(trace_file);
+    printf("trace (OK)\n");
+    return 0;
+}
@@ -0,0 +1,31 @@
+#include "bdd-for-c.h"
+
+static int steps;
+
+spec("trace") {
+    before() {
+        ++steps;
+    }
+
+    before_each() {
+        ++steps;
+    }
+
+    after_each() {
+        ++steps;
+    }
+
+    it("should trace a test") {
+        ++steps;
+    }
+
+    describe("a \"quoted\" group") {
+        it("should trace a nested test") {
+            ++steps;
+        }
+    }
+
+    after() {
+        ++steps;
+    }
+}
@@ -0,0 +1,85 @@
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include "spec-driver.h"
+
+// Copies the executable in a single step, like a linker replacing it
+static bool copy_file(const char *from, const char *to) {
+    char temporary[4096];
+    snprintf(temporary, sizeof(temporary), "%s.new", to);
+    int in = open(from, O_RDONLY);
+    int out = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0755);
+    char buffer[65536];
+    ssize_t size;
+    bool copied = in >= 0 && out >= 0;
+    while (copied && (size = read(in, buffer, sizeof(buffer))) > 0) {
+        copied = write(out, buffer, (size_t)size) == size;
+    }
+    if (in >= 0) {
+        close(in);
+    }
+    if (out >= 0) {
+        copied = close(out) == 0 && copied;
+    }
+    return copied && rename(temporary, to) == 0;
+}
+
+static bool is_empty(const char *directory) {
+    DIR *dir = opendir(directory);
+    struct dirent *entry;
+    bool empty = dir != NULL;
+    while (dir && (entry = readdir(dir))) {
+        empty &= strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0;
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    return empty;
+}
+
+static const char *waiting = "Waiting for the executable to be rebuilt...";
+
+int main(void) {
+    char directory[] = "/tmp/bdd-watch-test-XXXXXX";
+    EXPECT(mkdtemp(directory));
+    char temp_directory[64], executable[64], tmpdir[80];
+    snprintf(temp_directory, sizeof(temp_directory), "%s/tmp", directory);
+    snprintf(executable, sizeof(executable), "%s/watch", directory);
+    snprintf(tmpdir, sizeof(tmpdir), "TMPDIR=%s", temp_directory);
+    EXPECT(mkdir(temp_directory, 0700) == 0);
+    EXPECT(copy_file(SPEC_EXECUTABLE, executable));
+
+    const char *environment[] = { "BDD_WATCH=1", tmpdir, "WATCH_TEST_REBUILT", "BDD_WATCH_STATE", NULL };
+    spec_process process = start_spec(executable, environment);
+
+    // Rebuilds until the new executable is waiting too, since the first
+    // one only watches its directory after printing that it waits
+    bool state_removed = false;
+    for (int attempt = 0; attempt < 100 && count_in_output(waiting) < 2; ++attempt) {
+        if (!read_spec_output(&process, 200)) {
+            break;
+        }
+        if (count_in_output(waiting) == 1) {
+            state_removed = is_empty(temp_directory);
+            EXPECT(copy_file(SPEC_EXECUTABLE, executable));
+        }
+    }
+    kill(process.pid, SIGTERM);
+    finish_spec(&process);
+
+    remove(executable);
+    rmdir(temp_directory);
+    rmdir(directory);
+
+    EXPECT(count_in_output(waiting) == 2);
+    EXPECT(strstr(spec_output, "  should be fixed by the rebuild (FAIL)\n"));
+    EXPECT(strstr(spec_output, "\n2 tests, 1 failing. Waiting"));
+    EXPECT(strstr(spec_output, "\nFIXED  should be fixed by the rebuild\n"));
+    EXPECT(strstr(spec_output, "\n2 tests, 0 failing. Waiting"));
+    EXPECT(count_in_output("should pass every time") == 1);
+    EXPECT(state_removed);
+
+    printf("watch (OK)\n");
+    return 0;
+}
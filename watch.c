@@ -0,0 +1,16 @@
+#include "bdd-for-c.h"
+
+spec("watch") {
+    it("should pass every time") {
+        check(true);
+    }
+
+    it("should be fixed by the rebuild") {
+        check(getenv("WATCH_TEST_REBUILT"), "not rebuilt yet");
+    }
+
+    after() {
+        // The runner starts the rebuilt executable with this environment
+        setenv("WATCH_TEST_REBUILT", "1", 1);
+    }
+}